@@ -1,8 +1,12 @@
 ﻿#include "Application.h"
 #include "ApplicationConfiguration.h"
+#include "Audio/AudioCache.h"
+#include "Audio/OfflineRenderer.h"
 #include "Colors.h"
 #include "IO.h"
+#include "ImageLoader.h"
 #include "Localization.h"
+#include "Profiler.h"
 #include "ResourceManager.h"
 #include "Utilities.h"
 #include <filesystem>
@@ -16,6 +20,8 @@ namespace MikuMikuWorld
 	std::string Application::appDir;
 	std::string Application::pendingLoadScoreFile;
 	WindowState Application::windowState;
+	FrameStatistics Application::frameStatistics;
+	std::atomic<bool> Application::redrawRequested{ false };
 
 	NoteTextures noteTextures{ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 };
 
@@ -59,6 +65,118 @@ namespace MikuMikuWorld
 		return Result::Ok();
 	}
 
+	int Application::renderAudio(const std::string& root, const std::string& scoreFilename,
+	                             const std::string& outputFilename)
+	{
+		attachParentConsole();
+
+		appDir = root;
+		config.read(appDir + APP_CONFIG_FILENAME);
+
+		Score score;
+		try
+		{
+			std::string workingFilename;
+			score = ScoreEditor::readScoreFile(scoreFilename, workingFilename);
+		}
+		catch (std::exception& error)
+		{
+			fprintf(stderr, "Failed to load %s: %s\n", scoreFilename.c_str(), error.what());
+			return 1;
+		}
+
+		Audio::OfflineRenderSettings settings{};
+		settings.musicFilename = score.metadata.musicFile;
+		settings.musicOffset = score.metadata.musicOffset / 1000.0f;
+		settings.soundEffectsProfileIndex = config.seProfileIndex;
+		settings.masterVolume = config.masterVolume;
+		settings.musicVolume = config.bgmVolume;
+		settings.soundEffectsVolume = config.seVolume;
+
+		// Click until the music ends like the editor's export, or up to the last note without it
+		const float musicLength = Audio::getAudioFileLength(settings.musicFilename);
+		NoteSoundTimeline sounds;
+		sounds.setMetronome(config.renderMetronome,
+		                    musicLength > 0.0f ? musicLength + settings.musicOffset : 0.0f);
+		sounds.build(score);
+
+		Audio::OfflineRenderer renderer;
+		renderer.renderAsync(std::move(sounds), std::move(settings), outputFilename);
+		while (!renderer.isFinished())
+		{
+			printf("\rRendering %s %3.0f%%", outputFilename.c_str(), renderer.getProgress() * 100);
+			fflush(stdout);
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+
+		Result result = renderer.finish();
+		if (!result.isOk())
+		{
+			fprintf(stderr, "\nFailed to render %s: %s\n", outputFilename.c_str(),
+			        result.getMessage().c_str());
+			return 1;
+		}
+
+		printf("\rRendering %s 100%%\n", outputFilename.c_str());
+		return 0;
+	}
+
+	int Application::renderPreview(const std::string& root, const std::string& scoreFilename,
+	                               int startTick, int endTick, const std::string& outputFilename)
+	{
+		attachParentConsole();
+
+		appDir = root;
+		config.read(appDir + APP_CONFIG_FILENAME);
+
+		// There is no window to make an OpenGL context for, the sprites are drawn on the CPU
+		Texture::setHeadless(true);
+		TextureCache::setDirectory(appDir + "cache\\textures\\");
+		loadTextures();
+
+		ScoreContext context;
+		try
+		{
+			std::string workingFilename;
+			context.score = ScoreEditor::readScoreFile(scoreFilename, workingFilename);
+		}
+		catch (std::exception& error)
+		{
+			fprintf(stderr, "Failed to load %s: %s\n", scoreFilename.c_str(), error.what());
+			return 1;
+		}
+
+		ScoreEditorTimeline timeline;
+		timeline.setZoom(config.zoom);
+		timeline.laneWidth = config.timelineWidth;
+		timeline.notesHeight =
+		    config.matchNotesSizeToTimeline ? config.timelineWidth : config.notesHeight;
+
+		Renderer renderer(true);
+		Result result = timeline.renderPreviewImage(context, &renderer, startTick, endTick,
+		                                            outputFilename);
+		if (!result.isOk())
+		{
+			fprintf(stderr, "Failed to render %s: %s\n", outputFilename.c_str(),
+			        result.getMessage().c_str());
+			return 1;
+		}
+
+		printf("Rendered %s\n", outputFilename.c_str());
+		return 0;
+	}
+
+	void Application::attachParentConsole()
+	{
+		// Release builds have no console of their own, print to the one we were started from
+		if (AttachConsole(ATTACH_PARENT_PROCESS))
+		{
+			FILE* stream{};
+			freopen_s(&stream, "CONOUT$", "w", stdout);
+			freopen_s(&stream, "CONOUT$", "w", stderr);
+		}
+	}
+
 	const std::string& Application::getAppDir() { return appDir; }
 
 	std::string Application::getVersion()
@@ -106,6 +224,7 @@ namespace MikuMikuWorld
 		if (initialized)
 		{
 			editor->uninitialize();
+			ImageLoader::shutdown();
 			imgui->shutdown();
 			glfwDestroyWindow(window);
 			glfwTerminate();
@@ -307,13 +426,84 @@ namespace MikuMikuWorld
 		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		imgui->draw(window);
-		glfwSwapBuffers(window);
+		{
+			PROFILE_SCOPE("ImGuiManager::draw");
+			imgui->draw(window);
+		}
+		{
+			PROFILE_SCOPE("glfwSwapBuffers");
+			glfwSwapBuffers(window);
+		}
+	}
+
+	void Application::requestRedraw()
+	{
+		redrawRequested = true;
+		glfwPostEmptyEvent();
+	}
+
+	void Application::waitForEvents()
+	{
+		if (redrawRequested.exchange(false) || !config.idleThrottling ||
+		    editor->needsContinuousRedraw())
+			pendingRedrawFrames = settleFrameCount;
+
+		if (pendingRedrawFrames > 0)
+		{
+			--pendingRedrawFrames;
+			return;
+		}
+
+		Stopwatch idleTimer;
+		glfwWaitEventsTimeout(idleRedrawInterval);
+		const double idleSeconds = idleTimer.elapsed();
+
+		statisticsIdleSeconds += idleSeconds;
+		frameStatistics.totalIdleSeconds += idleSeconds;
+		++frameStatistics.totalIdleWaits;
+
+		// Woken up by input or another thread rather than the timeout
+		if (idleSeconds < idleRedrawInterval || redrawRequested.exchange(false))
+			pendingRedrawFrames = settleFrameCount - 1;
+	}
+
+	void Application::updateFrameStatistics()
+	{
+		++frameStatistics.totalFrames;
+		++statisticsFrames;
+
+		const double elapsed = statisticsTimer.elapsed();
+		if (elapsed < 1.0)
+			return;
+
+		frameStatistics.framesPerSecond = static_cast<int>(statisticsFrames / elapsed + 0.5);
+		frameStatistics.idleRatio = static_cast<float>(statisticsIdleSeconds / elapsed);
+		statisticsFrames = 0;
+		statisticsIdleSeconds = 0;
+		statisticsTimer.reset();
 	}
 
 	void Application::loadResources()
 	{
 		ResourceManager::loadShader(appDir + "res\\shaders\\basic2d");
+		TextureCache::setDirectory(appDir + "cache\\textures\\");
+		Audio::AudioCache::setDirectory(appDir + "cache\\audio\\");
+		loadTextures();
+
+		// Every note sprite sheet goes into one texture so the timeline needs fewer batches
+		ResourceManager::buildNoteAtlas({ noteTextures.notes, noteTextures.holdPath,
+		                                  noteTextures.touchLine, noteTextures.ccNotes,
+		                                  noteTextures.guideColors, noteTextures.bell,
+		                                  noteTextures.ten, noteTextures.danmaku,
+		                                  noteTextures.danmaku_center, noteTextures.danmaku_left,
+		                                  noteTextures.danmaku_right, noteTextures.flick_left,
+		                                  noteTextures.flick_right, noteTextures.flick_up });
+
+		Localization::loadLanguages(appDir + "res\\i18n");
+	}
+
+	void Application::loadTextures()
+	{
 		const std::string texturesDir = appDir + "res\\textures\\";
 		ResourceManager::loadTexture(texturesDir + "notes1.png",
 		                             TextureFilterMode::LinearMipMapLinear,
@@ -374,8 +564,6 @@ namespace MikuMikuWorld
 		noteTextures.flick_left = ResourceManager::getTexture(FLICK_LEFT_TEX);
 		noteTextures.flick_right = ResourceManager::getTexture(FLICK_RIGHT_TEX);
 		noteTextures.flick_up = ResourceManager::getTexture(FLICK_UP_TEX);
-
-		Localization::loadLanguages(appDir + "res\\i18n");
 	}
 
 	void Application::run()
@@ -393,16 +581,24 @@ namespace MikuMikuWorld
 		::SetWindowLongPtrW(hwnd, GWLP_WNDPROC, (LONG_PTR)wndProc);
 
 		windowState.windowHandle = hwnd;
-		windowState.windowTimerId =
-		    ::SetTimer(hwnd, reinterpret_cast<UINT_PTR>(&windowState.windowTimerId),
-		               USER_TIMER_MINIMUM, nullptr);
+
+		// The timer only runs while the window is dragged (see wndProc) so it does not keep
+		// waking up the idle loop
+		windowState.windowTimerId = reinterpret_cast<UINT_PTR>(&windowState.windowTimerId);
 
 		::DragAcceptFiles(hwnd, TRUE);
 
+		statisticsTimer.reset();
 		while (!glfwWindowShouldClose(window))
 		{
+			waitForEvents();
+
+			Profiler::beginFrame();
 			glfwPollEvents();
 			update();
+			Profiler::endFrame();
+
+			updateFrameStatistics();
 		}
 
 		editor->savePresets(appDir + "library");
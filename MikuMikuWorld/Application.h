@@ -11,7 +11,9 @@
 
 #include "ScoreEditor.h"
 #include "ImGuiManager.h"
+#include "Stopwatch.h"
 #include <Windows.h>
+#include <atomic>
 
 LRESULT CALLBACK wndProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 
@@ -36,6 +38,17 @@ namespace MikuMikuWorld
 		UINT_PTR windowTimerId{};
 	};
 
+	struct FrameStatistics
+	{
+		uint64_t totalFrames{};
+		uint64_t totalIdleWaits{};
+		double totalIdleSeconds{};
+
+		// Measured over the last completed second
+		int framesPerSecond{};
+		float idleRatio{};
+	};
+
 	class Application
 	{
 	  private:
@@ -50,14 +63,30 @@ namespace MikuMikuWorld
 
 		std::vector<std::string> pendingOpenFiles;
 
+		// Frames still drawn after the last event so ImGui can settle hover and layout changes
+		static constexpr int settleFrameCount = 3;
+		// Longest wait between frames while idle, keeps timers such as auto save running
+		static constexpr double idleRedrawInterval = 0.5;
+
+		int pendingRedrawFrames{ settleFrameCount };
+		Stopwatch statisticsTimer;
+		int statisticsFrames{};
+		double statisticsIdleSeconds{};
+		static std::atomic<bool> redrawRequested;
+
+		void waitForEvents();
+		void updateFrameStatistics();
+
 		static std::string version;
 		static std::string appDir;
 
 		Result initOpenGL();
 		std::string getVersion();
+		static void loadTextures();
 
 	  public:
 		static WindowState windowState;
+		static FrameStatistics frameStatistics;
 		static std::string pendingLoadScoreFile;
 
 		Application();
@@ -74,6 +103,31 @@ namespace MikuMikuWorld
 
 		GLFWwindow* getGlfwWindow() { return window; }
 
+		/**
+		 * @brief Render a score's music and hit sounds to a wav file without opening a window
+		 * @return The process exit code
+		 */
+		static int renderAudio(const std::string& root, const std::string& scoreFilename,
+		                       const std::string& outputFilename);
+
+		/**
+		 * @brief Render the notes between two ticks of a score to a png without opening a window
+		 * @return The process exit code
+		 */
+		static int renderPreview(const std::string& root, const std::string& scoreFilename,
+		                         int startTick, int endTick, const std::string& outputFilename);
+
+		/**
+		 * @brief Send stdout and stderr to the console the app was started from, if any
+		 */
+		static void attachParentConsole();
+
+		/**
+		 * @brief Wake the main loop for a redraw, safe to call from any thread
+		 * (ex. when an async job finishes)
+		 */
+		static void requestRedraw();
+
 		static const std::string& getAppDir();
 		static const std::string& getAppVersion();
 	};
@@ -44,6 +44,7 @@ namespace MikuMikuWorld
 			maximized = jsonIO::tryGetValue<bool>(window, "maximized", false);
 			vsync = jsonIO::tryGetValue<bool>(window, "vsync", true);
 			showFPS = jsonIO::tryGetValue<bool>(window, "show_fps", false);
+			idleThrottling = jsonIO::tryGetValue<bool>(window, "idle_throttling", true);
 
 			windowPos = jsonIO::tryGetValue(window, "position", Vector2{});
 			if (windowPos.x <= 0)
@@ -72,6 +73,8 @@ namespace MikuMikuWorld
 			laneOpacity = jsonIO::tryGetValue<float>(config["timeline"], "lane_opacity", 0.0f);
 			backgroundBrightness =
 			    jsonIO::tryGetValue<float>(config["timeline"], "background_brightness", 0.5f);
+			backgroundBlur =
+			    jsonIO::tryGetValue<float>(config["timeline"], "background_blur", 0.0f);
 			drawBackground = jsonIO::tryGetValue<bool>(config["timeline"], "draw_background", true);
 			backgroundImage =
 			    jsonIO::tryGetValue<std::string>(config["timeline"], "background_image", "");
@@ -86,6 +89,8 @@ namespace MikuMikuWorld
 			    jsonIO::tryGetValue<float>(config["timleine"], "scroll_speed_fast", 5.0f);
 
 			drawWaveform = jsonIO::tryGetValue<bool>(config["timeline"], "draw_waveform", true);
+			drawSpectrogram =
+			    jsonIO::tryGetValue<bool>(config["timeline"], "draw_spectrogram", false);
 			returnToLastSelectedTickOnPause = jsonIO::tryGetValue<bool>(
 			    config["timeline"], "return_to_last_tick_on_pause", false);
 			cursorPositionThreshold =
@@ -118,6 +123,11 @@ namespace MikuMikuWorld
 			                       0.0f, 1.0f);
 			seVolume = std::clamp(jsonIO::tryGetValue<float>(config["audio"], "se_volume", 1.0f),
 			                      0.0f, 1.0f);
+			preservePitch = jsonIO::tryGetValue<bool>(config["audio"], "preserve_pitch", true);
+			scrubAudio = jsonIO::tryGetValue<bool>(config["audio"], "scrub_audio", true);
+			metronome = jsonIO::tryGetValue<bool>(config["audio"], "metronome", false);
+			renderMetronome =
+			    jsonIO::tryGetValue<bool>(config["audio"], "render_metronome", false);
 		}
 
 		if (jsonIO::keyExists(config, "input") && jsonIO::keyExists(config["input"], "bindings"))
@@ -164,6 +174,7 @@ namespace MikuMikuWorld
 		config["window"]["maximized"] = maximized;
 		config["window"]["vsync"] = vsync;
 		config["window"]["show_fps"] = showFPS;
+		config["window"]["idle_throttling"] = idleThrottling;
 
 		config["timeline"] = { { "lane_width", timelineWidth },
 			                   { "notes_height", notesHeight },
@@ -172,6 +183,7 @@ namespace MikuMikuWorld
 			                   { "zoom", zoom },
 			                   { "lane_opacity", laneOpacity },
 			                   { "background_brightness", backgroundBrightness },
+			                   { "background_blur", backgroundBlur },
 			                   { "draw_background", drawBackground },
 			                   { "background_image", backgroundImage },
 			                   { "smooth_scrolling_enable", useSmoothScrolling },
@@ -179,6 +191,7 @@ namespace MikuMikuWorld
 			                   { "scroll_speed_normal", scrollSpeedNormal },
 			                   { "scroll_speed_fast", scrollSpeedShift },
 			                   { "draw_waveform", drawWaveform },
+			                   { "draw_spectrogram", drawSpectrogram },
 			                   { "return_to_last_tick_on_pause", returnToLastSelectedTickOnPause },
 			                   { "cursor_position_threshold", cursorPositionThreshold },
 			                   { "show_tick_in_properties", showTickInProperties } };
@@ -198,7 +211,11 @@ namespace MikuMikuWorld
 		config["audio"] = { { "se_profile", seProfileIndex },
 			                { "master_volume", masterVolume },
 			                { "bgm_volume", bgmVolume },
-			                { "se_volume", seVolume } };
+			                { "se_volume", seVolume },
+			                { "preserve_pitch", preservePitch },
+			                { "scrub_audio", scrubAudio },
+			                { "metronome", metronome },
+			                { "render_metronome", renderMetronome } };
 
 		json keyBindings;
 		for (const auto& binding : bindings)
@@ -230,6 +247,7 @@ namespace MikuMikuWorld
 		windowSize = Vector2(1000, 800);
 		maximized = false;
 		vsync = true;
+		idleThrottling = true;
 		accentColor = 1;
 		userColor = Color(0.2f, 0.2f, 0.2f, 1.0f);
 		language = "auto";
@@ -243,6 +261,7 @@ namespace MikuMikuWorld
 		zoom = 2.0f;
 		laneOpacity = 0.6f;
 		backgroundBrightness = 0.5f;
+		backgroundBlur = 0.0f;
 		drawBackground = true;
 		backgroundImage = "";
 		useSmoothScrolling = true;
@@ -251,6 +270,7 @@ namespace MikuMikuWorld
 		scrollSpeedShift = 5.0f;
 		cursorPositionThreshold = 0.5;
 		drawWaveform = true;
+		drawSpectrogram = false;
 		showTickInProperties = false;
 		followCursorInPlayback = true;
 		returnToLastSelectedTickOnPause = false;
@@ -263,6 +283,10 @@ namespace MikuMikuWorld
 		masterVolume = 1.0f;
 		bgmVolume = 1.0f;
 		seVolume = 1.0f;
+		preservePitch = true;
+		scrubAudio = true;
+		metronome = false;
+		renderMetronome = false;
 
 		debugEnabled = false;
 	}
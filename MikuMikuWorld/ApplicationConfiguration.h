@@ -89,6 +89,7 @@ namespace MikuMikuWorld
 		bool maximized;
 		bool vsync;
 		bool showFPS;
+		bool idleThrottling;
 		int accentColor;
 		Color userColor;
 		BaseTheme baseTheme;
@@ -104,6 +105,7 @@ namespace MikuMikuWorld
 		bool matchNotesSizeToTimeline;
 		float laneOpacity;
 		float backgroundBrightness;
+		float backgroundBlur;
 		bool drawBackground;
 		std::string backgroundImage;
 		bool useSmoothScrolling;
@@ -114,6 +116,7 @@ namespace MikuMikuWorld
 		bool returnToLastSelectedTickOnPause;
 		bool followCursorInPlayback;
 		bool drawWaveform;
+		bool drawSpectrogram;
 		bool showTickInProperties;
 		bool autoSaveEnabled;
 		int autoSaveInterval;
@@ -122,6 +125,10 @@ namespace MikuMikuWorld
 		float bgmVolume;
 		float seVolume;
 		int seProfileIndex;
+		bool preservePitch;
+		bool scrubAudio;
+		bool metronome;
+		bool renderMetronome;
 		bool debugEnabled;
 
 		InputConfiguration input;
@@ -0,0 +1,259 @@
+#include "AudioCache.h"
+#include "../CacheFiles.h"
+#include "../File.h"
+#include "../IO.h"
+#include <filesystem>
+#include <fstream>
+
+namespace Audio
+{
+	std::string AudioCache::directory{};
+	uint64_t AudioCache::maxSize{ AudioCache::defaultMaxSize };
+
+	namespace
+	{
+		constexpr uint32_t peaksMagic = 0x41574D4D; // "MMWA"
+		constexpr uint32_t peaksVersion = 1;
+
+		struct PeaksHeader
+		{
+			uint32_t magic{};
+			uint32_t version{};
+			uint32_t channelIndex{};
+			uint32_t reserved{};
+			uint64_t frameCount{};
+			uint64_t peakCount{};
+		};
+
+		constexpr uint32_t spectrogramMagic = 0x53574D4D; // "MMWS"
+
+		struct SpectrogramHeader
+		{
+			uint32_t magic{};
+			uint32_t layout{};
+			uint32_t bandCount{};
+			uint32_t reserved{};
+			uint64_t columnCount{};
+		};
+
+		std::filesystem::path toPath(const std::string& filename)
+		{
+			return std::filesystem::path(IO::mbToWideStr(filename));
+		}
+
+		bool readPeaksHeader(std::ifstream& file, uint32_t channelIndex, uint64_t frameCount,
+		                     PeaksHeader& header)
+		{
+			if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+				return false;
+
+			return header.magic == peaksMagic && header.version == peaksVersion &&
+			       header.channelIndex == channelIndex && header.frameCount == frameCount &&
+			       header.peakCount == (frameCount + 1) / 2;
+		}
+	}
+
+	AudioCache::PcmWriter::PcmWriter(uint64_t hash, uint32_t channelCount, uint32_t sampleRate)
+	{
+		if (!isEnabled() || hash == 0)
+			return;
+
+		std::error_code error;
+		std::filesystem::create_directories(toPath(directory), error);
+		if (error)
+			return;
+
+		filename = getCacheFilename(hash, "wav");
+		tempFilename = filename + ".tmp";
+		ma_encoder_config config =
+		    ma_encoder_config_init(ma_encoding_format_wav, ma_format_s16, channelCount, sampleRate);
+		initialized = ma_encoder_init_file_w(IO::mbToWideStr(tempFilename).c_str(), &config,
+		                                     &encoder) == MA_SUCCESS;
+	}
+
+	AudioCache::PcmWriter::~PcmWriter()
+	{
+		if (!initialized)
+			return;
+
+		// Never committed (ex. the scan was cancelled), the partial file is useless
+		ma_encoder_uninit(&encoder);
+		std::error_code error;
+		std::filesystem::remove(toPath(tempFilename), error);
+	}
+
+	void AudioCache::PcmWriter::write(const int16_t* samples, uint64_t frameCount)
+	{
+		if (initialized)
+			ma_encoder_write_pcm_frames(&encoder, samples, frameCount, nullptr);
+	}
+
+	void AudioCache::PcmWriter::commit()
+	{
+		if (!initialized)
+			return;
+
+		ma_encoder_uninit(&encoder);
+		initialized = false;
+
+		std::error_code error;
+		std::filesystem::rename(toPath(tempFilename), toPath(filename), error);
+		if (error)
+			std::filesystem::remove(toPath(tempFilename), error);
+
+		evict();
+	}
+
+	void AudioCache::setDirectory(const std::string& value)
+	{
+		directory = value;
+		if (!directory.empty() && directory.back() != '\\' && directory.back() != '/')
+			directory.push_back('\\');
+	}
+
+	void AudioCache::setMaxSize(uint64_t bytes) { maxSize = bytes; }
+
+	std::string AudioCache::getCacheFilename(uint64_t hash, const char* extension)
+	{
+		return directory + IO::formatString("%016llx.%s", static_cast<unsigned long long>(hash),
+		                                    extension);
+	}
+
+	uint64_t AudioCache::hashFile(const std::string& filename)
+	{
+		return IO::CacheFiles::hashFile(filename);
+	}
+
+	std::string AudioCache::findPcm(uint64_t hash)
+	{
+		if (!isEnabled() || hash == 0)
+			return {};
+
+		const std::string filename = getCacheFilename(hash, "wav");
+		if (!IO::File::exists(filename))
+			return {};
+
+		IO::CacheFiles::touch(filename);
+		return filename;
+	}
+
+	bool AudioCache::hasPeaks(uint64_t hash, uint32_t channelIndex, uint64_t frameCount)
+	{
+		if (!isEnabled() || hash == 0)
+			return false;
+
+		std::ifstream file(toPath(getCacheFilename(hash, channelIndex ? "peaksr" : "peaksl")),
+		                   std::ios::binary);
+		PeaksHeader header{};
+		return file && readPeaksHeader(file, channelIndex, frameCount, header);
+	}
+
+	bool AudioCache::loadPeaks(uint64_t hash, uint32_t channelIndex, uint64_t frameCount,
+	                           std::vector<WaveformPeak>& peaks)
+	{
+		if (!isEnabled() || hash == 0)
+			return false;
+
+		const std::string filename = getCacheFilename(hash, channelIndex ? "peaksr" : "peaksl");
+		std::ifstream file(toPath(filename), std::ios::binary);
+		PeaksHeader header{};
+		if (!file || !readPeaksHeader(file, channelIndex, frameCount, header))
+			return false;
+
+		peaks.resize(header.peakCount);
+		if (!file.read(reinterpret_cast<char*>(peaks.data()), peaks.size() * sizeof(WaveformPeak)))
+		{
+			// Truncated or corrupted, let it be generated again
+			file.close();
+			std::error_code error;
+			std::filesystem::remove(toPath(filename), error);
+			return false;
+		}
+
+		file.close();
+		IO::CacheFiles::touch(filename);
+		return true;
+	}
+
+	void AudioCache::savePeaks(uint64_t hash, uint32_t channelIndex, uint64_t frameCount,
+	                           const std::vector<WaveformPeak>& peaks)
+	{
+		if (!isEnabled() || hash == 0 || peaks.size() != (frameCount + 1) / 2)
+			return;
+
+		std::error_code error;
+		std::filesystem::create_directories(toPath(directory), error);
+		if (error)
+			return;
+
+		PeaksHeader header{};
+		header.magic = peaksMagic;
+		header.version = peaksVersion;
+		header.channelIndex = channelIndex;
+		header.frameCount = frameCount;
+		header.peakCount = peaks.size();
+		if (IO::CacheFiles::write(getCacheFilename(hash, channelIndex ? "peaksr" : "peaksl"),
+		                          { { &header, sizeof(header) },
+		                            { peaks.data(), peaks.size() * sizeof(WaveformPeak) } }))
+			evict();
+	}
+
+	bool AudioCache::loadSpectrogram(uint64_t hash, uint32_t layout, uint32_t bandCount,
+	                                 std::vector<uint8_t>& levels)
+	{
+		if (!isEnabled() || hash == 0 || bandCount == 0)
+			return false;
+
+		const std::string filename = getCacheFilename(hash, "spec");
+		std::ifstream file(toPath(filename), std::ios::binary);
+		SpectrogramHeader header{};
+		if (!file || !file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+		    header.magic != spectrogramMagic || header.layout != layout ||
+		    header.bandCount != bandCount || header.columnCount == 0)
+			return false;
+
+		levels.resize(header.columnCount * bandCount);
+		if (!file.read(reinterpret_cast<char*>(levels.data()), levels.size()))
+		{
+			// Truncated or corrupted, let it be generated again
+			file.close();
+			std::error_code error;
+			std::filesystem::remove(toPath(filename), error);
+			levels.clear();
+			return false;
+		}
+
+		file.close();
+		IO::CacheFiles::touch(filename);
+		return true;
+	}
+
+	void AudioCache::saveSpectrogram(uint64_t hash, uint32_t layout, uint32_t bandCount,
+	                                 const std::vector<uint8_t>& levels)
+	{
+		if (!isEnabled() || hash == 0 || bandCount == 0 || levels.empty() ||
+		    levels.size() % bandCount != 0)
+			return;
+
+		std::error_code error;
+		std::filesystem::create_directories(toPath(directory), error);
+		if (error)
+			return;
+
+		SpectrogramHeader header{};
+		header.magic = spectrogramMagic;
+		header.layout = layout;
+		header.bandCount = bandCount;
+		header.columnCount = levels.size() / bandCount;
+		if (IO::CacheFiles::write(getCacheFilename(hash, "spec"),
+		                          { { &header, sizeof(header) },
+		                            { levels.data(), levels.size() } }))
+			evict();
+	}
+
+	void AudioCache::evict()
+	{
+		// The wav, peaks and spectrogram of a track share its hash and are evicted together
+		IO::CacheFiles::evict(directory, maxSize);
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "Waveform.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Audio
+{
+	/**
+	 * @brief On-disk cache of decoded music and its waveform peaks, keyed by the content hash of
+	 * the source file. Reopening a cached track streams a wav file instead of decoding it and
+	 * skips building the waveform. The least recently used entries are evicted past a size limit.
+	 */
+	class AudioCache
+	{
+	  private:
+		static std::string directory;
+		static uint64_t maxSize;
+
+		static std::string getCacheFilename(uint64_t hash, const char* extension);
+
+	  public:
+		static constexpr uint64_t defaultMaxSize{ uint64_t{ 2 } << 30 };
+
+		/**
+		 * @brief Writes decoded frames to a wav file only added to the cache once committed
+		 */
+		class PcmWriter
+		{
+		  private:
+			ma_encoder encoder{};
+			bool initialized{ false };
+			std::string filename;
+			std::string tempFilename;
+
+		  public:
+			PcmWriter(uint64_t hash, uint32_t channelCount, uint32_t sampleRate);
+			PcmWriter(const PcmWriter&) = delete;
+			PcmWriter& operator=(const PcmWriter&) = delete;
+			~PcmWriter();
+
+			void write(const int16_t* samples, uint64_t frameCount);
+			void commit();
+		};
+
+		/**
+		 * @brief Set where cache files are stored, an empty directory disables the cache
+		 */
+		static void setDirectory(const std::string& directory);
+		static void setMaxSize(uint64_t bytes);
+		static inline bool isEnabled() { return !directory.empty(); }
+
+		/**
+		 * @brief Hash the contents of a file, 0 if it can't be read
+		 */
+		static uint64_t hashFile(const std::string& filename);
+
+		/**
+		 * @brief Get the decoded wav of a source file, empty if it isn't cached
+		 */
+		static std::string findPcm(uint64_t hash);
+
+		/**
+		 * @brief Whether the base waveform peaks of a channel are cached for a track this long
+		 */
+		static bool hasPeaks(uint64_t hash, uint32_t channelIndex, uint64_t frameCount);
+		static bool loadPeaks(uint64_t hash, uint32_t channelIndex, uint64_t frameCount,
+		                      std::vector<WaveformPeak>& peaks);
+		static void savePeaks(uint64_t hash, uint32_t channelIndex, uint64_t frameCount,
+		                      const std::vector<WaveformPeak>& peaks);
+
+		/**
+		 * @brief Spectrogram levels of a track stored as columns of bandCount bytes
+		 * @param layout Version of the analysis, entries made by another one are ignored
+		 */
+		static bool loadSpectrogram(uint64_t hash, uint32_t layout, uint32_t bandCount,
+		                            std::vector<uint8_t>& levels);
+		static void saveSpectrogram(uint64_t hash, uint32_t layout, uint32_t bandCount,
+		                            const std::vector<uint8_t>& levels);
+
+		/**
+		 * @brief Delete the least recently used entries until the cache fits its size limit
+		 */
+		static void evict();
+	};
+}
@@ -1,4 +1,5 @@
 #include "../Application.h"
+#include "../File.h"
 #include "../IO.h"
 #include "../UI.h"
 
@@ -8,7 +9,11 @@
 #define DR_WAV_IMPLEMENTATION
 #define DR_FLAC_IMPLEMENTATION
 #include "AudioManager.h"
+#include "AudioCache.h"
+#include <chrono>
+#include <cmath>
 #include <execution>
+#include <numeric>
 
 #undef STB_VORBIS_HEADER_ONLY
 
@@ -16,6 +21,36 @@ namespace Audio
 {
 	namespace mmw = MikuMikuWorld;
 
+	namespace
+	{
+		constexpr size_t soundEffectsCount = sizeof(mmw::SE_NAMES) / sizeof(const char*);
+		constexpr std::array<SoundFlags, soundEffectsCount> soundEffectsFlags = {
+			NONE, NONE, NONE, NONE, LOOP | EXTENDABLE, NONE, NONE, NONE, NONE, LOOP | EXTENDABLE
+		};
+
+		constexpr std::array<float, soundEffectsCount> soundEffectsVolumes = {
+			0.75f, 0.75f, 0.90f, 0.80f, 0.70f, 0.75f, 0.80f, 0.92f, 0.82f, 0.70f
+		};
+
+		// The metronome's clicks are generated and indexed after the loaded sound effects
+		constexpr std::array<const char*, 2> metronomeNames = { mmw::SE_METRONOME_DOWNBEAT,
+			                                                    mmw::SE_METRONOME_BEAT };
+		constexpr std::array<float, 2> metronomeFrequencies = { 1760.0f, 880.0f };
+		constexpr float metronomeClickDuration = 0.05f;
+		constexpr float metronomeVolume = 0.8f;
+		constexpr size_t soundEffectsTotalCount = soundEffectsCount + metronomeNames.size();
+
+		std::unique_ptr<SoundEffectBuffer> generateMetronomeClick(size_t index,
+		                                                          ma_uint32 channelCount,
+		                                                          ma_uint32 sampleRate)
+		{
+			return SoundEffectMixer::generateClick(metronomeNames[index],
+			                                       metronomeFrequencies[index],
+			                                       metronomeClickDuration, metronomeVolume,
+			                                       channelCount, sampleRate);
+		}
+	}
+
 	void AudioManager::initializeAudioEngine()
 	{
 		std::string err = "";
@@ -23,7 +58,12 @@ namespace Audio
 
 		try
 		{
-			result = ma_engine_init(nullptr, &engine);
+			// Commands are applied at the start of every audio callback, before the graph is read
+			ma_engine_config engineConfig = ma_engine_config_init();
+			engineConfig.dataCallback = dataCallback;
+			engineConfig.pProcessUserData = this;
+
+			result = ma_engine_init(&engineConfig, &engine);
 			if (result != MA_SUCCESS)
 			{
 				err = "FATAL: Failed to start audio engine. Aborting.\n";
@@ -37,12 +77,33 @@ namespace Audio
 				throw(result);
 			}
 
+			result = musicStretch.initialize(&engine, &musicGroup);
+			if (result != MA_SUCCESS)
+			{
+				err = "FATAL: Failed to initialize music time stretch. Aborting.\n";
+				throw(result);
+			}
+
+			result = musicScrubber.initialize(&engine, &musicGroup);
+			if (result != MA_SUCCESS)
+			{
+				err = "FATAL: Failed to initialize music scrubber. Aborting.\n";
+				throw(result);
+			}
+
 			result = ma_sound_group_init(&engine, maSoundFlagsDefault, nullptr, &soundEffectsGroup);
 			if (result != MA_SUCCESS)
 			{
 				err = "FATAL: Failed to initialize sound effects sound group. Aborting.\n";
 				throw(result);
 			}
+
+			result = soundEffects.initialize(&engine, &soundEffectsGroup);
+			if (result != MA_SUCCESS)
+			{
+				err = "FATAL: Failed to initialize sound effects mixer. Aborting.\n";
+				throw(result);
+			}
 		}
 		catch (ma_result)
 		{
@@ -53,6 +114,167 @@ namespace Audio
 		}
 	}
 
+	void AudioManager::dataCallback(ma_device* device, void* output, const void* input,
+	                                ma_uint32 frameCount)
+	{
+		ma_engine* engine = static_cast<ma_engine*>(device->pUserData);
+		static_cast<AudioManager*>(engine->pProcessUserData)->processCommands();
+		ma_engine_read_pcm_frames(engine, output, frameCount, nullptr);
+	}
+
+	void AudioManager::pushCommand(const AudioCommand& command)
+	{
+		// Nothing consumes the queue while the device is stopped so it's safe to apply here
+		if (!isEngineStarted())
+		{
+			processCommands();
+			applyCommand(command);
+			return;
+		}
+
+		// The audio thread drains the queue every callback, a full queue is only ever brief
+		while (!commands.push(command))
+			std::this_thread::yield();
+
+		++pushedCommands;
+	}
+
+	void AudioManager::processCommands()
+	{
+		AudioCommand command;
+		while (commands.pop(command))
+		{
+			applyCommand(command);
+			processedCommands.fetch_add(1, std::memory_order_release);
+		}
+	}
+
+	void AudioManager::flushCommands()
+	{
+		if (!isEngineStarted())
+		{
+			processCommands();
+			return;
+		}
+
+		// Bounded in case the device stops delivering callbacks without changing its state
+		const auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+		while (processedCommands.load(std::memory_order_acquire) != pushedCommands &&
+		       std::chrono::steady_clock::now() < timeout)
+			std::this_thread::yield();
+	}
+
+	void AudioManager::applyCommand(const AudioCommand& command)
+	{
+		using Type = AudioCommand::Type;
+		switch (command.type)
+		{
+		case Type::SetMasterVolume:
+			ma_engine_set_volume(&engine, command.value);
+			return;
+
+		case Type::SetMusicVolume:
+			ma_sound_group_set_volume(&musicGroup, command.value);
+			return;
+
+		case Type::SetSoundEffectsVolume:
+			ma_sound_group_set_volume(&soundEffectsGroup, command.value);
+			return;
+
+		case Type::SetPlaybackSpeed:
+			musicStretch.setSpeed(command.value);
+			applyMusicSampleRate();
+			return;
+
+		case Type::SetPreservePitch:
+			musicStretch.setEnabled(command.value != 0.0f);
+			applyMusicSampleRate();
+			return;
+
+		default:
+			break;
+		}
+
+		// The remaining commands are for the music, which may have been unloaded since
+		if (!musicStream->isValid())
+			return;
+
+		switch (command.type)
+		{
+		case Type::PlayMusic:
+			musicStretch.reset();
+			ma_sound_set_start_time_in_milliseconds(&music, command.value);
+			ma_sound_start(&music);
+			break;
+
+		case Type::StopMusic:
+			ma_sound_stop(&music);
+			musicStretch.reset();
+			break;
+
+		case Type::SeekMusic:
+		{
+			const ma_uint64 seekFrame = command.frame;
+			ma_sound_seek_to_pcm_frame(&music, seekFrame);
+			musicStretch.reset();
+
+			// The sound only applies the seek once it plays, let the stream start decoding from
+			// there
+			if (!ma_sound_is_playing(&music) && seekFrame < musicStream->frameCount)
+				musicStream->seek(seekFrame);
+
+			ma_uint64 length{};
+			ma_result lengthResult = ma_sound_get_length_in_pcm_frames(&music, &length);
+			if (lengthResult != MA_SUCCESS)
+				break;
+
+			if (seekFrame > length)
+			{
+				// Seeking beyond the sound's length
+				music.atEnd = true;
+			}
+			else if (ma_sound_at_end(&music) && seekFrame < length)
+			{
+				// Sound reached the end but sought to an earlier frame
+				music.atEnd = false;
+			}
+			break;
+		}
+
+		case Type::SetMusicStartTime:
+			ma_sound_set_start_time_in_milliseconds(&music, command.value);
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	void AudioManager::applyMusicSampleRate()
+	{
+		if (!musicStream->isValid())
+			return;
+
+		// Time stretching already plays the music at the playback speed
+		const float speed = musicStretch.isEnabled() ? 1.0f : musicStretch.getSpeed();
+		const ma_uint32 speedAdjustedSampleRate =
+		    static_cast<ma_uint32>(speed * musicStream->sampleRate);
+		music.engineNode.sampleRate = speedAdjustedSampleRate;
+
+		ma_uint32 sampleRateIn = speedAdjustedSampleRate;
+		ma_uint32 sampleRateOut = engine.sampleRate;
+		ma_uint32 gcf = mmw::gcf(sampleRateIn, sampleRateOut);
+		sampleRateIn /= gcf;
+		sampleRateOut /= gcf;
+
+		ma_linear_resampler& resampler = music.engineNode.resampler;
+		resampler.lpf.sampleRate = std::max(sampleRateIn, sampleRateOut);
+		resampler.inAdvanceInt = sampleRateIn / sampleRateOut;
+		resampler.inAdvanceFrac = sampleRateIn % sampleRateOut;
+		resampler.config.sampleRateIn = sampleRateIn;
+		resampler.config.sampleRateOut = sampleRateOut;
+	}
+
 	void AudioManager::startEngine() { ma_engine_start(&engine); }
 
 	void AudioManager::stopEngine() { ma_engine_stop(&engine); }
@@ -64,94 +286,201 @@ namespace Audio
 
 	void AudioManager::loadSoundEffects()
 	{
-		constexpr size_t soundEffectsCount = sizeof(mmw::SE_NAMES) / sizeof(const char*);
-		constexpr std::array<SoundFlags, soundEffectsCount> soundEffectsFlags = {
-			NONE, NONE, NONE, NONE, LOOP | EXTENDABLE, NONE, NONE, NONE, NONE, LOOP | EXTENDABLE
-		};
-
-		constexpr std::array<float, soundEffectsCount> soundEffectsVolumes = {
-			0.75f, 0.75f, 0.90f, 0.80f, 0.70f, 0.75f, 0.80f, 0.92f, 0.82f, 0.70f
-		};
-
 		debugSounds.resize(soundEffectsCount * soundEffectsProfileCount);
+		extendableVoices.assign(soundEffectsCount, {});
+
+		// Every profile shares the same clicks
+		std::array<SoundEffectBuffer*, metronomeNames.size()> metronomeBuffers{};
+		for (size_t i = 0; i < metronomeNames.size(); ++i)
+			metronomeBuffers[i] = soundEffects.addBuffer(generateMetronomeClick(
+			    i, ma_engine_get_channels(&engine), ma_engine_get_sample_rate(&engine)));
 
 		for (size_t index = 0; index < soundEffectsProfileCount; index++)
 		{
-			std::string path = IO::formatString("%s%s%02d\\", mmw::Application::getAppDir().c_str(),
-			                                    "res\\sound\\", index + 1);
-			sounds[index].pool.reserve(soundEffectsCount);
-			for (size_t i = 0; i < soundEffectsCount; ++i)
-				sounds[index].pool.emplace(
-				    std::move(SoundPoolPair(mmw::SE_NAMES[i], std::make_unique<SoundPool>())));
-
-			std::for_each(std::execution::par, sounds[index].pool.begin(), sounds[index].pool.end(),
-			              [&](auto& s)
-			              {
-				              std::string filename = path + s.first.data() + ".mp3";
-				              size_t soundNameIndex = mmw::findArrayItem(
-				                  s.first.data(), mmw::SE_NAMES, mmw::arrayLength(mmw::SE_NAMES));
-
-				              std::string name{};
-				              if (mmw::isArrayIndexInBounds(soundNameIndex, mmw::SE_NAMES))
-					              name = IO::formatString("%s_%02d", mmw::SE_NAMES[soundNameIndex],
-					                                      index + 1);
-
-				              s.second->initialize(name, filename, &engine, &soundEffectsGroup,
-				                                   soundEffectsFlags[soundNameIndex]);
-				              s.second->setVolume(soundEffectsVolumes[soundNameIndex]);
-
-				              SoundInstance& debugSound =
-				                  debugSounds[soundNameIndex + (index * soundEffectsCount)];
-				              debugSound.name = name;
-
-				              ma_sound_init_from_file_w(&engine, IO::mbToWideStr(filename).c_str(),
-				                                        maSoundFlagsDecodeAsync, &soundEffectsGroup,
-				                                        nullptr, &debugSound.source);
-			              });
-
-			// Adjust hold SE loop times for gapless playback
-			ma_uint64 holdNrmDuration = sounds[index].pool[mmw::SE_CONNECT]->getDurationInFrames();
-			ma_uint64 holdCrtDuration =
-			    sounds[index].pool[mmw::SE_CRITICAL_CONNECT]->getDurationInFrames();
-			sounds[index].pool[mmw::SE_CONNECT]->setLoopTime(3000, holdNrmDuration - 3000);
-			sounds[index].pool[mmw::SE_CRITICAL_CONNECT]->setLoopTime(3000, holdCrtDuration - 3000);
+			soundEffectBuffers[index].assign(soundEffectsTotalCount, nullptr);
+			std::copy(metronomeBuffers.begin(), metronomeBuffers.end(),
+			          soundEffectBuffers[index].begin() + soundEffectsCount);
+
+			std::vector<size_t> soundIndices(soundEffectsCount);
+			std::iota(soundIndices.begin(), soundIndices.end(), 0);
+			std::for_each(
+			    std::execution::par, soundIndices.begin(), soundIndices.end(),
+			    [&](size_t i)
+			    {
+				    std::string filename = getSoundEffectFilename(index, i);
+				    std::string name = IO::formatString("%s_%02d", mmw::SE_NAMES[i], index + 1);
+
+				    // Trim the hold SE loop for gapless playback
+				    soundEffectBuffers[index][i] = soundEffects.loadBuffer(
+				        filename, name, soundEffectsVolumes[i], soundEffectsFlags[i] & LOOP, 3000);
+
+				    SoundInstance& debugSound = debugSounds[i + (index * soundEffectsCount)];
+				    debugSound.name = name;
+
+				    ma_sound_init_from_file_w(&engine, IO::mbToWideStr(filename).c_str(),
+				                              maSoundFlagsDecodeAsync, &soundEffectsGroup, nullptr,
+				                              &debugSound.source);
+			    });
 		}
 	}
 
+	std::string AudioManager::getSoundEffectFilename(size_t profileIndex, size_t index)
+	{
+		return IO::formatString("%s%s%02d\\%s.mp3", mmw::Application::getAppDir().c_str(),
+		                        "res\\sound\\", static_cast<int>(profileIndex + 1),
+		                        mmw::SE_NAMES[index]);
+	}
+
+	std::vector<std::unique_ptr<SoundEffectBuffer>>
+	AudioManager::decodeSoundEffects(size_t profileIndex, ma_uint32 channelCount,
+	                                 ma_uint32 sampleRate)
+	{
+		std::vector<std::unique_ptr<SoundEffectBuffer>> buffers(soundEffectsTotalCount);
+		std::vector<size_t> soundIndices(soundEffectsCount);
+		std::iota(soundIndices.begin(), soundIndices.end(), 0);
+		std::for_each(std::execution::par, soundIndices.begin(), soundIndices.end(),
+		              [&](size_t i)
+		              {
+			              buffers[i] = SoundEffectMixer::decodeBuffer(
+			                  getSoundEffectFilename(profileIndex, i), mmw::SE_NAMES[i],
+			                  soundEffectsVolumes[i], soundEffectsFlags[i] & LOOP, 3000,
+			                  channelCount, sampleRate);
+		              });
+
+		for (size_t i = 0; i < metronomeNames.size(); ++i)
+			buffers[soundEffectsCount + i] = generateMetronomeClick(i, channelCount, sampleRate);
+
+		return buffers;
+	}
+
 	void AudioManager::uninitializeAudioEngine()
 	{
+		cancelMusicLoad();
+		joinCancelledMusicRequests(true);
 		disposeMusic();
-		for (size_t index = 0; index < soundEffectsProfileCount; index++)
-		{
-			for (auto& [name, sound] : sounds[index].pool)
-				sound->dispose();
-
-			sounds[index].pool.clear();
-		}
+		musicStretch.dispose();
+		musicScrubber.dispose();
+		soundEffects.dispose();
+		for (auto& buffers : soundEffectBuffers)
+			buffers.clear();
 
 		ma_engine_uninit(&engine);
 	}
 
-	mmw::Result AudioManager::loadMusic(const std::string& filename)
+	void AudioManager::loadMusicAsync(const std::string& filename)
 	{
+		cancelMusicLoad();
+		joinCancelledMusicRequests(false);
+		musicRequest = std::make_unique<MusicLoadRequest>(filename);
+		MusicLoadRequest* request = musicRequest.get();
+		request->worker = std::thread(
+		    [request]
+		    {
+			    // Previously opened tracks stream their cached wav instead of being decoded
+			    auto stream = std::make_unique<MusicStream>();
+			    const uint64_t hash = AudioCache::hashFile(request->filename);
+			    const std::string cachedFilename = AudioCache::findPcm(hash);
+			    bool isDecodedFromCache = !cachedFilename.empty();
+			    request->result =
+			        stream->open(isDecodedFromCache ? cachedFilename : request->filename);
+			    if (isDecodedFromCache && !request->result.isOk())
+			    {
+				    // A broken cache entry falls back to the source file
+				    isDecodedFromCache = false;
+				    request->result = stream->open(request->filename);
+			    }
+
+			    if (request->result.isOk())
+			    {
+				    stream->name = IO::File::getFilenameWithoutExtension(request->filename);
+				    stream->sourceHash = hash;
+				    stream->isDecodedFromCache = isDecodedFromCache;
+			    }
+
+			    // Superseded streams are disposed here instead of on the UI thread
+			    if (!request->cancelled)
+				    request->stream = std::move(stream);
+
+			    request->finished.store(true, std::memory_order_release);
+			    if (!request->cancelled)
+				    mmw::Application::requestRedraw();
+		    });
+	}
+
+	mmw::Result AudioManager::finishMusicLoad()
+	{
+		if (!isMusicLoadFinished())
+			return mmw::Result(mmw::ResultStatus::Error, "No music load finished");
+
+		musicRequest->worker.join();
+		mmw::Result result = musicRequest->result;
+
+		// Swap the whole source at once so the audio thread never sees a half initialized sound.
+		// Like a synchronous load, a failed one still unloads the previous music.
 		disposeMusic();
-		mmw::Result result = decodeAudioFile(filename, musicBuffer);
-		if (result.isOk())
+		if (result.isOk() && musicRequest->stream)
 		{
+			musicStream = std::move(musicRequest->stream);
+
 			// We want to always enable pitch here for miniaudio's resampler to work with playback
-			// speed
-			ma_sound_init_from_data_source(&engine, &musicBuffer.buffer,
-			                               MA_SOUND_FLAG_NO_SPATIALIZATION, &musicGroup, &music);
+			// speed. The music goes through the time stretch on its way to the music group.
+			ma_sound_config soundConfig = ma_sound_config_init_2(&engine);
+			soundConfig.pDataSource = musicStream->getDataSource();
+			soundConfig.flags = MA_SOUND_FLAG_NO_SPATIALIZATION;
+			soundConfig.pInitialAttachment = musicStretch.getNode();
+			ma_sound_init_ex(&engine, &soundConfig, &music);
+			musicScrubber.setMusic(musicStream->getPath());
 
 			// Sync
 			setPlaybackSpeed(playbackSpeed, 0);
 		}
 
+		musicRequest.reset();
+		joinCancelledMusicRequests(false);
 		return result;
 	}
 
+	void AudioManager::cancelMusicLoad()
+	{
+		if (!musicRequest)
+			return;
+
+		musicRequest->cancelled = true;
+		cancelledMusicRequests.push_back(std::move(musicRequest));
+	}
+
+	void AudioManager::joinCancelledMusicRequests(bool wait)
+	{
+		for (auto it = cancelledMusicRequests.begin(); it != cancelledMusicRequests.end();)
+		{
+			MusicLoadRequest& request = **it;
+			if (!wait && !request.isFinished())
+			{
+				++it;
+				continue;
+			}
+
+			request.worker.join();
+			it = cancelledMusicRequests.erase(it);
+		}
+	}
+
+	bool AudioManager::isMusicLoadPending() const { return musicRequest != nullptr; }
+
+	bool AudioManager::isMusicLoadFinished() const
+	{
+		return musicRequest && musicRequest->isFinished();
+	}
+
+	std::string AudioManager::getPendingMusicFilename() const
+	{
+		return musicRequest ? musicRequest->filename : "";
+	}
+
 	void AudioManager::playMusic(float currentTime)
 	{
+		musicScrubber.stop();
+
 		ma_uint64 length{};
 		ma_sound_get_length_in_pcm_frames(&music, &length);
 
@@ -159,23 +488,21 @@ namespace Audio
 		float time = musicOffset - currentTime;
 
 		// Starting past the music end
-		if (time * musicBuffer.sampleRate * -1 > length)
+		if (time * musicStream->sampleRate * -1 > length)
 			return;
 
-		ma_sound_set_start_time_in_milliseconds(&music, std::max(0.0f, time * 1000));
-		ma_sound_start(&music);
+		pushCommand({ AudioCommand::Type::PlayMusic, std::max(0.0f, time * 1000) });
 	}
 
-	void AudioManager::stopMusic() { ma_sound_stop(&music); }
+	void AudioManager::stopMusic() { pushCommand({ AudioCommand::Type::StopMusic }); }
 
 	void AudioManager::setMusicOffset(float currentTime, float offset)
 	{
 		musicOffset = offset / 1000.0f;
-		float seekTime = currentTime - musicOffset;
-		ma_sound_seek_to_pcm_frame(&music, seekTime * musicBuffer.sampleRate);
+		seekMusic(currentTime);
 
 		float start = getAudioEngineAbsoluteTime() + musicOffset - currentTime;
-		ma_sound_set_start_time_in_milliseconds(&music, std::max(0.0f, start * 1000));
+		pushCommand({ AudioCommand::Type::SetMusicStartTime, std::max(0.0f, start * 1000) });
 	}
 
 	float AudioManager::getMusicPosition()
@@ -196,34 +523,46 @@ namespace Audio
 
 	void AudioManager::disposeMusic()
 	{
-		if (musicBuffer.isValid())
+		// No command may still reach the sound or the stream being disposed (or swapped after)
+		flushCommands();
+		if (musicStream->isValid())
 		{
 			ma_sound_stop(&music);
 			ma_sound_uninit(&music);
-			musicBuffer.dispose();
+			musicStream->dispose();
+			musicScrubber.setMusic({});
 		}
 	}
 
 	void AudioManager::seekMusic(float time)
 	{
-		ma_uint64 seekFrame = (time - musicOffset) * musicBuffer.sampleRate;
-		ma_sound_seek_to_pcm_frame(&music, seekFrame);
-
-		ma_uint64 length{};
-		ma_result lengthResult = ma_sound_get_length_in_pcm_frames(&music, &length);
-		if (lengthResult != MA_SUCCESS)
-			return;
+		ma_uint64 seekFrame = std::max(0.0f, time - musicOffset) * musicStream->sampleRate;
+		pushCommand({ AudioCommand::Type::SeekMusic, 0.0f, seekFrame });
+	}
 
-		if (seekFrame > length)
-		{
-			// Seeking beyond the sound's length
-			music.atEnd = true;
-		}
-		else if (ma_sound_at_end(&music) && seekFrame < length)
+	double AudioManager::setMusicLoop(float start, float end)
+	{
+		if (!musicStream->isValid() || end <= start)
 		{
-			// Sound reached the end but sought to an earlier frame
-			music.atEnd = false;
+			clearMusicLoop();
+			return end - start;
 		}
+
+		// The length is rounded on its own so every pass lasts exactly as long
+		const double sampleRate = musicStream->sampleRate;
+		const int64_t startFrame = std::llround((start - musicOffset) * sampleRate);
+		const int64_t lengthFrames = std::max<int64_t>(1, std::llround((end - start) * sampleRate));
+		musicStream->setLoop(startFrame, startFrame + lengthFrames);
+
+		return lengthFrames / sampleRate;
+	}
+
+	void AudioManager::clearMusicLoop() { musicStream->setLoop(0, 0); }
+
+	void AudioManager::scrubMusic(float time)
+	{
+		if (musicStream->isValid())
+			musicScrubber.scrub(time - musicOffset);
 	}
 
 	float AudioManager::getMasterVolume() const { return masterVolume; }
@@ -231,7 +570,7 @@ namespace Audio
 	void AudioManager::setMasterVolume(float volume)
 	{
 		masterVolume = volume;
-		ma_engine_set_volume(&engine, volume);
+		pushCommand({ AudioCommand::Type::SetMasterVolume, volume });
 	}
 
 	float AudioManager::getMusicVolume() const { return musicVolume; }
@@ -239,7 +578,7 @@ namespace Audio
 	void AudioManager::setMusicVolume(float volume)
 	{
 		musicVolume = volume;
-		ma_sound_group_set_volume(&musicGroup, volume);
+		pushCommand({ AudioCommand::Type::SetMusicVolume, volume });
 	}
 
 	float AudioManager::getSoundEffectsVolume() const { return soundEffectsVolume; }
@@ -247,131 +586,149 @@ namespace Audio
 	void AudioManager::setSoundEffectsVolume(float volume)
 	{
 		soundEffectsVolume = volume;
-		ma_sound_group_set_volume(&soundEffectsGroup, volume);
+		pushCommand({ AudioCommand::Type::SetSoundEffectsVolume, volume });
 	}
 
 	float AudioManager::getPlaybackSpeed() const { return playbackSpeed; }
 
-	void AudioManager::setPlaybackSpeed(float speed, float currentTime)
+	void AudioManager::setPreservePitch(bool preserve)
 	{
-		const ma_uint32 speedAdjustedSampleRate =
-		    static_cast<ma_uint32>(speed * musicBuffer.sampleRate);
-		musicBuffer.effectiveSampleRate = speedAdjustedSampleRate;
-		music.engineNode.sampleRate = speedAdjustedSampleRate;
+		preservePitch = preserve;
+		pushCommand({ AudioCommand::Type::SetPreservePitch, preserve ? 1.0f : 0.0f });
+	}
 
-		ma_uint32 sampleRateIn = speedAdjustedSampleRate;
-		ma_uint32 sampleRateOut = engine.sampleRate;
-		ma_uint32 gcf = mmw::gcf(sampleRateIn, sampleRateOut);
-		sampleRateIn /= gcf;
-		sampleRateOut /= gcf;
+	bool AudioManager::getPreservePitch() const { return preservePitch; }
 
-		ma_linear_resampler& resampler = music.engineNode.resampler;
-		resampler.lpf.sampleRate = std::max(sampleRateIn, sampleRateOut);
-		resampler.inAdvanceInt = sampleRateIn / sampleRateOut;
-		resampler.inAdvanceFrac = sampleRateIn % sampleRateOut;
-		resampler.config.sampleRateIn = sampleRateIn;
-		resampler.config.sampleRateOut = sampleRateOut;
+	float AudioManager::getTimeStretchLoad() const { return musicStretch.getLoad(); }
+
+	void AudioManager::setPlaybackSpeed(float speed, float currentTime)
+	{
+		musicStream->effectiveSampleRate = static_cast<ma_uint32>(speed * musicStream->sampleRate);
+		pushCommand({ AudioCommand::Type::SetPlaybackSpeed, speed });
 
 		// Adjust timing of extendable sounds
-		for (auto& [name, sound] : sounds[soundEffectsProfileIndex].pool)
+		const float engineTime = getAudioEngineAbsoluteTime();
+		for (ExtendableVoice& voice : extendableVoices)
 		{
-			if ((sound->flags & EXTENDABLE) != 0)
-			{
-				for (auto& instance : sound->pool)
-				{
-					if (instance.isPlaying())
-						instance.extendDuration(currentTime, instance.absoluteEnd, speed);
-				}
-			}
+			if (voice.voice != 0 && voice.endTime > engineTime)
+				setExtendableVoiceEnd(voice,
+				                      ((voice.absoluteEnd - currentTime) / speed) + engineTime);
 		}
 
 		playbackSpeed = speed;
 	}
 
-	void AudioManager::playOneShotSound(std::string_view name)
+	size_t AudioManager::findSoundEffect(std::string_view name)
 	{
-		if (sounds[soundEffectsProfileIndex].pool.find(name) ==
-		    sounds[soundEffectsProfileIndex].pool.end())
-			return;
+		for (size_t i = 0; i < mmw::arrayLength(mmw::SE_NAMES); ++i)
+		{
+			if (name == mmw::SE_NAMES[i])
+				return i;
+		}
+
+		for (size_t i = 0; i < metronomeNames.size(); ++i)
+		{
+			if (name == metronomeNames[i])
+				return soundEffectsCount + i;
+		}
+
+		return -1;
+	}
 
-		sounds[soundEffectsProfileIndex].pool.at(name)->play(0, -1);
+	bool AudioManager::isSoundEffectExtendable(size_t index)
+	{
+		return index < soundEffectsCount && soundEffectsFlags[index] & EXTENDABLE;
+	}
+
+	SoundEffectBuffer* AudioManager::getSoundEffectBuffer(size_t index) const
+	{
+		const std::vector<SoundEffectBuffer*>& buffers =
+		    soundEffectBuffers[soundEffectsProfileIndex];
+		return index < buffers.size() ? buffers[index] : nullptr;
+	}
+
+	void AudioManager::setExtendableVoiceEnd(ExtendableVoice& voice, float endTime)
+	{
+		voice.endTime = endTime;
+		soundEffects.setEndFrame(voice.voice, soundEffects.secondsToFrames(endTime));
+	}
+
+	void AudioManager::playOneShotSound(std::string_view name)
+	{
+		// A start at frame 0 plays immediately
+		soundEffects.play(getSoundEffectBuffer(findSoundEffect(name)), 0);
 	}
 
 	void AudioManager::playSoundEffect(std::string_view name, float start, float end,
 	                                   float currentTime)
 	{
-		if (sounds[soundEffectsProfileIndex].pool.find(name) ==
-		    sounds[soundEffectsProfileIndex].pool.end())
+		const size_t index = findSoundEffect(name);
+		SoundEffectBuffer* buffer = getSoundEffectBuffer(index);
+		if (buffer == nullptr)
 			return;
 
-		SoundPool* soundPool = sounds[soundEffectsProfileIndex].pool.at(name).get();
 		const float absoluteStart = start + lastPlaybackTime;
 		const float absoluteEnd = end + lastPlaybackTime;
-		const int poolIndex = soundPool->getCurrentIndex();
+		const float engineTime = getAudioEngineAbsoluteTime();
 
-		if (soundPool->flags & SoundFlags::EXTENDABLE)
+		if (isSoundEffectExtendable(index))
 		{
-			// We want to re-use the currently playing instance
-			SoundInstance& currentInstance = soundPool->pool[poolIndex];
-
-			// If the start time is immediate, the source's time is effectively 0 and the sound
-			// isn't marked playing yet
-			const bool isCurrentInstancePlaying = ma_sound_is_playing(&currentInstance.source) ||
-			                                      (absoluteStart == currentInstance.absoluteStart &&
-			                                       currentInstance.lastStartTime != 0.0f);
+			// We want to re-use the currently playing voice
+			ExtendableVoice& current = extendableVoices[index];
+			const bool isCurrentVoicePlaying = current.voice != 0 && current.endTime > engineTime;
 
 			const bool isNewSoundWithinOldRange =
-			    mmw::isWithinRange(absoluteStart, currentInstance.absoluteStart,
-			                       currentInstance.absoluteEnd) &&
-			    mmw::isWithinRange(absoluteEnd, currentInstance.absoluteStart,
-			                       currentInstance.absoluteEnd);
+			    mmw::isWithinRange(absoluteStart, current.absoluteStart, current.absoluteEnd) &&
+			    mmw::isWithinRange(absoluteEnd, current.absoluteStart, current.absoluteEnd);
 
-			if (isNewSoundWithinOldRange && isCurrentInstancePlaying)
+			if (isNewSoundWithinOldRange && isCurrentVoicePlaying)
 				return;
 
-			if (isCurrentInstancePlaying && absoluteEnd > currentInstance.absoluteEnd)
+			if (isCurrentVoicePlaying && absoluteEnd > current.absoluteEnd)
 			{
-				currentInstance.extendDuration(currentTime, absoluteEnd, playbackSpeed);
+				current.absoluteEnd = absoluteEnd;
+				setExtendableVoiceEnd(current,
+				                      ((absoluteEnd - currentTime) / playbackSpeed) + engineTime);
 				return;
 			}
-		}
 
-		const float scaledEnd =
-		    ((absoluteEnd - absoluteStart) / playbackSpeed) + getAudioEngineAbsoluteTime();
+			// The new voice replaces the old one from its first frame
+			const float scaledEnd =
+			    std::max(start, engineTime) + ((absoluteEnd - absoluteStart) / playbackSpeed);
+			if (isCurrentVoicePlaying)
+				soundEffects.setEndFrame(current.voice, soundEffects.secondsToFrames(start));
+
+			current.voice = soundEffects.play(buffer, soundEffects.secondsToFrames(start),
+			                                  soundEffects.secondsToFrames(scaledEnd));
+			current.absoluteStart = absoluteStart;
+			current.absoluteEnd = absoluteEnd;
+			current.endTime = scaledEnd;
+			return;
+		}
 
-		soundPool->pool[poolIndex].absoluteStart = absoluteStart;
-		soundPool->pool[poolIndex].absoluteEnd = absoluteEnd;
-		soundPool->play(start, end == -1 ? end : scaledEnd);
+		const float scaledEnd = std::max(start, engineTime) + ((end - start) / playbackSpeed);
+		soundEffects.play(buffer, soundEffects.secondsToFrames(start),
+		                  end == -1 ? SoundEffectMixer::noEndFrame
+		                            : soundEffects.secondsToFrames(scaledEnd));
 	}
 
 	void AudioManager::stopSoundEffects(bool all)
 	{
 		if (all)
 		{
-			for (size_t index = 0; index < soundEffectsProfileCount; index++)
-				for (auto& [se, sound] : sounds[index].pool)
-					sound->stopAll();
+			soundEffects.stopAll();
 		}
 		else
 		{
-			sounds[soundEffectsProfileIndex].pool[mmw::SE_CONNECT]->stopAll();
-			sounds[soundEffectsProfileIndex].pool[mmw::SE_CRITICAL_CONNECT]->stopAll();
+			soundEffects.stopBuffer(getSoundEffectBuffer(findSoundEffect(mmw::SE_CONNECT)));
+			soundEffects.stopBuffer(
+			    getSoundEffectBuffer(findSoundEffect(mmw::SE_CRITICAL_CONNECT)));
 
 			// Also stop any scheduled sounds
-			for (size_t index = 0; index < soundEffectsProfileCount; index++)
-			{
-				for (auto& [se, sound] : sounds[index].pool)
-				{
-					for (auto& instance : sound->pool)
-					{
-						ma_uint64 cursor{};
-						ma_sound_get_cursor_in_pcm_frames(&instance.source, &cursor);
-						if (cursor <= 0)
-							ma_sound_stop(&instance.source);
-					}
-				}
-			}
+			soundEffects.stopScheduled();
 		}
+
+		std::fill(extendableVoices.begin(), extendableVoices.end(), ExtendableVoice{});
 	}
 
 	uint32_t AudioManager::getDeviceChannelCount() const
@@ -405,19 +762,22 @@ namespace Audio
 		return length + musicOffset;
 	}
 
+	// The engine time is atomic and read right after by the SE scheduling, so it isn't queued
 	void AudioManager::syncAudioEngineTimer() { ma_engine_set_time(&engine, 0); }
 
-	bool AudioManager::isMusicInitialized() const { return musicBuffer.isValid(); }
+	bool AudioManager::isMusicInitialized() const { return musicStream->isValid(); }
 
 	bool AudioManager::isMusicAtEnd() const { return ma_sound_at_end(&music); }
 
 	bool AudioManager::isSoundPlaying(std::string_view name) const
 	{
-		if (sounds[soundEffectsProfileIndex].pool.find(name) ==
-		    sounds[soundEffectsProfileIndex].pool.end())
-			return false;
+		const SoundEffectBuffer* buffer = getSoundEffectBuffer(findSoundEffect(name));
+		return buffer != nullptr && buffer->playingVoices.load(std::memory_order_relaxed) > 0;
+	}
 
-		return sounds[soundEffectsProfileIndex].pool.at(name)->isAnyPlaying();
+	SoundEffectMixer::Stats AudioManager::getSoundEffectStats() const
+	{
+		return soundEffects.getStats();
 	}
 
 	size_t AudioManager::getSoundEffectsProfileIndex() const { return soundEffectsProfileIndex; }
@@ -1,20 +1,95 @@
 #pragma once
 #include "Sound.h"
+#include "MusicScrubber.h"
+#include "MusicStream.h"
+#include "SoundEffectMixer.h"
+#include "SpscQueue.h"
+#include "TimeStretchNode.h"
 #include <unordered_map>
 #include <vector>
 #include <array>
 #include <memory>
+#include <thread>
 
 namespace Audio
 {
+	/**
+	 * @brief Music file opened on a worker thread.
+	 * The stream is swapped in by AudioManager::finishMusicLoad once finished, which
+	 * ScoreEditor::updateMusicLoad polls every frame.
+	 */
+	class MusicLoadRequest
+	{
+	  private:
+		std::thread worker;
+		std::atomic<bool> cancelled{ false };
+		std::atomic<bool> finished{ false };
+
+		friend class AudioManager;
+
+	  public:
+		const std::string filename;
+
+		// Only valid once the request is finished
+		std::unique_ptr<MusicStream> stream;
+		MikuMikuWorld::Result result = MikuMikuWorld::Result::Ok();
+
+		MusicLoadRequest(const std::string& filename) : filename{ filename } {}
+
+		inline bool isFinished() const { return finished.load(std::memory_order_acquire); }
+	};
+
+	/**
+	 * @brief Change to the playback state made by the UI, applied at the start of an audio callback
+	 */
+	struct AudioCommand
+	{
+		enum class Type : uint8_t
+		{
+			PlayMusic,
+			StopMusic,
+			SeekMusic,
+			SetMusicStartTime,
+			SetPlaybackSpeed,
+			SetPreservePitch,
+			SetMasterVolume,
+			SetMusicVolume,
+			SetSoundEffectsVolume
+		};
+
+		Type type{};
+		// Volume, playback speed, start time in milliseconds or 0/1 for flags
+		float value{};
+		ma_uint64 frame{};
+	};
+
 	class AudioManager
 	{
 	  private:
 		ma_engine engine;
 		ma_sound music;
 		ma_sound_group musicGroup;
+		TimeStretchNode musicStretch;
+		MusicScrubber musicScrubber;
 		ma_sound_group soundEffectsGroup;
-		std::array<SoundEffectProfile, soundEffectsProfileCount> sounds;
+		SoundEffectMixer soundEffects;
+
+		// Indexed like findSoundEffect, null where a sound effect failed to load
+		std::array<std::vector<SoundEffectBuffer*>, soundEffectsProfileCount> soundEffectBuffers;
+
+		// Hold sounds keep a single voice per sound effect that is extended instead of restarted
+		struct ExtendableVoice
+		{
+			SoundEffectMixer::VoiceId voice{};
+
+			// The absolute start and end times in seconds
+			float absoluteStart{};
+			float absoluteEnd{};
+
+			// Engine time the voice stops at in seconds
+			float endTime{};
+		};
+		std::vector<ExtendableVoice> extendableVoices;
 
 		// Offset from chart time in seconds
 		float musicOffset{ 0.0f };
@@ -24,12 +99,43 @@ namespace Audio
 		float soundEffectsVolume{ 1.0f };
 
 		float playbackSpeed{ 1.0f };
+		bool preservePitch{ true };
 		size_t soundEffectsProfileIndex{ 0 };
 
 		float lastPlaybackTime{};
 
+		std::unique_ptr<MusicLoadRequest> musicRequest;
+		// Cancelled requests can't interrupt opening a file, they are joined once finished
+		std::vector<std::unique_ptr<MusicLoadRequest>> cancelledMusicRequests;
+
+		// Only the UI thread pushes and only the audio thread pops while the device is started
+		SpscQueue<AudioCommand, 1024> commands;
+		uint64_t pushedCommands{};
+		std::atomic<uint64_t> processedCommands{ 0 };
+
+		static void dataCallback(ma_device* device, void* output, const void* input,
+		                         ma_uint32 frameCount);
+		void pushCommand(const AudioCommand& command);
+		void processCommands();
+		void applyCommand(const AudioCommand& command);
+
+		/**
+		 * @brief Resample the music for the playback speed unless it is time stretched instead
+		 */
+		void applyMusicSampleRate();
+
+		/**
+		 * @brief Wait until the audio thread applied every pushed command
+		 */
+		void flushCommands();
+
+		void joinCancelledMusicRequests(bool wait);
+		SoundEffectBuffer* getSoundEffectBuffer(size_t index) const;
+		void setExtendableVoiceEnd(ExtendableVoice& voice, float endTime);
+
 	  public:
-		SoundBuffer musicBuffer;
+		// Never null, holds an empty stream while no music is loaded
+		std::unique_ptr<MusicStream> musicStream{ std::make_unique<MusicStream>() };
 		std::vector<SoundInstance> debugSounds;
 
 		void initializeAudioEngine();
@@ -45,7 +151,39 @@ namespace Audio
 		float getAudioEngineAbsoluteTime() const;
 
 		void loadSoundEffects();
-		MikuMikuWorld::Result loadMusic(const std::string& filename);
+
+		/**
+		 * @brief Index of a sound effect in SE_NAMES, followed by the metronome's clicks.
+		 * -1 if there is none.
+		 */
+		static size_t findSoundEffect(std::string_view name);
+
+		/**
+		 * @brief Whether overlapping plays of a sound effect extend a single voice (ex. holds)
+		 */
+		static bool isSoundEffectExtendable(size_t index);
+		static std::string getSoundEffectFilename(size_t profileIndex, size_t index);
+
+		/**
+		 * @brief Decode the sound effects of a profile without the engine (ex. offline rendering)
+		 * @return Buffers indexed like findSoundEffect, null where a sound effect failed to load
+		 */
+		static std::vector<std::unique_ptr<SoundEffectBuffer>>
+		decodeSoundEffects(size_t profileIndex, ma_uint32 channelCount, ma_uint32 sampleRate);
+		/**
+		 * @brief Start opening a music file in the background, replacing any pending load.
+		 * The current music keeps playing until the new one is swapped in.
+		 */
+		void loadMusicAsync(const std::string& filename);
+
+		/**
+		 * @brief Swap in the music of a finished load. Only call once isMusicLoadFinished.
+		 */
+		MikuMikuWorld::Result finishMusicLoad();
+		void cancelMusicLoad();
+		bool isMusicLoadPending() const;
+		bool isMusicLoadFinished() const;
+		std::string getPendingMusicFilename() const;
 
 		void setMasterVolume(float volume);
 		float getMasterVolume() const;
@@ -59,10 +197,30 @@ namespace Audio
 		void setPlaybackSpeed(float speed, float currentTime);
 		float getPlaybackSpeed() const;
 
+		/**
+		 * @brief Time stretch the music below 1x instead of resampling it, which lowers the pitch
+		 */
+		void setPreservePitch(bool preserve);
+		bool getPreservePitch() const;
+		float getTimeStretchLoad() const;
+
 		void playMusic(float currentTime);
 		void stopMusic();
 		void seekMusic(float time);
+
+		/**
+		 * @brief Play a short grain of the music at a chart time while paused
+		 */
+		void scrubMusic(float time);
 		void setMusicOffset(float currentTime, float offset);
+
+		/**
+		 * @brief Loop the music between two chart times in seconds from the next seek. The stream
+		 * wraps on the audio thread so the end joins the start without a gap.
+		 * @return The length of the loop once rounded to whole frames
+		 */
+		double setMusicLoop(float start, float end);
+		void clearMusicLoop();
 		float getMusicPosition();
 		float getMusicLength();
 		float getMusicOffset() const;
@@ -75,13 +233,12 @@ namespace Audio
 		void playSoundEffect(std::string_view name, float start, float end, float currentTime);
 		void stopSoundEffects(bool all);
 		bool isSoundPlaying(std::string_view name) const;
+		SoundEffectMixer::Stats getSoundEffectStats() const;
 
 		size_t getSoundEffectsProfileIndex() const;
 		void setSoundEffectsProfileIndex(size_t index);
 
 		float getLastPlaybackTime() const;
 		void setLastPlaybackTime(float time);
-
-		using SoundPoolPair = std::pair<std::string_view, std::unique_ptr<SoundPool>>;
 	};
 }
\ No newline at end of file
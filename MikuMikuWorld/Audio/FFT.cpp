@@ -0,0 +1,80 @@
+#include "FFT.h"
+#include <cassert>
+#include <cmath>
+
+namespace Audio
+{
+	namespace
+	{
+		constexpr double twoPi = 6.283185307179586;
+	}
+
+	FFT::FFT(size_t size) : size{ size }
+	{
+		assert(size >= 2 && (size & (size - 1)) == 0);
+
+		size_t bits = 0;
+		while ((size_t{ 1 } << bits) < size)
+			++bits;
+
+		bitReversed.resize(size);
+		for (size_t i = 0; i < size; ++i)
+		{
+			size_t reversed = 0;
+			for (size_t bit = 0; bit < bits; ++bit)
+				reversed |= ((i >> bit) & 1) << (bits - 1 - bit);
+
+			bitReversed[i] = reversed;
+		}
+
+		twiddles.resize(size / 2);
+		for (size_t i = 0; i < size / 2; ++i)
+			twiddles[i] = std::polar(1.0f, static_cast<float>(-twoPi * i / size));
+	}
+
+	void FFT::forward(std::complex<float>* data) const
+	{
+		for (size_t i = 0; i < size; ++i)
+		{
+			if (i < bitReversed[i])
+				std::swap(data[i], data[bitReversed[i]]);
+		}
+
+		for (size_t length = 2; length <= size; length <<= 1)
+		{
+			const size_t half = length / 2;
+			const size_t twiddleStep = size / length;
+			for (size_t start = 0; start < size; start += length)
+			{
+				for (size_t i = 0; i < half; ++i)
+				{
+					const std::complex<float> odd =
+					    data[start + i + half] * twiddles[i * twiddleStep];
+					data[start + i + half] = data[start + i] - odd;
+					data[start + i] += odd;
+				}
+			}
+		}
+	}
+
+	void FFT::magnitudes(const float* samples, const float* window,
+	                     std::vector<std::complex<float>>& scratch, float* output) const
+	{
+		scratch.resize(size);
+		for (size_t i = 0; i < size; ++i)
+			scratch[i] = { window ? samples[i] * window[i] : samples[i], 0.0f };
+
+		forward(scratch.data());
+		for (size_t i = 0; i <= size / 2; ++i)
+			output[i] = std::abs(scratch[i]);
+	}
+
+	std::vector<float> FFT::hannWindow(size_t length)
+	{
+		std::vector<float> window(length);
+		for (size_t i = 0; i < length; ++i)
+			window[i] = static_cast<float>(0.5 - 0.5 * std::cos(twoPi * i / length));
+
+		return window;
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <complex>
+#include <vector>
+
+namespace Audio
+{
+	/**
+	 * @brief In-place radix-2 FFT of a fixed power of two size.
+	 * The tables are built once so a single instance can be shared by threads transforming
+	 * their own buffers.
+	 */
+	class FFT
+	{
+	  private:
+		size_t size{};
+		std::vector<size_t> bitReversed;
+		std::vector<std::complex<float>> twiddles;
+
+	  public:
+		explicit FFT(size_t size);
+
+		void forward(std::complex<float>* data) const;
+
+		/**
+		 * @brief Magnitudes of the first size / 2 + 1 bins of a real signal
+		 * @param window Applied to the samples first, may be null
+		 * @param scratch Holds size values, reused between calls to avoid allocating
+		 */
+		void magnitudes(const float* samples, const float* window,
+		                std::vector<std::complex<float>>& scratch, float* output) const;
+
+		inline size_t getSize() const { return size; }
+
+		/**
+		 * @brief Periodic Hann window of a given length
+		 */
+		static std::vector<float> hannWindow(size_t length);
+	};
+}
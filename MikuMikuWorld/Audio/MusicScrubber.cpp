@@ -0,0 +1,268 @@
+#include "MusicScrubber.h"
+#include "MusicStream.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace Audio
+{
+	ma_result MusicScrubber::initialize(ma_engine* engine, ma_node* output)
+	{
+		static ma_node_vtable vtable = { onProcess, nullptr, 0, 1, 0 };
+
+		channelCount = ma_engine_get_channels(engine);
+		sampleRate = ma_engine_get_sample_rate(engine);
+		grainFrames = static_cast<ma_uint64>(grainDuration * sampleRate);
+		fadeFrames = std::max<ma_uint64>(1, static_cast<ma_uint64>(fadeDuration * sampleRate));
+		node.scrubber = this;
+
+		for (Grain& grain : grains)
+			grain.samples.assign(grainFrames * channelCount, 0.0f);
+
+		fadeIn.resize(fadeFrames);
+		for (size_t i = 0; i < fadeFrames; ++i)
+			fadeIn[i] = 0.5f - 0.5f * std::cos(3.14159265f * i / fadeFrames);
+
+		ma_node_config config = ma_node_config_init();
+		config.vtable = &vtable;
+		config.pOutputChannels = &channelCount;
+
+		ma_result result = ma_node_init(ma_engine_get_node_graph(engine), &config, nullptr, &node);
+		if (result != MA_SUCCESS)
+			return result;
+
+		result = ma_node_attach_output_bus(&node, 0, output, 0);
+		if (result != MA_SUCCESS)
+		{
+			ma_node_uninit(&node, nullptr);
+			return result;
+		}
+
+		workerSlots.clear();
+		workerSlots.reserve(grainSlots);
+		for (uint32_t slot = 0; slot < grainSlots; ++slot)
+			workerSlots.push_back(slot);
+
+		stopping = false;
+		worker = std::thread(&MusicScrubber::run, this);
+		initialized = true;
+		return MA_SUCCESS;
+	}
+
+	void MusicScrubber::dispose()
+	{
+		if (!initialized)
+			return;
+
+		ma_node_uninit(&node, nullptr);
+		initialized = false;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		condition.notify_one();
+		worker.join();
+
+		if (decoderInitialized)
+			ma_decoder_uninit(&decoder);
+
+		decoderInitialized = false;
+		hasRequest = false;
+		hasPendingMusic = false;
+		voiceCount = 0;
+
+		uint32_t slot;
+		while (readyGrains.pop(slot))
+			;
+		while (freeGrains.pop(slot))
+			;
+	}
+
+	void MusicScrubber::setMusic(const std::wstring& path)
+	{
+		if (!initialized)
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pendingMusicPath = path;
+			hasPendingMusic = true;
+			hasRequest = false;
+		}
+		condition.notify_one();
+	}
+
+	void MusicScrubber::scrub(float time)
+	{
+		if (!initialized)
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			requestedFrame =
+			    static_cast<int64_t>(std::floor(static_cast<double>(time) * sampleRate));
+			hasRequest = true;
+		}
+		condition.notify_one();
+	}
+
+	void MusicScrubber::stop()
+	{
+		if (initialized)
+			stopRequested.store(true, std::memory_order_release);
+	}
+
+	void MusicScrubber::run()
+	{
+		while (true)
+		{
+			std::wstring path;
+			bool openMusic = false;
+			int64_t frame = 0;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				auto hasFreeSlot = [this]
+				{
+					uint32_t slot;
+					while (freeGrains.pop(slot))
+						workerSlots.push_back(slot);
+
+					return !workerSlots.empty();
+				};
+
+				// The audio thread doesn't notify when it hands a slot back, poll while all are out
+				while (!stopping && !hasPendingMusic && !(hasRequest && hasFreeSlot()))
+				{
+					if (hasRequest)
+						condition.wait_for(lock, std::chrono::milliseconds(2));
+					else
+						condition.wait(lock);
+				}
+
+				if (stopping)
+					return;
+
+				if (hasPendingMusic)
+				{
+					path = std::move(pendingMusicPath);
+					hasPendingMusic = false;
+					openMusic = true;
+				}
+				else
+				{
+					frame = requestedFrame;
+					hasRequest = false;
+				}
+			}
+
+			if (openMusic)
+			{
+				openDecoder(path);
+				continue;
+			}
+
+			const uint32_t slot = workerSlots.back();
+			workerSlots.pop_back();
+			decodeGrain(slot, frame);
+		}
+	}
+
+	void MusicScrubber::openDecoder(const std::wstring& path)
+	{
+		if (decoderInitialized)
+			ma_decoder_uninit(&decoder);
+
+		decoderInitialized = false;
+		if (path.empty())
+			return;
+
+		// Decode straight to the engine's format so grains are mixed as they are
+		ma_decoder_config decoderConfig =
+		    ma_decoder_config_init(ma_format_f32, channelCount, sampleRate);
+		decoderConfig.seekPointCount = MusicStream::seekPointCount;
+		decoderInitialized =
+		    ma_decoder_init_file_w(path.c_str(), &decoderConfig, &decoder) == MA_SUCCESS;
+	}
+
+	void MusicScrubber::decodeGrain(uint32_t slot, int64_t frame)
+	{
+		Grain& grain = grains[slot];
+
+		// Times before the music starts are silent
+		const ma_uint64 silentFrames =
+		    frame < 0 ? std::min<ma_uint64>(static_cast<ma_uint64>(-frame), grainFrames) : 0;
+		std::fill_n(grain.samples.begin(), silentFrames * channelCount, 0.0f);
+
+		ma_uint64 framesRead = 0;
+		if (decoderInitialized && silentFrames < grainFrames &&
+		    ma_decoder_seek_to_pcm_frame(&decoder, std::max<int64_t>(frame, 0)) == MA_SUCCESS)
+		{
+			ma_decoder_read_pcm_frames(&decoder, grain.samples.data() + silentFrames * channelCount,
+			                           grainFrames - silentFrames, &framesRead);
+		}
+
+		grain.frameCount = silentFrames + framesRead;
+		if (framesRead == 0 || !readyGrains.push(slot))
+			workerSlots.push_back(slot);
+	}
+
+	void MusicScrubber::onProcess(ma_node* node, const float** framesIn, ma_uint32* frameCountIn,
+	                              float** framesOut, ma_uint32* frameCountOut)
+	{
+		static_cast<Node*>(node)->scrubber->process(framesOut[0], *frameCountOut);
+	}
+
+	void MusicScrubber::process(float* output, ma_uint32 frameCount)
+	{
+		std::fill_n(output, static_cast<size_t>(frameCount) * channelCount, 0.0f);
+
+		if (stopRequested.exchange(false, std::memory_order_acq_rel))
+		{
+			for (size_t i = 0; i < voiceCount; ++i)
+				voices[i].fadeOutStart = std::min(voices[i].fadeOutStart, voices[i].cursor);
+		}
+
+		// A new grain cross-fades with the ones before it. There are as many voices as slots so
+		// one is always free.
+		uint32_t slot;
+		while (readyGrains.pop(slot))
+		{
+			for (size_t i = 0; i < voiceCount; ++i)
+				voices[i].fadeOutStart = std::min(voices[i].fadeOutStart, voices[i].cursor);
+
+			const ma_uint64 length = grains[slot].frameCount;
+			voices[voiceCount++] = { slot, 0, length > fadeFrames ? length - fadeFrames : 0 };
+		}
+
+		for (size_t i = 0; i < voiceCount;)
+		{
+			Voice& voice = voices[i];
+			const Grain& grain = grains[voice.slot];
+			const ma_uint64 end = std::min(grain.frameCount, voice.fadeOutStart + fadeFrames);
+			for (ma_uint32 frame = 0; frame < frameCount && voice.cursor < end;
+			     ++frame, ++voice.cursor)
+			{
+				float gain = voice.cursor < fadeFrames ? fadeIn[voice.cursor] : 1.0f;
+				if (voice.cursor >= voice.fadeOutStart)
+					gain *= 1.0f - fadeIn[voice.cursor - voice.fadeOutStart];
+
+				const float* in = grain.samples.data() + voice.cursor * channelCount;
+				float* out = output + static_cast<size_t>(frame) * channelCount;
+				for (ma_uint32 channel = 0; channel < channelCount; ++channel)
+					out[channel] += in[channel] * gain;
+			}
+
+			if (voice.cursor >= end)
+				releaseVoice(i);
+			else
+				++i;
+		}
+	}
+
+	void MusicScrubber::releaseVoice(size_t index)
+	{
+		freeGrains.push(voices[index].slot);
+		voices[index] = voices[--voiceCount];
+	}
+}
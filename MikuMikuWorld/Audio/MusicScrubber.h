@@ -0,0 +1,118 @@
+#pragma once
+#include "Sound.h"
+#include "SpscQueue.h"
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Audio
+{
+	/**
+	 * @brief Miniaudio node playing short grains of the music at a requested time (ex. while
+	 * dragging the timeline cursor). A worker decodes each grain from its own decoder into one of
+	 * a few preallocated slots, the audio thread only fades them in and out and hands the slots
+	 * back, so grains can be retriggered at mouse move rate without allocating.
+	 */
+	class MusicScrubber
+	{
+	  public:
+		static constexpr float grainDuration{ 0.08f };
+		static constexpr float fadeDuration{ 0.005f };
+		static constexpr uint32_t grainSlots{ 8 };
+
+	  private:
+		struct Grain
+		{
+			std::vector<float> samples;
+			ma_uint64 frameCount{};
+		};
+
+		struct Voice
+		{
+			uint32_t slot{};
+			ma_uint64 cursor{};
+			ma_uint64 fadeOutStart{};
+		};
+
+		// Miniaudio expects the node base first, the callback finds the scrubber through it
+		struct Node
+		{
+			ma_node_base base;
+			MusicScrubber* scrubber;
+		};
+
+		Node node{};
+		bool initialized{ false };
+		ma_uint32 channelCount{};
+		ma_uint32 sampleRate{};
+		ma_uint64 grainFrames{};
+		ma_uint64 fadeFrames{};
+
+		// Allocated once in initialize
+		std::array<Grain, grainSlots> grains{};
+		std::vector<float> fadeIn;
+
+		// Slots travel from the worker to the audio thread and back, never owned by both
+		SpscQueue<uint32_t, 16> readyGrains;
+		SpscQueue<uint32_t, 16> freeGrains;
+
+		// Only touched by the audio thread
+		std::array<Voice, grainSlots> voices{};
+		size_t voiceCount{};
+		std::atomic<bool> stopRequested{ false };
+
+		std::thread worker;
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool stopping{ false };
+		// Only the latest request is decoded, the ones in between are skipped
+		bool hasRequest{ false };
+		int64_t requestedFrame{};
+		bool hasPendingMusic{ false };
+		std::wstring pendingMusicPath;
+
+		// Worker only
+		ma_decoder decoder{};
+		bool decoderInitialized{ false };
+		std::vector<uint32_t> workerSlots;
+
+		static void onProcess(ma_node* node, const float** framesIn, ma_uint32* frameCountIn,
+		                      float** framesOut, ma_uint32* frameCountOut);
+
+		void process(float* output, ma_uint32 frameCount);
+		void releaseVoice(size_t index);
+		void run();
+		void openDecoder(const std::wstring& path);
+		void decodeGrain(uint32_t slot, int64_t frame);
+
+	  public:
+		MusicScrubber() = default;
+		MusicScrubber(const MusicScrubber&) = delete;
+		MusicScrubber& operator=(const MusicScrubber&) = delete;
+
+		/**
+		 * @brief Create the node and attach it to the input of another node (ex. a sound group)
+		 */
+		ma_result initialize(ma_engine* engine, ma_node* output);
+		void dispose();
+
+		/**
+		 * @brief Open the music grains are decoded from in the background, empty to close it
+		 */
+		void setMusic(const std::wstring& path);
+
+		/**
+		 * @brief Play a grain starting at a time of the music in seconds, fading out the last one
+		 */
+		void scrub(float time);
+
+		/**
+		 * @brief Fade out the grains still playing
+		 */
+		void stop();
+	};
+}
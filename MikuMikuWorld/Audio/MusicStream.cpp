@@ -0,0 +1,428 @@
+#include "MusicStream.h"
+#include "../File.h"
+#include "../IO.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+
+namespace Audio
+{
+	namespace mmw = MikuMikuWorld;
+
+	ma_data_source_vtable MusicStream::vtable = { MusicStream::onRead,
+		                                          MusicStream::onSeek,
+		                                          MusicStream::onGetDataFormat,
+		                                          MusicStream::onGetCursor,
+		                                          MusicStream::onGetLength,
+		                                          nullptr,
+		                                          0 };
+
+	mmw::Result MusicStream::open(const std::string& filename)
+	{
+		dispose();
+		if (!IO::File::exists(filename))
+			return mmw::Result(mmw::ResultStatus::Error, "File not found");
+
+		std::string fileExtension = IO::File::getFileExtension(filename);
+		std::transform(fileExtension.begin(), fileExtension.end(), fileExtension.begin(),
+		               ::tolower);
+
+		if (!isSupportedFileFormat(fileExtension))
+			return mmw::Result(mmw::ResultStatus::Error, "Unsupported file format");
+
+		path = IO::mbToWideStr(filename);
+		ma_decoder_config decoderConfig = ma_decoder_config_init(ma_format_s16, 0, 0);
+		decoderConfig.seekPointCount = seekPointCount;
+		if (ma_decoder_init_file_w(path.c_str(), &decoderConfig, &decoder) != MA_SUCCESS)
+			return mmw::Result(mmw::ResultStatus::Error, "Failed to decode music file");
+
+		ma_format format{};
+		ma_decoder_get_data_format(&decoder, &format, &channelCount, &sampleRate, nullptr, 0);
+		ma_decoder_get_length_in_pcm_frames(&decoder, &frameCount);
+		if (channelCount == 0 || sampleRate == 0 || frameCount == 0)
+		{
+			ma_decoder_uninit(&decoder);
+			return mmw::Result(mmw::ResultStatus::Error, "Failed to get music length");
+		}
+
+		ma_data_source_config dataSourceConfig = ma_data_source_config_init();
+		dataSourceConfig.vtable = &vtable;
+		ma_data_source_init(&dataSourceConfig, &base);
+		ma_pcm_rb_init(ma_format_s16, channelCount, ringBufferFrames, nullptr, nullptr,
+		               &ringBuffer);
+
+		name = IO::File::getFilenameWithoutExtension(filename);
+		effectiveSampleRate = sampleRate;
+		initialized = true;
+		worker = std::thread(&MusicStream::run, this);
+
+		return mmw::Result::Ok();
+	}
+
+	void MusicStream::dispose()
+	{
+		if (!initialized)
+			return;
+
+		stopping = true;
+		condition.notify_one();
+		if (worker.joinable())
+			worker.join();
+
+		stopScan();
+		ma_pcm_rb_uninit(&ringBuffer);
+		ma_decoder_uninit(&decoder);
+		ma_data_source_uninit(&base);
+
+		initialized = false;
+		stopping = false;
+		name.clear();
+		path.clear();
+		sampleRate = 0;
+		channelCount = 0;
+		frameCount = 0;
+		effectiveSampleRate = 0;
+		sourceHash = 0;
+		isDecodedFromCache = false;
+
+		seekTarget = 0;
+		requestedGeneration = 0;
+		producedGeneration = 0;
+		generationStart = 0;
+		cursor = 0;
+		underrunFrames = 0;
+		readerGeneration = 0;
+		framesConsumed = 0;
+		framesToSkip = 0;
+		framesWritten = 0;
+		decoderAtEnd = false;
+		readerPosition = 0;
+		decodePosition = 0;
+		readerLoop = {};
+		decoderLoop = {};
+		loopStart = 0;
+		loopEnd = 0;
+		loopChanged = false;
+	}
+
+	void MusicStream::seek(ma_uint64 frameIndex)
+	{
+		// Already decoding from there (ex. a seek command before the sound repeats it on start)
+		const bool isLoopChanged = loopChanged.exchange(false);
+		if (cursor.load() == frameIndex && !isLoopChanged)
+			return;
+
+		seekTarget.store(frameIndex);
+		cursor.store(frameIndex);
+		requestedGeneration.fetch_add(1, std::memory_order_release);
+		condition.notify_one();
+	}
+
+	void MusicStream::setLoop(int64_t startFrame, int64_t endFrame)
+	{
+		loopStart.store(startFrame);
+		loopEnd.store(endFrame);
+		loopChanged.store(true);
+	}
+
+	void MusicStream::run()
+	{
+		uint32_t generation = producedGeneration.load();
+		while (!stopping)
+		{
+			const uint32_t requested = requestedGeneration.load(std::memory_order_acquire);
+			if (requested != generation)
+			{
+				const ma_uint64 target = seekTarget.load();
+				ma_decoder_seek_to_pcm_frame(&decoder, target);
+				decoderAtEnd = false;
+				decodePosition = static_cast<int64_t>(target);
+				decoderLoop.reset(loopStart.load(), loopEnd.load(), decodePosition);
+				generation = requested;
+
+				generationStart.store(framesWritten, std::memory_order_relaxed);
+				producedGeneration.store(generation, std::memory_order_release);
+				continue;
+			}
+
+			// Keeping playback fed always comes before scanning
+			if (fillRingBuffer() || scanBlock())
+				continue;
+
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait_for(lock, std::chrono::milliseconds(5), [&]
+			                   { return stopping || requestedGeneration.load() != generation; });
+		}
+	}
+
+	bool MusicStream::fillRingBuffer()
+	{
+		if (decoderAtEnd || ma_pcm_rb_available_write(&ringBuffer) < decodeBlockFrames)
+			return false;
+
+		// The acquired region may be shorter than a block when it wraps around
+		ma_uint32 frames = decodeBlockFrames;
+		void* buffer{};
+		if (ma_pcm_rb_acquire_write(&ringBuffer, &frames, &buffer) != MA_SUCCESS || frames == 0)
+			return false;
+
+		ma_uint64 decoded{};
+		if (decoderLoop.active)
+		{
+			decoded = decodeLooped(static_cast<int16_t*>(buffer), frames);
+		}
+		else
+		{
+			ma_decoder_read_pcm_frames(&decoder, buffer, frames, &decoded);
+			decodePosition += decoded;
+		}
+
+		ma_pcm_rb_commit_write(&ringBuffer, static_cast<ma_uint32>(decoded));
+		framesWritten += decoded;
+
+		if (decoded < frames)
+			decoderAtEnd = true;
+
+		return decoded > 0;
+	}
+
+	ma_uint64 MusicStream::decodeLooped(int16_t* output, ma_uint64 count)
+	{
+		ma_uint64 written = 0;
+		while (written < count)
+		{
+			if (decodePosition >= decoderLoop.end)
+			{
+				decodePosition = decoderLoop.start;
+				ma_decoder_seek_to_pcm_frame(
+				    &decoder, static_cast<ma_uint64>(std::max<int64_t>(decodePosition, 0)));
+			}
+
+			int16_t* frames = output + written * channelCount;
+			ma_uint64 length = std::min<ma_uint64>(
+			    count - written, static_cast<ma_uint64>(decoderLoop.end - decodePosition));
+			ma_uint64 decoded = 0;
+			if (decodePosition < 0)
+				length = std::min<ma_uint64>(length, static_cast<ma_uint64>(-decodePosition));
+			else
+				ma_decoder_read_pcm_frames(&decoder, frames, length, &decoded);
+
+			// Parts of the loop before the music starts or after it ends are silent
+			std::memset(frames + decoded * channelCount, 0,
+			            static_cast<size_t>(length - decoded) * channelCount * sizeof(int16_t));
+			decodePosition += length;
+			written += length;
+		}
+
+		return written;
+	}
+
+	bool MusicStream::scanBlock()
+	{
+		std::lock_guard<std::mutex> lock(scanMutex);
+		if (!scanning)
+			return false;
+
+		if (!scanDecoderInitialized)
+		{
+			ma_decoder_config decoderConfig = ma_decoder_config_init(ma_format_s16, 0, 0);
+			scanDecoderInitialized =
+			    ma_decoder_init_file_w(path.c_str(), &decoderConfig, &scanDecoder) == MA_SUCCESS;
+		}
+
+		ma_uint64 decoded{};
+		if (scanDecoderInitialized)
+		{
+			scanBuffer.resize(static_cast<size_t>(scanBlockFrames) * channelCount);
+			ma_decoder_read_pcm_frames(&scanDecoder, scanBuffer.data(), scanBlockFrames,
+			                           &decoded);
+			if (decoded > 0 && onScanFrames)
+				onScanFrames(scanBuffer.data(), channelCount, decoded);
+
+			scannedFrames += decoded;
+		}
+
+		if (decoded < scanBlockFrames)
+		{
+			if (onScanComplete)
+				onScanComplete();
+
+			scanning = false;
+			onScanFrames = nullptr;
+			onScanComplete = nullptr;
+			if (scanDecoderInitialized)
+				ma_decoder_uninit(&scanDecoder);
+
+			scanDecoderInitialized = false;
+			scanBuffer = {};
+		}
+
+		return true;
+	}
+
+	void MusicStream::startScan(ScanFramesCallback onFrames, ScanCompleteCallback onComplete)
+	{
+		stopScan();
+		if (!initialized)
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(scanMutex);
+			onScanFrames = std::move(onFrames);
+			onScanComplete = std::move(onComplete);
+			scannedFrames = 0;
+			scanning = true;
+		}
+
+		condition.notify_one();
+	}
+
+	void MusicStream::stopScan()
+	{
+		// Waits for a block being scanned so the callbacks never outlive this call
+		std::lock_guard<std::mutex> lock(scanMutex);
+		scanning = false;
+		onScanFrames = nullptr;
+		onScanComplete = nullptr;
+		if (scanDecoderInitialized)
+			ma_decoder_uninit(&scanDecoder);
+
+		scanDecoderInitialized = false;
+		scanBuffer = {};
+	}
+
+	ma_uint64 MusicStream::discardFrames(ma_uint64 count)
+	{
+		ma_uint64 discarded = 0;
+		while (discarded < count)
+		{
+			ma_uint32 frames = static_cast<ma_uint32>(std::min<ma_uint64>(
+			    count - discarded, std::numeric_limits<ma_uint32>::max()));
+			void* buffer{};
+			if (ma_pcm_rb_acquire_read(&ringBuffer, &frames, &buffer) != MA_SUCCESS || frames == 0)
+				break;
+
+			ma_pcm_rb_commit_read(&ringBuffer, frames);
+			discarded += frames;
+		}
+
+		framesConsumed += discarded;
+		return discarded;
+	}
+
+	ma_uint64 MusicStream::read(int16_t* output, ma_uint64 count)
+	{
+		const uint32_t requested = requestedGeneration.load(std::memory_order_relaxed);
+		if (requested != readerGeneration)
+		{
+			readerGeneration = requested;
+			framesToSkip = 0;
+			readerPosition = static_cast<int64_t>(seekTarget.load());
+			readerLoop.reset(loopStart.load(), loopEnd.load(), readerPosition);
+		}
+
+		ma_uint64 copied = 0;
+		if (producedGeneration.load(std::memory_order_acquire) == requested)
+		{
+			// Drop frames decoded before the last seek
+			const ma_uint64 start = generationStart.load(std::memory_order_relaxed);
+			if (start > framesConsumed)
+				discardFrames(start - framesConsumed);
+
+			// Catch up with the silence played while the decoder was behind
+			framesToSkip -= discardFrames(framesToSkip);
+
+			while (framesToSkip == 0 && copied < count)
+			{
+				ma_uint32 frames = static_cast<ma_uint32>(
+				    std::min<ma_uint64>(count - copied, std::numeric_limits<ma_uint32>::max()));
+				void* buffer{};
+				if (ma_pcm_rb_acquire_read(&ringBuffer, &frames, &buffer) != MA_SUCCESS ||
+				    frames == 0)
+					break;
+
+				std::memcpy(output + copied * channelCount, buffer,
+				            static_cast<size_t>(frames) * channelCount * sizeof(int16_t));
+				ma_pcm_rb_commit_read(&ringBuffer, frames);
+				framesConsumed += frames;
+				copied += frames;
+			}
+		}
+
+		// Underruns play silence but keep the cursor moving so the music stays in sync
+		if (copied < count)
+		{
+			std::memset(output + copied * channelCount, 0,
+			            static_cast<size_t>(count - copied) * channelCount * sizeof(int16_t));
+			framesToSkip += count - copied;
+			underrunFrames += count - copied;
+		}
+
+		readerPosition += count;
+		if (readerLoop.active && readerPosition >= readerLoop.end)
+		{
+			const int64_t loopLength = readerLoop.end - readerLoop.start;
+			readerPosition = readerLoop.start + (readerPosition - readerLoop.end) % loopLength;
+		}
+
+		cursor.store(static_cast<ma_uint64>(std::max<int64_t>(readerPosition, 0)));
+		return count;
+	}
+
+	ma_result MusicStream::onRead(ma_data_source* dataSource, void* framesOut,
+	                              ma_uint64 frameCount, ma_uint64* framesRead)
+	{
+		MusicStream* stream = static_cast<MusicStream*>(dataSource);
+		const ma_uint64 position = stream->cursor.load();
+		const bool looping = stream->readerLoop.active;
+		if (!looping && position >= stream->frameCount)
+		{
+			if (framesRead)
+				*framesRead = 0;
+
+			return MA_AT_END;
+		}
+
+		// A loop never ends, it plays silence past the music if it reaches there
+		const ma_uint64 count =
+		    looping ? frameCount : std::min(frameCount, stream->frameCount - position);
+		const ma_uint64 read = stream->read(static_cast<int16_t*>(framesOut), count);
+		if (framesRead)
+			*framesRead = read;
+
+		return MA_SUCCESS;
+	}
+
+	ma_result MusicStream::onSeek(ma_data_source* dataSource, ma_uint64 frameIndex)
+	{
+		static_cast<MusicStream*>(dataSource)->seek(frameIndex);
+		return MA_SUCCESS;
+	}
+
+	ma_result MusicStream::onGetDataFormat(ma_data_source* dataSource, ma_format* format,
+	                                       ma_uint32* channels, ma_uint32* sampleRate,
+	                                       ma_channel* channelMap, size_t channelMapCap)
+	{
+		const MusicStream* stream = static_cast<const MusicStream*>(dataSource);
+		*format = ma_format_s16;
+		*channels = stream->channelCount;
+		*sampleRate = stream->sampleRate;
+		ma_channel_map_init_standard(ma_standard_channel_map_default, channelMap, channelMapCap,
+		                             stream->channelCount);
+
+		return MA_SUCCESS;
+	}
+
+	ma_result MusicStream::onGetCursor(ma_data_source* dataSource, ma_uint64* cursor)
+	{
+		*cursor = static_cast<const MusicStream*>(dataSource)->cursor.load();
+		return MA_SUCCESS;
+	}
+
+	ma_result MusicStream::onGetLength(ma_data_source* dataSource, ma_uint64* length)
+	{
+		*length = static_cast<const MusicStream*>(dataSource)->frameCount;
+		return MA_SUCCESS;
+	}
+}
@@ -0,0 +1,170 @@
+#pragma once
+#include "Sound.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Audio
+{
+	/**
+	 * @brief Music data source decoding ahead of the playback cursor on a worker thread.
+	 * Only a ring buffer of decoded frames is kept in memory regardless of the track length.
+	 */
+	class MusicStream
+	{
+	  public:
+		using ScanFramesCallback =
+		    std::function<void(const int16_t* samples, ma_uint32 channels, ma_uint64 frames)>;
+		using ScanCompleteCallback = std::function<void()>;
+
+		static constexpr ma_uint32 ringBufferFrames{ 1 << 16 };
+		static constexpr ma_uint32 decodeBlockFrames{ 4096 };
+		static constexpr ma_uint32 scanBlockFrames{ 1 << 14 };
+
+		// Lets mp3 seeks jump close to the target instead of decoding from the start
+		static constexpr ma_uint32 seekPointCount{ 4096 };
+
+	  private:
+		// Must stay the first member so the stream can be used as a miniaudio data source
+		ma_data_source_base base{};
+		ma_decoder decoder{};
+		ma_pcm_rb ringBuffer{};
+		std::wstring path;
+		bool initialized{ false };
+
+		std::thread worker;
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::atomic<bool> stopping{ false };
+
+		// Seeks bump the requested generation, the worker answers once it decodes from there.
+		// Frames written before the answer are stale and dropped by the reader. Seeks and reads
+		// happen on the same thread so the reader always sees its own requests in order.
+		std::atomic<ma_uint64> seekTarget{ 0 };
+		std::atomic<uint32_t> requestedGeneration{ 0 };
+		std::atomic<uint32_t> producedGeneration{ 0 };
+		std::atomic<ma_uint64> generationStart{ 0 };
+		std::atomic<ma_uint64> cursor{ 0 };
+		std::atomic<ma_uint64> underrunFrames{ 0 };
+
+		// Loop region in frames, it may reach outside the music where it plays silence.
+		// Both threads pick it up at the next generation so the frames in between stay in order.
+		std::atomic<int64_t> loopStart{ 0 };
+		std::atomic<int64_t> loopEnd{ 0 };
+		std::atomic<bool> loopChanged{ false };
+
+		struct LoopState
+		{
+			int64_t start{};
+			int64_t end{};
+			bool active{ false };
+
+			// Apply the loop only when the generation starts before its end
+			void reset(int64_t loopStart, int64_t loopEnd, int64_t position)
+			{
+				start = loopStart;
+				end = loopEnd;
+				active = loopEnd > loopStart && position < loopEnd;
+			}
+		};
+
+		// Audio thread only
+		uint32_t readerGeneration{};
+		ma_uint64 framesConsumed{};
+		ma_uint64 framesToSkip{};
+		int64_t readerPosition{};
+		LoopState readerLoop;
+
+		// Worker only
+		ma_uint64 framesWritten{};
+		bool decoderAtEnd{ false };
+		int64_t decodePosition{};
+		LoopState decoderLoop;
+
+		// The waveform scan decodes the whole track once with its own decoder
+		std::mutex scanMutex;
+		std::atomic<bool> scanning{ false };
+		std::atomic<ma_uint64> scannedFrames{ 0 };
+		ma_decoder scanDecoder{};
+		bool scanDecoderInitialized{ false };
+		std::vector<int16_t> scanBuffer;
+		ScanFramesCallback onScanFrames;
+		ScanCompleteCallback onScanComplete;
+
+		static ma_data_source_vtable vtable;
+		static ma_result onRead(ma_data_source* dataSource, void* framesOut, ma_uint64 frameCount,
+		                        ma_uint64* framesRead);
+		static ma_result onSeek(ma_data_source* dataSource, ma_uint64 frameIndex);
+		static ma_result onGetDataFormat(ma_data_source* dataSource, ma_format* format,
+		                                 ma_uint32* channels, ma_uint32* sampleRate,
+		                                 ma_channel* channelMap, size_t channelMapCap);
+		static ma_result onGetCursor(ma_data_source* dataSource, ma_uint64* cursor);
+		static ma_result onGetLength(ma_data_source* dataSource, ma_uint64* length);
+
+		void run();
+		bool fillRingBuffer();
+		ma_uint64 decodeLooped(int16_t* output, ma_uint64 frameCount);
+		bool scanBlock();
+		ma_uint64 discardFrames(ma_uint64 frameCount);
+		ma_uint64 read(int16_t* output, ma_uint64 frameCount);
+
+	  public:
+		std::string name;
+		ma_uint32 sampleRate{};
+		ma_uint32 channelCount{};
+		ma_uint64 frameCount{};
+		ma_uint32 effectiveSampleRate{};
+
+		// Content hash of the source file keying the audio cache, 0 when it couldn't be read
+		uint64_t sourceHash{};
+		// Whether the frames come from the cached wav instead of the source file
+		bool isDecodedFromCache{ false };
+
+		MusicStream() = default;
+		MusicStream(const MusicStream&) = delete;
+		MusicStream& operator=(const MusicStream&) = delete;
+		~MusicStream() { dispose(); }
+
+		MikuMikuWorld::Result open(const std::string& filename);
+		void dispose();
+
+		bool isValid() const { return initialized && sampleRate > 0 && frameCount > 0; }
+		inline ma_data_source* getDataSource() { return &base; }
+		inline const std::wstring& getPath() const { return path; }
+		inline ma_uint64 getUnderrunFrames() const { return underrunFrames.load(); }
+
+		/**
+		 * @brief Start decoding from a frame ahead of playback.
+		 * Only call from the audio thread, the one reading the stream (ex. from a queued command
+		 * or when miniaudio seeks the sound). It only stores atomics and wakes the worker without
+		 * waiting for it, so it is safe in the audio callback.
+		 */
+		void seek(ma_uint64 frameIndex);
+
+		/**
+		 * @brief Wrap back to a start frame whenever playback reaches an end frame, decoding the
+		 * start right after the end so the two join without a gap. Takes effect from the next
+		 * seek, an end not after the start disables the loop.
+		 */
+		void setLoop(int64_t startFrame, int64_t endFrame);
+
+		/**
+		 * @brief Decode the whole track block by block on the stream's worker (ex. to build the
+		 * waveform). The callbacks run on the worker thread.
+		 */
+		void startScan(ScanFramesCallback onFrames, ScanCompleteCallback onComplete);
+		void stopScan();
+		inline bool isScanning() const { return scanning.load(); }
+		inline float getScanProgress() const
+		{
+			if (frameCount == 0)
+				return 0.0f;
+
+			return std::min(scannedFrames.load() / static_cast<float>(frameCount), 1.0f);
+		}
+	};
+}
@@ -0,0 +1,350 @@
+#include "OfflineRenderer.h"
+#include "AudioManager.h"
+#include "../IO.h"
+#include <algorithm>
+#include <cmath>
+#include <execution>
+#include <filesystem>
+#include <numeric>
+
+namespace Audio
+{
+	namespace mmw = MikuMikuWorld;
+
+	namespace
+	{
+		struct RenderEvent
+		{
+			ma_uint64 start{};
+			ma_uint64 end{};
+			const SoundEffectBuffer* buffer{};
+		};
+
+		struct RenderSources
+		{
+			ma_uint32 channelCount{};
+			float musicGain{};
+			float soundEffectsGain{};
+
+			// Both sorted by start frame
+			std::vector<RenderEvent> notes;
+			std::vector<RenderEvent> holds;
+			ma_uint64 longestNote{};
+		};
+
+		// Mix the part of an event inside a block, loops wrap between their loop points
+		void mixEvent(const RenderEvent& event, float gain, ma_uint32 channelCount,
+		              ma_uint64 blockStart, ma_uint64 blockLength, float* block)
+		{
+			const SoundEffectBuffer& buffer = *event.buffer;
+			const ma_uint64 from = std::max(event.start, blockStart);
+			const ma_uint64 to = std::min(event.end, blockStart + blockLength);
+			const ma_uint64 sourceEnd = buffer.loop ? buffer.loopEnd : buffer.frameCount;
+
+			ma_uint64 cursor = from - event.start;
+			if (buffer.loop && cursor >= buffer.loopEnd)
+				cursor = buffer.loopStart +
+				         (cursor - buffer.loopStart) % (buffer.loopEnd - buffer.loopStart);
+
+			for (ma_uint64 frame = from; frame < to;)
+			{
+				if (cursor >= sourceEnd)
+				{
+					if (!buffer.loop)
+						break;
+
+					cursor = buffer.loopStart;
+				}
+
+				const ma_uint64 run = std::min(to - frame, sourceEnd - cursor);
+				const float* source = buffer.samples.data() + cursor * channelCount;
+				float* destination = block + (frame - blockStart) * channelCount;
+				for (size_t i = 0; i < run * channelCount; ++i)
+					destination[i] += source[i] * gain;
+
+				frame += run;
+				cursor += run;
+			}
+		}
+
+		// Music decoded for the blocks of a batch, one batch at a time so memory stays bounded
+		class MusicReader
+		{
+		  private:
+			ma_decoder decoder{};
+			bool initialized{ false };
+			ma_uint32 channelCount{};
+			ma_int64 offsetFrames{};
+			ma_uint64 frameCount{};
+
+		  public:
+			~MusicReader()
+			{
+				if (initialized)
+					ma_decoder_uninit(&decoder);
+			}
+
+			mmw::Result open(const std::string& filename, ma_uint32 channelCount,
+			                 ma_uint32 sampleRate, ma_int64 offsetFrames)
+			{
+				this->channelCount = channelCount;
+				this->offsetFrames = offsetFrames;
+
+				ma_decoder_config config =
+				    ma_decoder_config_init(ma_format_f32, channelCount, sampleRate);
+				ma_result result = ma_decoder_init_file_w(IO::mbToWideStr(filename).c_str(),
+				                                          &config, &decoder);
+				if (result != MA_SUCCESS)
+					return mmw::Result(mmw::ResultStatus::Error, ma_result_description(result));
+
+				initialized = true;
+				ma_decoder_get_length_in_pcm_frames(&decoder, &frameCount);
+				if (frameCount == 0)
+				{
+					// The length isn't known upfront for every format, count it in a first pass
+					std::vector<float> scratch(OfflineRenderer::blockFrames * channelCount);
+					ma_uint64 framesRead{};
+					do
+					{
+						ma_decoder_read_pcm_frames(&decoder, scratch.data(),
+						                           OfflineRenderer::blockFrames, &framesRead);
+						frameCount += framesRead;
+					} while (framesRead == OfflineRenderer::blockFrames);
+				}
+
+				// A negative offset starts the chart partway through the music
+				ma_decoder_seek_to_pcm_frame(&decoder, std::max<ma_int64>(0, -offsetFrames));
+				return mmw::Result::Ok();
+			}
+
+			// Output frame the music ends at
+			ma_int64 getEndFrame() const
+			{
+				return initialized ? static_cast<ma_int64>(frameCount) + offsetFrames : 0;
+			}
+
+			// Batches are read in order so the decoder only ever moves forward
+			void read(ma_uint64 start, ma_uint64 length, std::vector<float>& samples)
+			{
+				samples.assign(length * channelCount, 0.0f);
+				if (!initialized)
+					return;
+
+				const ma_int64 silentFrames =
+				    std::clamp<ma_int64>(offsetFrames - static_cast<ma_int64>(start), 0,
+				                         static_cast<ma_int64>(length));
+				ma_decoder_read_pcm_frames(&decoder, samples.data() + silentFrames * channelCount,
+				                           length - silentFrames, nullptr);
+			}
+		};
+
+		void mixBlock(const RenderSources& sources, const float* music, ma_uint64 blockStart,
+		              ma_uint64 blockLength, std::vector<float>& mix,
+		              std::vector<int16_t>& output)
+		{
+			const ma_uint32 channelCount = sources.channelCount;
+			mix.resize(blockLength * channelCount);
+			for (size_t i = 0; i < mix.size(); ++i)
+				mix[i] = music[i] * sources.musicGain;
+
+			// Only notes starting less than the longest sound before the block can reach it
+			const ma_uint64 blockEnd = blockStart + blockLength;
+			const ma_uint64 earliestStart =
+			    blockStart > sources.longestNote ? blockStart - sources.longestNote : 0;
+			auto note = std::lower_bound(sources.notes.begin(), sources.notes.end(), earliestStart,
+			                             [](const RenderEvent& event, ma_uint64 frame)
+			                             { return event.start < frame; });
+			for (; note != sources.notes.end() && note->start < blockEnd; ++note)
+			{
+				if (note->end > blockStart)
+					mixEvent(*note, sources.soundEffectsGain * note->buffer->volume,
+					         channelCount, blockStart, blockLength, mix.data());
+			}
+
+			for (const RenderEvent& hold : sources.holds)
+			{
+				if (hold.start >= blockEnd)
+					break;
+
+				if (hold.end > blockStart)
+					mixEvent(hold, sources.soundEffectsGain * hold.buffer->volume, channelCount,
+					         blockStart, blockLength, mix.data());
+			}
+
+			// Clips to the s16 range
+			output.resize(mix.size());
+			ma_pcm_f32_to_s16(output.data(), mix.data(), mix.size(), ma_dither_mode_none);
+		}
+	}
+
+	OfflineRenderer::~OfflineRenderer()
+	{
+		cancel();
+		if (worker.joinable())
+			worker.join();
+	}
+
+	mmw::Result OfflineRenderer::render(const mmw::NoteSoundTimeline& sounds,
+	                                    const OfflineRenderSettings& settings,
+	                                    const std::string& filename)
+	{
+		progress = 0.0f;
+		const ma_uint32 channelCount = settings.channelCount;
+		const ma_uint32 sampleRate = settings.sampleRate;
+		if (channelCount == 0 || sampleRate == 0)
+			return mmw::Result(mmw::ResultStatus::Error, "Invalid output format");
+
+		RenderSources sources{};
+		sources.channelCount = channelCount;
+		sources.musicGain = settings.masterVolume * settings.musicVolume;
+		sources.soundEffectsGain = settings.masterVolume * settings.soundEffectsVolume;
+
+		MusicReader music;
+		if (!settings.musicFilename.empty())
+		{
+			mmw::Result musicResult =
+			    music.open(settings.musicFilename, channelCount, sampleRate,
+			               std::llround(settings.musicOffset * sampleRate));
+			if (!musicResult.isOk())
+				return mmw::Result(mmw::ResultStatus::Error,
+				                   "Failed to decode music: " + musicResult.getMessage());
+		}
+
+		const std::vector<std::unique_ptr<SoundEffectBuffer>> soundEffects =
+		    AudioManager::decodeSoundEffects(settings.soundEffectsProfileIndex, channelCount,
+		                                     sampleRate);
+		auto findBuffer = [&](std::string_view se) -> const SoundEffectBuffer*
+		{
+			const size_t index = AudioManager::findSoundEffect(se);
+			return index < soundEffects.size() ? soundEffects[index].get() : nullptr;
+		};
+
+		auto toFrames = [sampleRate](float time)
+		{ return static_cast<ma_uint64>(std::llround(std::max(0.0f, time) * sampleRate)); };
+
+		// Resolve the buffers once instead of for every block
+		ma_uint64 totalFrames = std::max<ma_int64>(0, music.getEndFrame());
+		for (const auto& event : sounds.getNoteEvents())
+		{
+			const SoundEffectBuffer* buffer = findBuffer(event.se);
+			if (buffer == nullptr)
+				continue;
+
+			const ma_uint64 start = toFrames(event.time);
+			sources.notes.push_back({ start, start + buffer->frameCount, buffer });
+			sources.longestNote = std::max(sources.longestNote, buffer->frameCount);
+			totalFrames = std::max(totalFrames, start + buffer->frameCount);
+		}
+
+		// Like live playback, overlapping holds of an extendable sound effect extend one voice
+		std::vector<size_t> extendedHolds(soundEffects.size(), SIZE_MAX);
+		for (const auto& event : sounds.getHoldEvents())
+		{
+			const size_t index = AudioManager::findSoundEffect(event.se);
+			const SoundEffectBuffer* buffer = findBuffer(event.se);
+			if (buffer == nullptr)
+				continue;
+
+			const RenderEvent hold{ toFrames(event.time), toFrames(event.endTime), buffer };
+			totalFrames = std::max(totalFrames, hold.end);
+			if (AudioManager::isSoundEffectExtendable(index))
+			{
+				size_t& current = extendedHolds[index];
+				if (current != SIZE_MAX && sources.holds[current].end > hold.start)
+				{
+					sources.holds[current].end = std::max(sources.holds[current].end, hold.end);
+					continue;
+				}
+
+				current = sources.holds.size();
+			}
+
+			sources.holds.push_back(hold);
+		}
+
+		if (totalFrames == 0)
+			return mmw::Result(mmw::ResultStatus::Error, "Nothing to render");
+
+		ma_encoder_config encoderConfig =
+		    ma_encoder_config_init(ma_encoding_format_wav, ma_format_s16, channelCount, sampleRate);
+		ma_encoder encoder;
+		ma_result encoderResult =
+		    ma_encoder_init_file_w(IO::mbToWideStr(filename).c_str(), &encoderConfig, &encoder);
+		if (encoderResult != MA_SUCCESS)
+			return mmw::Result(mmw::ResultStatus::Error,
+			                   IO::formatString("Failed to create %s: %s", filename.c_str(),
+			                                    ma_result_description(encoderResult)));
+
+		// Mix a few blocks per thread at a time so memory stays bounded for long tracks
+		const size_t blockCount = (totalFrames + blockFrames - 1) / blockFrames;
+		const size_t batchSize = std::max(std::thread::hardware_concurrency(), 1u) * 2;
+		std::vector<std::vector<float>> mixes(batchSize);
+		std::vector<std::vector<int16_t>> outputs(batchSize);
+		std::vector<size_t> batch(batchSize);
+		std::vector<float> musicBatch;
+
+		for (size_t batchStart = 0; batchStart < blockCount && !cancelled; batchStart += batchSize)
+		{
+			const size_t count = std::min(batchSize, blockCount - batchStart);
+			const ma_uint64 batchFrame = batchStart * blockFrames;
+			const ma_uint64 batchFrames =
+			    std::min<ma_uint64>(count * blockFrames, totalFrames - batchFrame);
+			music.read(batchFrame, batchFrames, musicBatch);
+
+			std::iota(batch.begin(), batch.begin() + count, size_t{ 0 });
+			std::for_each(std::execution::par, batch.begin(), batch.begin() + count,
+			              [&](size_t i)
+			              {
+				              const ma_uint64 blockStart = (batchStart + i) * blockFrames;
+				              const ma_uint64 blockLength =
+				                  std::min(blockFrames, totalFrames - blockStart);
+				              mixBlock(sources, musicBatch.data() + i * blockFrames * channelCount,
+				                       blockStart, blockLength, mixes[i], outputs[i]);
+			              });
+
+			for (size_t i = 0; i < count; ++i)
+				ma_encoder_write_pcm_frames(&encoder, outputs[i].data(),
+				                            outputs[i].size() / channelCount, nullptr);
+
+			progress = static_cast<float>(batchStart + count) / blockCount;
+		}
+
+		ma_encoder_uninit(&encoder);
+		if (cancelled)
+		{
+			std::error_code error;
+			std::filesystem::remove(std::filesystem::path(IO::mbToWideStr(filename)), error);
+			return mmw::Result(mmw::ResultStatus::Warning, "Render cancelled");
+		}
+
+		return mmw::Result::Ok();
+	}
+
+	void OfflineRenderer::renderAsync(mmw::NoteSoundTimeline sounds,
+	                                  OfflineRenderSettings settings, std::string filename)
+	{
+		cancel();
+		if (worker.joinable())
+			worker.join();
+
+		cancelled = false;
+		finished = false;
+		worker = std::thread(
+		    [this, sounds = std::move(sounds), settings = std::move(settings),
+		     filename = std::move(filename)]
+		    {
+			    result = render(sounds, settings, filename);
+			    finished.store(true, std::memory_order_release);
+		    });
+	}
+
+	mmw::Result OfflineRenderer::finish()
+	{
+		if (worker.joinable())
+			worker.join();
+
+		return result;
+	}
+
+	void OfflineRenderer::cancel() { cancelled = true; }
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "Sound.h"
+#include "../NoteSoundTimeline.h"
+#include <atomic>
+#include <string>
+#include <thread>
+
+namespace Audio
+{
+	struct OfflineRenderSettings
+	{
+		std::string musicFilename;
+
+		// Chart time the music starts at in seconds
+		float musicOffset{};
+
+		ma_uint32 sampleRate{ 48000 };
+		ma_uint32 channelCount{ 2 };
+		size_t soundEffectsProfileIndex{};
+		float masterVolume{ 1.0f };
+		float musicVolume{ 1.0f };
+		float soundEffectsVolume{ 1.0f };
+	};
+
+	/**
+	 * @brief Mixes the music and hit sounds of a chart into a wav file without an audio device.
+	 * The output is cut in fixed size blocks mixed in parallel, then written in order.
+	 */
+	class OfflineRenderer
+	{
+	  private:
+		std::thread worker;
+		std::atomic<float> progress{ 0.0f };
+		std::atomic<bool> cancelled{ false };
+		std::atomic<bool> finished{ false };
+		MikuMikuWorld::Result result = MikuMikuWorld::Result::Ok();
+
+	  public:
+		static constexpr ma_uint64 blockFrames{ 1 << 16 };
+
+		OfflineRenderer() = default;
+		OfflineRenderer(const OfflineRenderer&) = delete;
+		OfflineRenderer& operator=(const OfflineRenderer&) = delete;
+		~OfflineRenderer();
+
+		/**
+		 * @brief Render on the calling thread, the blocks are still mixed in parallel
+		 */
+		MikuMikuWorld::Result render(const MikuMikuWorld::NoteSoundTimeline& sounds,
+		                             const OfflineRenderSettings& settings,
+		                             const std::string& filename);
+
+		/**
+		 * @brief Render on a worker thread. Poll isFinished then collect the result with finish.
+		 */
+		void renderAsync(MikuMikuWorld::NoteSoundTimeline sounds, OfflineRenderSettings settings,
+		                 std::string filename);
+		MikuMikuWorld::Result finish();
+		void cancel();
+
+		inline bool isRunning() const { return worker.joinable(); }
+		inline bool isFinished() const { return finished.load(std::memory_order_acquire); }
+		inline float getProgress() const { return progress.load(std::memory_order_relaxed); }
+	};
+}
@@ -117,131 +117,62 @@ namespace Audio
 		return mmw::Result(mmw::ResultStatus::Error, "Unsupported file format");
 	}
 
-	bool isSupportedFileFormat(const std::string_view& fileExtension)
-	{
-		return std::find(supportedFileFormats.begin(), supportedFileFormats.end(), fileExtension) !=
-		       supportedFileFormats.end();
-	}
-
-	ma_uint64 SoundPool::getDurationInFrames() const
-	{
-		ma_uint64 length{};
-		ma_data_source_get_length_in_pcm_frames(pool[0].source.pDataSource, &length);
-
-		return length;
-	}
-
-	float SoundPool::getDurationInSeconds() const
-	{
-		float length{};
-		ma_data_source_get_length_in_seconds(pool[0].source.pDataSource, &length);
-
-		return length;
-	}
-
-	void SoundPool::setLoopTime(ma_uint64 startFrames, ma_uint64 endFrames)
-	{
-		for (auto& instance : pool)
-			ma_data_source_set_loop_point_in_pcm_frames(instance.source.pDataSource, startFrames,
-			                                            endFrames);
-	}
-
-	bool SoundPool::isLooping() const { return flags & SoundFlags::LOOP; }
-
-	void SoundPool::setVolume(float volume)
-	{
-		for (auto& instance : pool)
-			ma_sound_set_volume(&instance.source, volume);
-	}
-
-	float SoundPool::getVolume() const { return ma_sound_get_volume(&pool[0].source); }
-
-	void SoundPool::initialize(const std::string& path, ma_engine* engine, ma_sound_group* group,
-	                           SoundFlags flags)
-	{
-		std::wstring wPath = IO::mbToWideStr(path);
-		for (int i = 0; i < pool.size(); i++)
+	mmw::Result decodeAudioFileF32(const std::string& filename, ma_uint32 channelCount,
+	                               ma_uint32 sampleRate, std::vector<float>& samples,
+	                               ma_uint32* sourceSampleRate)
+	{
+		ma_decoder_config config = ma_decoder_config_init(ma_format_f32, channelCount, sampleRate);
+		ma_decoder decoder;
+		ma_result result =
+		    ma_decoder_init_file_w(IO::mbToWideStr(filename).c_str(), &config, &decoder);
+		if (result != MA_SUCCESS)
+			return mmw::Result(mmw::ResultStatus::Error, ma_result_description(result));
+
+		if (sourceSampleRate)
 		{
-			ma_result result = ma_sound_init_from_file_w(
-			    engine, wPath.c_str(), maSoundFlagsDecodeAsync, group, NULL, &pool[i].source);
-			if (flags & SoundFlags::LOOP)
-				ma_sound_set_looping(&pool[i].source, true);
+			*sourceSampleRate = sampleRate;
+			ma_data_source_get_data_format(decoder.pBackend, nullptr, nullptr, sourceSampleRate,
+			                               nullptr, 0);
 		}
 
-		this->flags = flags;
-		currentIndex = 0;
-	}
-
-	void SoundPool::initialize(const std::string& name, const std::string& path, ma_engine* engine,
-	                           ma_sound_group* group, SoundFlags flags)
-	{
-		this->name = name;
-		initialize(path, engine, group, flags);
-	}
-
-	void SoundPool::initialize(SoundBuffer& sound, ma_engine* engine, ma_sound_group* group,
-	                           SoundFlags flags)
-	{
-		for (int i = 0; i < pool.size(); i++)
+		// The length isn't known upfront for every format so read in chunks until the end
+		samples.clear();
+		constexpr ma_uint64 chunkFrames = 1 << 14;
+		while (true)
 		{
-			ma_result result = ma_sound_init_from_data_source(
-			    engine, &sound.buffer, maSoundFlagsDefault, group, &pool[i].source);
-			if (flags & SoundFlags::LOOP)
-				ma_sound_set_looping(&pool[i].source, true);
+			const size_t offset = samples.size();
+			samples.resize(offset + chunkFrames * channelCount);
+
+			ma_uint64 framesRead{};
+			ma_decoder_read_pcm_frames(&decoder, samples.data() + offset, chunkFrames,
+			                           &framesRead);
+			samples.resize(offset + framesRead * channelCount);
+			if (framesRead < chunkFrames)
+				break;
 		}
 
-		this->flags = flags;
-		currentIndex = 0;
+		ma_decoder_uninit(&decoder);
+		samples.shrink_to_fit();
+		return mmw::Result::Ok();
 	}
 
-	void SoundPool::dispose()
+	float getAudioFileLength(const std::string& filename)
 	{
-		for (auto& instance : pool)
-			ma_sound_uninit(&instance.source);
-	}
+		ma_decoder decoder;
+		if (ma_decoder_init_file_w(IO::mbToWideStr(filename).c_str(), nullptr, &decoder) !=
+		    MA_SUCCESS)
+			return 0.0f;
 
-	void SoundPool::extendInstanceDuration(SoundInstance& instance, float newEndTime)
-	{
-		ma_sound_set_stop_time_in_milliseconds(&instance.source, newEndTime * 1000);
-		instance.lastEndTime = newEndTime;
+		ma_uint64 frameCount{};
+		ma_decoder_get_length_in_pcm_frames(&decoder, &frameCount);
+		const ma_uint32 sampleRate = decoder.outputSampleRate;
+		ma_decoder_uninit(&decoder);
+		return sampleRate ? static_cast<float>(frameCount) / sampleRate : 0.0f;
 	}
 
-	void SoundPool::play(float start, float end)
-	{
-		SoundInstance& instance = pool[currentIndex];
-
-		instance.seek(0);
-		ma_sound_set_start_time_in_milliseconds(&instance.source, start * 1000);
-
-		if (end > -1)
-			ma_sound_set_stop_time_in_milliseconds(&instance.source, end * 1000);
-
-		instance.play();
-		instance.lastStartTime = start;
-		instance.lastEndTime = end;
-
-		if ((flags & SoundFlags::EXTENDABLE) == 0)
-			currentIndex = ++currentIndex % pool.size();
-	}
-
-	void SoundPool::stopAll()
-	{
-		for (auto& instance : pool)
-		{
-			instance.stop();
-			instance.lastStartTime = 0;
-			instance.lastEndTime = 0;
-		}
-	}
-
-	bool SoundPool::isPlaying(const SoundInstance& soundInstance) const
-	{
-		return soundInstance.isPlaying();
-	}
-
-	bool SoundPool::isAnyPlaying() const
+	bool isSupportedFileFormat(const std::string_view& fileExtension)
 	{
-		return std::any_of(pool.begin(), pool.end(),
-		                   [this](const SoundInstance& a) { return isPlaying(a); });
+		return std::find(supportedFileFormats.begin(), supportedFileFormats.end(), fileExtension) !=
+		       supportedFileFormats.end();
 	}
 }
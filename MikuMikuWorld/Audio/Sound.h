@@ -2,8 +2,8 @@
 #include <array>
 #include <string>
 #include <memory>
-#include <unordered_map>
 #include <string_view>
+#include <vector>
 
 // Already defined somewhere else but Visual Studio gets confused
 #define NOMINMAX
@@ -59,20 +59,27 @@ namespace Audio
 		                                                               ".ogg" };
 
 	MikuMikuWorld::Result decodeAudioFile(std::string filename, SoundBuffer& sound);
+
+	/**
+	 * @brief Decode a whole file to interleaved float samples converted to a channel count and
+	 * sample rate
+	 * @param sourceSampleRate Receives the file's own sample rate when not null
+	 */
+	MikuMikuWorld::Result decodeAudioFileF32(const std::string& filename, ma_uint32 channelCount,
+	                                         ma_uint32 sampleRate, std::vector<float>& samples,
+	                                         ma_uint32* sourceSampleRate = nullptr);
+
+	/**
+	 * @brief Length of an audio file in seconds without decoding it, 0 if it can't be opened or
+	 * its format doesn't store the length
+	 */
+	float getAudioFileLength(const std::string& filename);
 	bool isSupportedFileFormat(const std::string_view& fileExtension);
 
 	struct SoundInstance
 	{
 		std::string name;
 		ma_sound source;
-		float lastStartTime{};
-		float lastEndTime{};
-
-		// The absolute start time in seconds
-		float absoluteStart{};
-
-		// The absolute end time in seconds
-		float absoluteEnd{};
 
 		inline void play() { ma_sound_start(&source); }
 		inline void stop() { ma_sound_stop(&source); }
@@ -106,66 +113,5 @@ namespace Audio
 			ma_sound_get_length_in_seconds(&source, &time);
 			return time;
 		}
-
-		void extendDuration(float currentTime, float newAbsoluteEnd, float timeScale)
-		{
-			const float engineTime =
-			    static_cast<float>(ma_engine_get_time_in_milliseconds(source.engineNode.pEngine)) /
-			    1000.0f;
-			const float duration = newAbsoluteEnd - absoluteStart;
-			const float instanceTime = currentTime - absoluteStart;
-			const float newEndTime = ((duration - instanceTime) / timeScale) + engineTime;
-
-			absoluteEnd = newAbsoluteEnd;
-			lastEndTime = newEndTime;
-			ma_sound_set_stop_time_in_milliseconds(&source, newEndTime * 1000);
-		}
-	};
-
-	class SoundPool
-	{
-	  public:
-		static constexpr int poolSize{ 24 };
-		std::array<SoundInstance, poolSize> pool;
-		SoundFlags flags{};
-
-		ma_uint64 getDurationInFrames() const;
-		float getDurationInSeconds() const;
-
-		void setLoopTime(ma_uint64 startFrames, ma_uint64 endFrames);
-		bool isLooping() const;
-
-		void setVolume(float volume);
-		float getVolume() const;
-
-		void extendInstanceDuration(SoundInstance& instance, float newEndTime);
-		void play(float start, float end);
-		void stopAll();
-
-		bool isPlaying(const SoundInstance& soundInstance) const;
-		bool isAnyPlaying() const;
-
-		void initialize(const std::string& name, const std::string& path, ma_engine* engine,
-		                ma_sound_group* group, SoundFlags flags);
-		void initialize(const std::string& path, ma_engine* engine, ma_sound_group* group,
-		                SoundFlags flags);
-		void initialize(SoundBuffer& sound, ma_engine* engine, ma_sound_group* group,
-		                SoundFlags flags);
-		void dispose();
-
-		std::string getName() const { return name; }
-		int getCurrentIndex() const { return currentIndex; }
-
-	  private:
-		float volume{ 1.0f };
-		int currentIndex{ 0 };
-
-		std::string name{};
-	};
-
-	struct SoundEffectProfile
-	{
-		std::string name;
-		std::unordered_map<std::string_view, std::unique_ptr<SoundPool>> pool;
 	};
 }
\ No newline at end of file
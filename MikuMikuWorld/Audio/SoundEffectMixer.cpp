@@ -0,0 +1,372 @@
+#include "SoundEffectMixer.h"
+#include <algorithm>
+#include <cmath>
+
+namespace Audio
+{
+	ma_result SoundEffectMixer::initialize(ma_engine* engine, ma_node* output)
+	{
+		static ma_node_vtable vtable = { onProcess, nullptr, 0, 1, 0 };
+
+		this->engine = engine;
+		channelCount = ma_engine_get_channels(engine);
+		sampleRate = ma_engine_get_sample_rate(engine);
+		node.mixer = this;
+
+		ma_node_config config = ma_node_config_init();
+		config.vtable = &vtable;
+		config.pOutputChannels = &channelCount;
+
+		ma_result result = ma_node_init(ma_engine_get_node_graph(engine), &config, nullptr, &node);
+		if (result != MA_SUCCESS)
+			return result;
+
+		result = ma_node_attach_output_bus(&node, 0, output, 0);
+		if (result != MA_SUCCESS)
+		{
+			ma_node_uninit(&node, nullptr);
+			return result;
+		}
+
+		initialized = true;
+		return MA_SUCCESS;
+	}
+
+	void SoundEffectMixer::dispose()
+	{
+		if (!initialized)
+			return;
+
+		// Detaching waits for the audio thread so the buffers are safe to free afterwards
+		ma_node_uninit(&node, nullptr);
+		initialized = false;
+
+		Event event;
+		while (events.pop(event))
+			;
+
+		voiceCount = 0;
+		lastEngineTime = UINT64_MAX;
+		std::lock_guard<std::mutex> lock(buffersMutex);
+		buffers.clear();
+	}
+
+	std::unique_ptr<SoundEffectBuffer>
+	SoundEffectMixer::decodeBuffer(const std::string& filename, const std::string& name,
+	                               float volume, bool loop, ma_uint64 loopMargin,
+	                               ma_uint32 channelCount, ma_uint32 sampleRate)
+	{
+		// Converting once here leaves nothing but a multiply-add per sample for the audio thread
+		auto buffer = std::make_unique<SoundEffectBuffer>();
+		ma_uint32 sourceSampleRate = sampleRate;
+		if (!decodeAudioFileF32(filename, channelCount, sampleRate, buffer->samples,
+		                        &sourceSampleRate)
+		         .isOk())
+			return nullptr;
+
+		buffer->frameCount = buffer->samples.size() / channelCount;
+		if (buffer->frameCount == 0)
+			return nullptr;
+
+		buffer->name = name;
+		buffer->volume = volume;
+
+		// The margin is given at the file's rate, scale it to the converted buffer
+		const ma_uint64 margin = loopMargin * sampleRate / std::max(sourceSampleRate, 1u);
+		buffer->loop = loop && buffer->frameCount > margin * 2;
+		buffer->loopStart = buffer->loop ? margin : 0;
+		buffer->loopEnd = buffer->loop ? buffer->frameCount - margin : buffer->frameCount;
+		return buffer;
+	}
+
+	std::unique_ptr<SoundEffectBuffer>
+	SoundEffectMixer::generateClick(const std::string& name, float frequency, float duration,
+	                                float volume, ma_uint32 channelCount, ma_uint32 sampleRate)
+	{
+		auto buffer = std::make_unique<SoundEffectBuffer>();
+		buffer->name = name;
+		buffer->volume = volume;
+		buffer->frameCount = std::max<ma_uint64>(1, static_cast<ma_uint64>(duration * sampleRate));
+		buffer->loopEnd = buffer->frameCount;
+		buffer->samples.resize(buffer->frameCount * channelCount);
+
+		// A sine with a short attack and an exponential decay down to silence at the end
+		const double attackFrames = 0.001 * sampleRate;
+		const double decayRate = 6.0 / buffer->frameCount;
+		const double phaseStep = 2.0 * 3.14159265358979323846 * frequency / sampleRate;
+		for (ma_uint64 frame = 0; frame < buffer->frameCount; ++frame)
+		{
+			const double attack = std::min(1.0, frame / attackFrames);
+			const double envelope = attack * std::exp(-decayRate * frame) *
+			                        (1.0 - static_cast<double>(frame) / buffer->frameCount);
+			const float sample = static_cast<float>(std::sin(phaseStep * frame) * envelope);
+			std::fill_n(buffer->samples.begin() + frame * channelCount, channelCount, sample);
+		}
+
+		return buffer;
+	}
+
+	SoundEffectBuffer* SoundEffectMixer::loadBuffer(const std::string& filename,
+	                                                const std::string& name, float volume,
+	                                                bool loop, ma_uint64 loopMargin)
+	{
+		if (!initialized)
+			return nullptr;
+
+		return addBuffer(
+		    decodeBuffer(filename, name, volume, loop, loopMargin, channelCount, sampleRate));
+	}
+
+	SoundEffectBuffer* SoundEffectMixer::addBuffer(std::unique_ptr<SoundEffectBuffer> buffer)
+	{
+		if (!initialized || !buffer)
+			return nullptr;
+
+		std::lock_guard<std::mutex> lock(buffersMutex);
+		buffers.push_back(std::move(buffer));
+		return buffers.back().get();
+	}
+
+	SoundEffectMixer::VoiceId SoundEffectMixer::play(SoundEffectBuffer* buffer,
+	                                                 ma_uint64 startFrame, ma_uint64 endFrame)
+	{
+		if (!initialized || buffer == nullptr)
+			return 0;
+
+		const VoiceId voice = nextVoiceId++;
+		if (nextVoiceId == 0)
+			nextVoiceId = 1;
+
+		pushEvent({ EventType::Play, voice, buffer, startFrame, endFrame });
+		return voice;
+	}
+
+	void SoundEffectMixer::setEndFrame(VoiceId voice, ma_uint64 endFrame)
+	{
+		if (voice != 0)
+			pushEvent({ EventType::SetEnd, voice, nullptr, 0, endFrame });
+	}
+
+	void SoundEffectMixer::stop(VoiceId voice)
+	{
+		if (voice != 0)
+			pushEvent({ EventType::Stop, voice });
+	}
+
+	void SoundEffectMixer::stopBuffer(SoundEffectBuffer* buffer)
+	{
+		if (buffer != nullptr)
+			pushEvent({ EventType::StopBuffer, 0, buffer });
+	}
+
+	void SoundEffectMixer::stopScheduled() { pushEvent({ EventType::StopScheduled }); }
+
+	void SoundEffectMixer::stopAll() { pushEvent({ EventType::StopAll }); }
+
+	void SoundEffectMixer::pushEvent(const Event& event)
+	{
+		if (initialized && !events.push(event))
+			droppedEvents.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	ma_uint64 SoundEffectMixer::secondsToFrames(float seconds) const
+	{
+		if (seconds <= 0.0f)
+			return 0;
+
+		return static_cast<ma_uint64>(static_cast<double>(seconds) * sampleRate + 0.5);
+	}
+
+	SoundEffectMixer::Stats SoundEffectMixer::getStats() const
+	{
+		Stats stats{};
+		stats.activeVoices = activeVoices.load(std::memory_order_relaxed);
+		stats.peakVoices = peakVoices.load(std::memory_order_relaxed);
+		stats.stolenVoices = stolenVoices.load(std::memory_order_relaxed);
+		stats.lateVoices = lateVoices.load(std::memory_order_relaxed);
+		stats.droppedEvents = droppedEvents.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	void SoundEffectMixer::onProcess(ma_node* node, const float** framesIn,
+	                                 ma_uint32* frameCountIn, float** framesOut,
+	                                 ma_uint32* frameCountOut)
+	{
+		static_cast<Node*>(node)->mixer->process(framesOut[0], *frameCountOut);
+	}
+
+	void SoundEffectMixer::process(float* output, ma_uint32 frameCount)
+	{
+		// The engine time only advances once per graph read while the group above us may pull
+		// several blocks within it, so follow the time ourselves between reads
+		const ma_uint64 engineTime = ma_engine_get_time_in_pcm_frames(engine);
+		if (engineTime != lastEngineTime)
+		{
+			clock = engineTime;
+			lastEngineTime = engineTime;
+		}
+
+		const ma_uint64 blockStart = clock;
+		clock += frameCount;
+
+		for (size_t i = 0; i < voiceCount; ++i)
+			voices[i].buffer->playingVoices.store(0, std::memory_order_relaxed);
+
+		Event event;
+		while (events.pop(event))
+			applyEvent(event, blockStart);
+
+		std::fill(output, output + static_cast<size_t>(frameCount) * channelCount, 0.0f);
+		for (size_t i = 0; i < voiceCount;)
+		{
+			if (mixVoice(voices[i], output, frameCount, blockStart))
+				++i;
+			else
+				removeVoice(i);
+		}
+
+		for (size_t i = 0; i < voiceCount; ++i)
+			voices[i].buffer->playingVoices.fetch_add(1, std::memory_order_relaxed);
+
+		const uint32_t count = static_cast<uint32_t>(voiceCount);
+		activeVoices.store(count, std::memory_order_relaxed);
+		if (count > peakVoices.load(std::memory_order_relaxed))
+			peakVoices.store(count, std::memory_order_relaxed);
+	}
+
+	void SoundEffectMixer::applyEvent(const Event& event, ma_uint64 blockStart)
+	{
+		switch (event.type)
+		{
+		case EventType::Play:
+			startVoice(event, blockStart);
+			break;
+
+		case EventType::SetEnd:
+			for (size_t i = 0; i < voiceCount; ++i)
+				if (voices[i].id == event.voice)
+					voices[i].endFrame = event.endFrame;
+			break;
+
+		case EventType::Stop:
+			for (size_t i = 0; i < voiceCount; ++i)
+			{
+				if (voices[i].id == event.voice)
+				{
+					removeVoice(i);
+					break;
+				}
+			}
+			break;
+
+		case EventType::StopBuffer:
+			for (size_t i = 0; i < voiceCount;)
+			{
+				if (voices[i].buffer == event.buffer)
+					removeVoice(i);
+				else
+					++i;
+			}
+			break;
+
+		case EventType::StopScheduled:
+			for (size_t i = 0; i < voiceCount;)
+			{
+				if (voices[i].cursor == 0 && voices[i].startFrame >= blockStart)
+					removeVoice(i);
+				else
+					++i;
+			}
+			break;
+
+		case EventType::StopAll:
+			voiceCount = 0;
+			break;
+		}
+	}
+
+	void SoundEffectMixer::startVoice(const Event& event, ma_uint64 blockStart)
+	{
+		if (voiceCount == voiceBudget)
+		{
+			// Steal the oldest one-shot voice, hold loops are only taken once nothing else is left
+			size_t oldest = 0;
+			for (size_t i = 1; i < voiceCount; ++i)
+			{
+				const Voice& voice = voices[i];
+				const Voice& current = voices[oldest];
+				const bool isOlder = voice.buffer->loop != current.buffer->loop
+				                         ? !voice.buffer->loop
+				                         : voice.startFrame < current.startFrame;
+				if (isOlder)
+					oldest = i;
+			}
+
+			removeVoice(oldest);
+			stolenVoices.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// A start of 0 asks for immediate playback, anything else in the past missed its frame
+		if (event.startFrame != 0 && event.startFrame < blockStart)
+			lateVoices.fetch_add(1, std::memory_order_relaxed);
+
+		Voice& voice = voices[voiceCount++];
+		voice.buffer = event.buffer;
+		voice.id = event.voice;
+		voice.startFrame = std::max(event.startFrame, blockStart);
+		voice.endFrame = event.endFrame;
+		voice.cursor = 0;
+	}
+
+	void SoundEffectMixer::removeVoice(size_t index) { voices[index] = voices[--voiceCount]; }
+
+	bool SoundEffectMixer::mixVoice(Voice& voice, float* output, ma_uint32 frameCount,
+	                                ma_uint64 blockStart)
+	{
+		const ma_uint64 blockEnd = blockStart + frameCount;
+		if (voice.endFrame <= blockStart)
+			return false;
+
+		if (voice.startFrame >= blockEnd)
+			return true;
+
+		const SoundEffectBuffer& buffer = *voice.buffer;
+		const ma_uint64 sourceEnd = buffer.loop ? buffer.loopEnd : buffer.frameCount;
+		const float gain = buffer.volume;
+
+		ma_uint32 frame = voice.startFrame > blockStart
+		                      ? static_cast<ma_uint32>(voice.startFrame - blockStart)
+		                      : 0;
+		const ma_uint32 lastFrame =
+		    voice.endFrame < blockEnd ? static_cast<ma_uint32>(voice.endFrame - blockStart)
+		                              : frameCount;
+
+		while (frame < lastFrame)
+		{
+			if (voice.cursor >= sourceEnd)
+			{
+				if (!buffer.loop)
+					return false;
+
+				voice.cursor = buffer.loopStart;
+			}
+
+			// Mix contiguous runs so the inner loop stays a plain vectorizable multiply-add
+			const ma_uint32 run = static_cast<ma_uint32>(
+			    std::min<ma_uint64>(lastFrame - frame, sourceEnd - voice.cursor));
+			const float* source = buffer.samples.data() + voice.cursor * channelCount;
+			float* destination = output + static_cast<size_t>(frame) * channelCount;
+			const size_t sampleCount = static_cast<size_t>(run) * channelCount;
+			for (size_t i = 0; i < sampleCount; ++i)
+				destination[i] += source[i] * gain;
+
+			frame += run;
+			voice.cursor += run;
+		}
+
+		if (!buffer.loop && voice.cursor >= buffer.frameCount)
+			return false;
+
+		return voice.endFrame > blockEnd;
+	}
+}
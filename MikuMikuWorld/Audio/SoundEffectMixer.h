@@ -0,0 +1,183 @@
+#pragma once
+#include "Sound.h"
+#include "SpscQueue.h"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Audio
+{
+	/**
+	 * @brief Sound effect decoded ahead of time to the engine's sample rate and channel count.
+	 * Immutable once loaded so the audio thread can read it without synchronization.
+	 */
+	struct SoundEffectBuffer
+	{
+		std::string name;
+		std::vector<float> samples;
+		ma_uint64 frameCount{};
+		ma_uint64 loopStart{};
+		ma_uint64 loopEnd{};
+		float volume{ 1.0f };
+		bool loop{ false };
+
+		// Voices mixing this buffer as of the last processed block
+		std::atomic<uint32_t> playingVoices{ 0 };
+	};
+
+	/**
+	 * @brief Miniaudio node mixing sound effect buffers with frame accurate start and end times.
+	 * Voices are requested through a lock-free queue and owned by the audio thread, which mixes up
+	 * to voiceBudget of them and steals the oldest one-shot voice past that.
+	 */
+	class SoundEffectMixer
+	{
+	  public:
+		using VoiceId = uint32_t;
+
+		static constexpr size_t voiceBudget{ 256 };
+		static constexpr ma_uint64 noEndFrame{ UINT64_MAX };
+
+		struct Stats
+		{
+			uint32_t activeVoices{};
+			uint32_t peakVoices{};
+			uint64_t stolenVoices{};
+			uint64_t lateVoices{};
+			uint64_t droppedEvents{};
+		};
+
+	  private:
+		enum class EventType : uint8_t
+		{
+			Play,
+			SetEnd,
+			Stop,
+			StopBuffer,
+			StopScheduled,
+			StopAll
+		};
+
+		struct Event
+		{
+			EventType type{};
+			VoiceId voice{};
+			SoundEffectBuffer* buffer{};
+			ma_uint64 startFrame{};
+			ma_uint64 endFrame{};
+		};
+
+		struct Voice
+		{
+			SoundEffectBuffer* buffer{};
+			VoiceId id{};
+			ma_uint64 startFrame{};
+			ma_uint64 endFrame{};
+			ma_uint64 cursor{};
+		};
+
+		// Miniaudio expects the node base first, the callback finds the mixer through it
+		struct Node
+		{
+			ma_node_base base;
+			SoundEffectMixer* mixer;
+		};
+
+		Node node{};
+		ma_engine* engine{};
+		bool initialized{ false };
+		ma_uint32 channelCount{};
+		ma_uint32 sampleRate{};
+
+		// Loading may run in parallel, the audio thread only sees buffers through its events
+		std::mutex buffersMutex;
+		std::vector<std::unique_ptr<SoundEffectBuffer>> buffers;
+		SpscQueue<Event, 4096> events;
+		VoiceId nextVoiceId{ 1 };
+
+		// Only touched by the audio thread, the active voices are kept at the front
+		std::array<Voice, voiceBudget> voices{};
+		size_t voiceCount{};
+		ma_uint64 clock{};
+		ma_uint64 lastEngineTime{ UINT64_MAX };
+
+		std::atomic<uint32_t> activeVoices{ 0 };
+		std::atomic<uint32_t> peakVoices{ 0 };
+		std::atomic<uint64_t> stolenVoices{ 0 };
+		std::atomic<uint64_t> lateVoices{ 0 };
+		std::atomic<uint64_t> droppedEvents{ 0 };
+
+		static void onProcess(ma_node* node, const float** framesIn, ma_uint32* frameCountIn,
+		                      float** framesOut, ma_uint32* frameCountOut);
+
+		void process(float* output, ma_uint32 frameCount);
+		void applyEvent(const Event& event, ma_uint64 blockStart);
+		void startVoice(const Event& event, ma_uint64 blockStart);
+		void removeVoice(size_t index);
+		bool mixVoice(Voice& voice, float* output, ma_uint32 frameCount, ma_uint64 blockStart);
+		void pushEvent(const Event& event);
+
+	  public:
+		SoundEffectMixer() = default;
+		SoundEffectMixer(const SoundEffectMixer&) = delete;
+		SoundEffectMixer& operator=(const SoundEffectMixer&) = delete;
+
+		/**
+		 * @brief Create the node and attach it to the input of another node (ex. a sound group)
+		 */
+		ma_result initialize(ma_engine* engine, ma_node* output);
+		void dispose();
+
+		/**
+		 * @brief Decode a sound effect file to a channel count and sample rate
+		 * @param loopMargin Frames at the file's sample rate skipped at both ends when looping
+		 * @return nullptr if the file could not be decoded
+		 */
+		static std::unique_ptr<SoundEffectBuffer>
+		decodeBuffer(const std::string& filename, const std::string& name, float volume, bool loop,
+		             ma_uint64 loopMargin, ma_uint32 channelCount, ma_uint32 sampleRate);
+
+		/**
+		 * @brief Synthesize a short decaying sine click (ex. for the metronome)
+		 */
+		static std::unique_ptr<SoundEffectBuffer>
+		generateClick(const std::string& name, float frequency, float duration, float volume,
+		              ma_uint32 channelCount, ma_uint32 sampleRate);
+
+		/**
+		 * @brief Decode a sound effect file into a buffer owned by the mixer
+		 * @param loopMargin Frames at the file's sample rate skipped at both ends when looping
+		 * @return nullptr if the file could not be decoded
+		 */
+		SoundEffectBuffer* loadBuffer(const std::string& filename, const std::string& name,
+		                              float volume, bool loop, ma_uint64 loopMargin);
+
+		/**
+		 * @brief Take ownership of a buffer made elsewhere (ex. a generated click)
+		 * @return nullptr if the buffer is null or the mixer is not initialized
+		 */
+		SoundEffectBuffer* addBuffer(std::unique_ptr<SoundEffectBuffer> buffer);
+
+		/**
+		 * @brief Schedule a voice on the engine's timeline, frames already passed start immediately
+		 */
+		VoiceId play(SoundEffectBuffer* buffer, ma_uint64 startFrame,
+		             ma_uint64 endFrame = noEndFrame);
+		void setEndFrame(VoiceId voice, ma_uint64 endFrame);
+		void stop(VoiceId voice);
+		void stopBuffer(SoundEffectBuffer* buffer);
+
+		/**
+		 * @brief Stop the voices that did not start yet
+		 */
+		void stopScheduled();
+		void stopAll();
+
+		ma_uint64 secondsToFrames(float seconds) const;
+		inline bool isInitialized() const { return initialized; }
+		Stats getStats() const;
+	};
+}
@@ -0,0 +1,297 @@
+#include "Spectrogram.h"
+#include "AudioCache.h"
+#include "FFT.h"
+#include <algorithm>
+#include <cmath>
+#include <execution>
+#include <numeric>
+
+namespace Audio
+{
+	namespace
+	{
+		struct BandBins
+		{
+			size_t first{};
+			size_t last{};
+		};
+
+		// Log spaced bands, the lowest ones may share a bin
+		std::vector<BandBins> makeBands()
+		{
+			using Chain = SpectrogramMipChain;
+			const double binFrequency = static_cast<double>(Chain::sampleRate) / Chain::fftSize;
+			const double ratio = static_cast<double>(Chain::maxFrequency) / Chain::minFrequency;
+			const size_t binCount = Chain::fftSize / 2 + 1;
+
+			std::vector<BandBins> bands(Chain::bandCount);
+			for (size_t band = 0; band < Chain::bandCount; ++band)
+			{
+				auto edge = [&](size_t index)
+				{
+					const double frequency = Chain::minFrequency *
+					                         std::pow(ratio, static_cast<double>(index) /
+					                                             Chain::bandCount);
+					return std::min(static_cast<size_t>(frequency / binFrequency), binCount - 1);
+				};
+
+				bands[band].first = edge(band);
+				bands[band].last = std::max(edge(band + 1), bands[band].first + 1);
+			}
+
+			return bands;
+		}
+	}
+
+	size_t SpectrogramMipChain::getReadyColumnCount(size_t level) const
+	{
+		if (level >= usedMipCount)
+			return 0;
+
+		if (isComplete())
+			return mips[level].columnCount;
+
+		return std::min(readyColumns.load(std::memory_order_acquire) >> level,
+		                mips[level].columnCount);
+	}
+
+	const SpectrogramMip& SpectrogramMipChain::findClosestMip(double secondsPerPixel) const
+	{
+		const SpectrogramMip* closestMip = &mips[0];
+		for (size_t i = 1; i < usedMipCount; i++)
+		{
+			if (std::abs(mips[i].secondsPerColumn - secondsPerPixel) <
+			    std::abs(closestMip->secondsPerColumn - secondsPerPixel))
+				closestMip = &mips[i];
+		}
+
+		return *closestMip;
+	}
+
+	void SpectrogramMipChain::levelsInTimeRange(const SpectrogramMip& mip, double startTime,
+	                                            double endTime, uint8_t* output) const
+	{
+		std::fill_n(output, bandCount, uint8_t{ 0 });
+		if (isEmpty() || mip.secondsPerColumn <= 0)
+			return;
+
+		const size_t level = &mip - mips;
+		const double first = std::floor(startTime / mip.secondsPerColumn);
+		const double last = std::ceil(endTime / mip.secondsPerColumn);
+		const size_t readyCount = getReadyColumnCount(level);
+		if (last <= 0 || first >= static_cast<double>(readyCount))
+			return;
+
+		const size_t begin = static_cast<size_t>(std::max(first, 0.0));
+		const size_t end = std::max(std::min(static_cast<size_t>(last), readyCount), begin + 1);
+		for (size_t column = begin; column < end; ++column)
+		{
+			const uint8_t* levels = mip.getColumn(column);
+			for (size_t band = 0; band < bandCount; ++band)
+				output[band] = std::max(output[band], levels[band]);
+		}
+	}
+
+	void SpectrogramMipChain::generateFromFile(const std::wstring& filename, uint64_t hash)
+	{
+		clear();
+		this->filename = filename;
+		if (filename.empty())
+			return;
+
+		running = true;
+		worker = std::thread(&SpectrogramMipChain::generate, this, hash);
+	}
+
+	void SpectrogramMipChain::cancelGeneration()
+	{
+		cancelRequested = true;
+		if (worker.joinable())
+			worker.join();
+
+		cancelRequested = false;
+	}
+
+	void SpectrogramMipChain::clear()
+	{
+		cancelGeneration();
+		readyColumns = 0;
+		complete = false;
+		failed = false;
+		filename.clear();
+		for (auto& mip : mips)
+			mip.clear();
+
+		usedMipCount = 0;
+		version++;
+	}
+
+	void SpectrogramMipChain::generate(uint64_t hash)
+	{
+		std::vector<uint8_t> cachedLevels;
+		if (AudioCache::loadSpectrogram(hash, layoutVersion, bandCount, cachedLevels))
+		{
+			allocateMips(cachedLevels.size() / bandCount);
+			std::copy(cachedLevels.begin(), cachedLevels.end(), mips[0].levels.begin());
+			reduceLevels(0, mips[0].columnCount);
+		}
+		else if (!analyze())
+		{
+			failed.store(!cancelRequested, std::memory_order_release);
+			running.store(false, std::memory_order_release);
+			return;
+		}
+		else
+		{
+			AudioCache::saveSpectrogram(hash, layoutVersion, bandCount, mips[0].levels);
+		}
+
+		complete.store(true, std::memory_order_release);
+		publish(mips[0].columnCount);
+		running.store(false, std::memory_order_release);
+	}
+
+	bool SpectrogramMipChain::analyze()
+	{
+		// Hi-hats barely reach past 16kHz, a mono 32kHz decode keeps them at a fraction of the work
+		ma_decoder_config decoderConfig = ma_decoder_config_init(ma_format_f32, 1, sampleRate);
+		ma_decoder decoder;
+		if (ma_decoder_init_file_w(filename.c_str(), &decoderConfig, &decoder) != MA_SUCCESS)
+			return false;
+
+		ma_uint64 frameCount = 0;
+		ma_decoder_get_length_in_pcm_frames(&decoder, &frameCount);
+		if (frameCount == 0)
+		{
+			ma_decoder_uninit(&decoder);
+			return false;
+		}
+
+		const size_t columnCount = (frameCount + hopSize - 1) / hopSize;
+		allocateMips(columnCount);
+
+		const FFT fft(fftSize);
+		const std::vector<float> window = FFT::hannWindow(fftSize);
+		const std::vector<BandBins> bands = makeBands();
+
+		// A Hann windowed full scale sine peaks at a quarter of the window's length
+		const float fullScale = fftSize / 4.0f;
+		const float decibelsToLevel = 255.0f / dynamicRange;
+
+		// Column c is centered on sample c * hopSize, so the first windows start before the music
+		constexpr size_t halfWindow = fftSize / 2;
+		std::vector<float> samples(halfWindow, 0.0f);
+		bool endOfStream = false;
+
+		for (size_t blockStart = 0; blockStart < columnCount && !cancelRequested;
+		     blockStart += blockColumns)
+		{
+			const size_t blockEnd = std::min(blockStart + blockColumns, columnCount);
+			const size_t required = (blockEnd - blockStart - 1) * hopSize + fftSize;
+			while (samples.size() < required && !endOfStream)
+			{
+				const size_t offset = samples.size();
+				samples.resize(required);
+
+				ma_uint64 framesRead = 0;
+				ma_decoder_read_pcm_frames(&decoder, samples.data() + offset, required - offset,
+				                           &framesRead);
+				samples.resize(offset + framesRead);
+				endOfStream = framesRead == 0;
+			}
+
+			// Past the end of the music is silence
+			samples.resize(std::max(samples.size(), required), 0.0f);
+
+			std::vector<size_t> tasks((blockEnd - blockStart + taskColumns - 1) / taskColumns);
+			std::iota(tasks.begin(), tasks.end(), 0);
+			std::for_each(
+			    std::execution::par, tasks.begin(), tasks.end(),
+			    [&](size_t task)
+			    {
+				    std::vector<std::complex<float>> scratch;
+				    std::vector<float> magnitudes(fftSize / 2 + 1);
+				    const size_t first = blockStart + task * taskColumns;
+				    const size_t last = std::min(first + taskColumns, blockEnd);
+				    for (size_t column = first; column < last && !cancelRequested; ++column)
+				    {
+					    fft.magnitudes(samples.data() + (column - blockStart) * hopSize,
+					                   window.data(), scratch, magnitudes.data());
+
+					    uint8_t* levels = mips[0].levels.data() + column * bandCount;
+					    for (size_t band = 0; band < bandCount; ++band)
+					    {
+						    const float magnitude =
+						        *std::max_element(magnitudes.begin() + bands[band].first,
+						                          magnitudes.begin() + bands[band].last);
+						    const float decibels =
+						        20.0f * std::log10(std::max(magnitude / fullScale, 1e-6f));
+						    levels[band] = static_cast<uint8_t>(std::clamp(
+						        (decibels + dynamicRange) * decibelsToLevel, 0.0f, 255.0f));
+					    }
+				    }
+			    });
+
+			samples.erase(samples.begin(),
+			              samples.begin() + std::min((blockEnd - blockStart) * hopSize,
+			                                         samples.size()));
+			if (cancelRequested)
+				break;
+
+			reduceLevels(blockStart, blockEnd);
+			publish(blockEnd);
+		}
+
+		ma_decoder_uninit(&decoder);
+		return !cancelRequested;
+	}
+
+	void SpectrogramMipChain::allocateMips(size_t columnCount)
+	{
+		usedMipCount = 0;
+		double secondsPerColumn = static_cast<double>(hopSize) / sampleRate;
+		for (size_t level = 0; level < maxMipLevels && columnCount > 0; ++level)
+		{
+			SpectrogramMip& mip = mips[level];
+			mip.secondsPerColumn = secondsPerColumn;
+			mip.columnCount = columnCount;
+			mip.levels.assign(columnCount * bandCount, 0);
+			usedMipCount++;
+
+			if (columnCount == 1)
+				break;
+
+			columnCount = (columnCount + 1) / 2;
+			secondsPerColumn *= 2;
+		}
+	}
+
+	void SpectrogramMipChain::reduceLevels(size_t begin, size_t end)
+	{
+		// Blocks are a multiple of the coarsest mip's span so each pair is reduced once complete
+		for (size_t level = 1; level < usedMipCount; ++level)
+		{
+			const SpectrogramMip& source = mips[level - 1];
+			SpectrogramMip& mip = mips[level];
+			const bool reachedEnd = end == source.columnCount;
+			begin /= 2;
+			end = reachedEnd ? mip.columnCount : end / 2;
+
+			for (size_t column = begin; column < end; ++column)
+			{
+				const uint8_t* a = source.getColumn(column * 2);
+				const uint8_t* b =
+				    column * 2 + 1 < source.columnCount ? source.getColumn(column * 2 + 1) : a;
+				uint8_t* levels = mip.levels.data() + column * bandCount;
+				for (size_t band = 0; band < bandCount; ++band)
+					levels[band] = std::max(a[band], b[band]);
+			}
+		}
+	}
+
+	void SpectrogramMipChain::publish(size_t columns)
+	{
+		readyColumns.store(columns, std::memory_order_release);
+		version++;
+	}
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include "Sound.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Audio
+{
+	/**
+	 * @brief Columns of log-frequency band levels, one byte per band from silence to full scale
+	 */
+	class SpectrogramMip
+	{
+	  public:
+		double secondsPerColumn{};
+		size_t columnCount{};
+		std::vector<uint8_t> levels;
+
+		inline const uint8_t* getColumn(size_t index) const;
+
+		void clear()
+		{
+			secondsPerColumn = {};
+			columnCount = {};
+			levels.clear();
+		}
+	};
+
+	/**
+	 * @brief Spectrogram of a track built on a worker thread and kept as a pyramid of mips, each
+	 * keeping the loudest of two columns of the one before so short transients survive zooming
+	 * out. The music is decoded in blocks whose windows are transformed in parallel, and the base
+	 * mip is saved to the audio cache so reopening the track skips the FFTs entirely.
+	 */
+	class SpectrogramMipChain
+	{
+	  public:
+		static constexpr ma_uint32 sampleRate{ 32000 };
+		static constexpr size_t fftSize{ 1024 };
+		static constexpr size_t hopSize{ 256 };
+		static constexpr size_t bandCount{ 64 };
+		static constexpr float minFrequency{ 50.0f };
+		static constexpr float maxFrequency{ 16000.0f };
+		static constexpr float dynamicRange{ 80.0f };
+		static constexpr size_t maxMipLevels{ 10 };
+
+		// Bump when the analysis changes so stale cache entries are ignored
+		static constexpr uint32_t layoutVersion{ 1 };
+
+	  private:
+		// Columns decoded and transformed per step, split between the threads
+		static constexpr size_t blockColumns{ 4096 };
+		static constexpr size_t taskColumns{ 256 };
+
+		std::thread worker;
+		std::atomic<bool> cancelRequested{ false };
+		std::atomic<size_t> readyColumns{ 0 };
+		std::atomic<bool> complete{ false };
+		std::atomic<bool> running{ false };
+		std::atomic<bool> failed{ false };
+		std::wstring filename;
+
+		void generate(uint64_t hash);
+		bool analyze();
+		void allocateMips(size_t columnCount);
+		void reduceLevels(size_t begin, size_t end);
+		void publish(size_t columns);
+
+	  public:
+		SpectrogramMip mips[maxMipLevels]{};
+		size_t usedMipCount{};
+
+		// Bumped whenever the mips change so cached renders know to refresh
+		std::atomic<uint32_t> version{ 0 };
+
+		SpectrogramMipChain() = default;
+		SpectrogramMipChain(const SpectrogramMipChain&) = delete;
+		SpectrogramMipChain& operator=(const SpectrogramMipChain&) = delete;
+		~SpectrogramMipChain() { cancelGeneration(); }
+
+		bool isEmpty() const { return readyColumns.load(std::memory_order_acquire) == 0; }
+		bool isComplete() const { return complete.load(std::memory_order_acquire); }
+		bool isGenerating() const { return running.load(std::memory_order_acquire); }
+
+		// The filename is kept when the music can't be analyzed so the job isn't restarted
+		bool hasFailed() const { return failed.load(std::memory_order_acquire); }
+		const std::wstring& getFilename() const { return filename; }
+
+		/**
+		 * @brief Columns of a mip that can be read, the rest are still being generated
+		 */
+		size_t getReadyColumnCount(size_t level) const;
+		const SpectrogramMip& findClosestMip(double secondsPerPixel) const;
+
+		/**
+		 * @brief Loudest level of every band between two times of the music
+		 * @param output Holds bandCount levels
+		 */
+		void levelsInTimeRange(const SpectrogramMip& mip, double startTime, double endTime,
+		                       uint8_t* output) const;
+
+		/**
+		 * @brief Start building the spectrogram of a music file, replacing the current one
+		 * @param hash Content hash of the file for the audio cache, 0 to skip the cache
+		 */
+		void generateFromFile(const std::wstring& filename, uint64_t hash);
+		void cancelGeneration();
+		void clear();
+	};
+
+	inline const uint8_t* SpectrogramMip::getColumn(size_t index) const
+	{
+		return levels.data() + index * SpectrogramMipChain::bandCount;
+	}
+}
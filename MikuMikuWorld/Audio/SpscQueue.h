@@ -0,0 +1,64 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace Audio
+{
+	/**
+	 * @brief Bounded lock-free queue between exactly one producer and one consumer thread.
+	 * Neither side blocks or allocates so the audio thread can drain it from its callback.
+	 */
+	template <typename T, size_t Capacity> class SpscQueue
+	{
+		static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+		              "SpscQueue capacity must be a power of two");
+
+	  private:
+		static constexpr size_t mask{ Capacity - 1 };
+
+		std::array<T, Capacity> items{};
+
+		// Kept on separate cache lines so the two threads don't keep invalidating each other
+		alignas(64) std::atomic<size_t> head{ 0 };
+		alignas(64) std::atomic<size_t> tail{ 0 };
+
+	  public:
+		/**
+		 * @brief Producer side. Returns false without blocking when the queue is full.
+		 */
+		bool push(const T& item)
+		{
+			const size_t position = tail.load(std::memory_order_relaxed);
+			if (position - head.load(std::memory_order_acquire) == Capacity)
+				return false;
+
+			items[position & mask] = item;
+			tail.store(position + 1, std::memory_order_release);
+			return true;
+		}
+
+		/**
+		 * @brief Consumer side. Returns false without blocking when the queue is empty.
+		 */
+		bool pop(T& item)
+		{
+			const size_t position = head.load(std::memory_order_relaxed);
+			if (position == tail.load(std::memory_order_acquire))
+				return false;
+
+			item = items[position & mask];
+			head.store(position + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Only a snapshot when called while the other thread is active
+		size_t size() const
+		{
+			return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+		}
+
+		bool empty() const { return size() == 0; }
+		static constexpr size_t capacity() { return Capacity; }
+	};
+}
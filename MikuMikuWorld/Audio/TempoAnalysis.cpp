@@ -0,0 +1,312 @@
+#include "TempoAnalysis.h"
+#include "FFT.h"
+#include "../Application.h"
+#include <algorithm>
+#include <cmath>
+#include <execution>
+#include <numeric>
+
+namespace Audio
+{
+	namespace mmw = MikuMikuWorld;
+
+	namespace
+	{
+		// Spectral frames per parallel task
+		constexpr size_t chunkFrames = 512;
+
+		// Log compression of the magnitudes so quiet onsets still count
+		constexpr float compression = 100.0f;
+
+		struct CombScore
+		{
+			float bpm{};
+			float phase{};
+			float score{};
+			float meanScore{};
+		};
+
+		float sampleLinear(const std::vector<float>& values, float position)
+		{
+			const size_t index = static_cast<size_t>(position);
+			if (index + 1 >= values.size())
+				return index < values.size() ? values[index] : 0.0f;
+
+			const float fraction = position - index;
+			return values[index] + (values[index + 1] - values[index]) * fraction;
+		}
+
+		// Average onset strength on a beat grid, at the phase that lines up best with the onsets
+		CombScore scoreTempo(const std::vector<float>& onsets, float bpm, float rate)
+		{
+			const float period = rate * 60.0f / bpm;
+			const float length = static_cast<float>(onsets.size());
+
+			CombScore result{ bpm };
+			float totalScore = 0.0f;
+			size_t phaseCount = 0;
+			for (float phase = 0.0f; phase < period; phase += 0.25f)
+			{
+				float sum = 0.0f;
+				size_t beats = 0;
+				for (float position = phase; position < length; position += period)
+				{
+					sum += sampleLinear(onsets, position);
+					++beats;
+				}
+
+				const float score = beats ? sum / beats : 0.0f;
+				totalScore += score;
+				++phaseCount;
+				if (score > result.score)
+				{
+					result.score = score;
+					result.phase = phase;
+				}
+			}
+
+			result.meanScore = phaseCount ? totalScore / phaseCount : 0.0f;
+			return result;
+		}
+
+		// Tempo prior centered on 120 BPM, keeps the autocorrelation from picking half or double
+		float tempoPrior(float bpm)
+		{
+			const float octaves = std::log2(bpm / 120.0f) / 0.9f;
+			return std::exp(-0.5f * octaves * octaves);
+		}
+	}
+
+	TempoAnalysis::~TempoAnalysis()
+	{
+		cancel();
+		if (worker.joinable())
+			worker.join();
+	}
+
+	void TempoAnalysis::start(const std::string& filename)
+	{
+		cancel();
+		if (worker.joinable())
+			worker.join();
+
+		cancelled = false;
+		finished = false;
+		progress = 0.0f;
+		worker = std::thread(
+		    [this, filename]
+		    {
+			    result = analyze(filename);
+			    finished.store(true, std::memory_order_release);
+			    mmw::Application::requestRedraw();
+		    });
+	}
+
+	mmw::Result TempoAnalysis::finish()
+	{
+		if (worker.joinable())
+			worker.join();
+
+		return result;
+	}
+
+	void TempoAnalysis::cancel() { cancelled = true; }
+
+	mmw::Result TempoAnalysis::analyze(const std::string& filename)
+	{
+		// Onsets don't need the full bandwidth, a mono 22kHz decode is a fraction of the work
+		std::vector<float> samples;
+		mmw::Result decodeResult = decodeAudioFileF32(filename, 1, sampleRate, samples);
+		if (!decodeResult.isOk())
+			return mmw::Result(mmw::ResultStatus::Error,
+			                   "Failed to decode music: " + decodeResult.getMessage());
+
+		if (samples.size() < windowSize * 8)
+			return mmw::Result(mmw::ResultStatus::Error, "The music is too short to analyze");
+
+		progress = 0.3f;
+		if (cancelled)
+			return mmw::Result(mmw::ResultStatus::Warning, "Analysis cancelled");
+
+		// Spectral flux, chunks transform the frame before them again so they run independently
+		const size_t frameCount = (samples.size() - windowSize) / hopSize + 1;
+		const size_t binCount = windowSize / 2 + 1;
+		const FFT fft(windowSize);
+		const std::vector<float> window = FFT::hannWindow(windowSize);
+
+		std::vector<float> flux(frameCount, 0.0f);
+		std::vector<size_t> chunks((frameCount + chunkFrames - 1) / chunkFrames);
+		std::iota(chunks.begin(), chunks.end(), 0);
+		std::atomic<size_t> chunksDone{ 0 };
+		std::for_each(
+		    std::execution::par, chunks.begin(), chunks.end(),
+		    [&](size_t chunk)
+		    {
+			    if (cancelled)
+				    return;
+
+			    std::vector<std::complex<float>> scratch;
+			    std::vector<float> previous(binCount), current(binCount);
+			    auto spectrum = [&](size_t frame, std::vector<float>& output)
+			    {
+				    fft.magnitudes(samples.data() + frame * hopSize, window.data(), scratch,
+				                   output.data());
+				    for (float& magnitude : output)
+					    magnitude = std::log1p(compression * magnitude);
+			    };
+
+			    const size_t first = chunk * chunkFrames;
+			    const size_t last = std::min(first + chunkFrames, frameCount);
+			    spectrum(first > 0 ? first - 1 : 0, previous);
+			    for (size_t frame = std::max<size_t>(first, 1); frame < last; ++frame)
+			    {
+				    spectrum(frame, current);
+				    float sum = 0.0f;
+				    for (size_t bin = 0; bin < binCount; ++bin)
+					    sum += std::max(0.0f, current[bin] - previous[bin]);
+
+				    flux[frame] = sum;
+				    std::swap(previous, current);
+			    }
+
+			    const size_t done = chunksDone.fetch_add(1, std::memory_order_relaxed) + 1;
+			    progress = 0.3f + 0.5f * done / chunks.size();
+		    });
+
+		if (cancelled)
+			return mmw::Result(mmw::ResultStatus::Warning, "Analysis cancelled");
+
+		// Keep what rises above the local average so loud sections don't drown the rest
+		const float rate = getOnsetsRate();
+		const size_t averageRadius = static_cast<size_t>(rate * 0.25f);
+		std::vector<double> prefix(frameCount + 1, 0.0);
+		for (size_t i = 0; i < frameCount; ++i)
+			prefix[i + 1] = prefix[i] + flux[i];
+
+		std::vector<float> envelope(frameCount);
+		for (size_t i = 0; i < frameCount; ++i)
+		{
+			const size_t from = i > averageRadius ? i - averageRadius : 0;
+			const size_t to = std::min(frameCount, i + averageRadius + 1);
+			const float average = static_cast<float>((prefix[to] - prefix[from]) / (to - from));
+			envelope[i] = std::max(0.0f, flux[i] - average);
+		}
+
+		const float peak = *std::max_element(envelope.begin(), envelope.end());
+		if (peak <= 0.0f)
+			return mmw::Result(mmw::ResultStatus::Error, "No onsets found in the music");
+
+		for (float& value : envelope)
+			value /= peak;
+
+		// Coarse tempo from the autocorrelation of the onsets. They are smoothed first so a
+		// period between two whole frames still correlates with itself.
+		std::vector<float> smoothed(frameCount);
+		for (size_t i = 0; i < frameCount; ++i)
+		{
+			float sum = 0.0f, weights = 0.0f;
+			for (int offset = -2; offset <= 2; ++offset)
+			{
+				const ptrdiff_t index = static_cast<ptrdiff_t>(i) + offset;
+				if (index < 0 || index >= static_cast<ptrdiff_t>(frameCount))
+					continue;
+
+				const float weight = 3.0f - std::abs(offset);
+				sum += envelope[index] * weight;
+				weights += weight;
+			}
+
+			smoothed[i] = sum / weights;
+		}
+
+		const size_t minLag = static_cast<size_t>(rate * 60.0f / maxBpm);
+		const size_t maxLag = static_cast<size_t>(std::ceil(rate * 60.0f / minBpm));
+		std::vector<size_t> lags(maxLag - minLag + 1);
+		std::iota(lags.begin(), lags.end(), minLag);
+		std::vector<float> correlations(lags.size());
+		std::transform(std::execution::par, lags.begin(), lags.end(), correlations.begin(),
+		               [&](size_t lag)
+		               {
+			               double sum = 0.0;
+			               for (size_t i = 0; i + lag < frameCount; ++i)
+				               sum += smoothed[i] * smoothed[i + lag];
+
+			               return static_cast<float>(sum / (frameCount - lag));
+		               });
+
+		size_t bestLag = 1;
+		float bestCorrelation = -1.0f;
+		for (size_t i = 1; i + 1 < lags.size(); ++i)
+		{
+			const float weighted = correlations[i] * tempoPrior(rate * 60.0f / lags[i]);
+			if (weighted > bestCorrelation)
+			{
+				bestCorrelation = weighted;
+				bestLag = i;
+			}
+		}
+
+		// Parabolic interpolation between the neighbouring lags
+		const float left = correlations[bestLag - 1];
+		const float center = correlations[bestLag];
+		const float right = correlations[bestLag + 1];
+		const float curvature = left - 2.0f * center + right;
+		const float lagOffset = curvature < 0.0f ? 0.5f * (left - right) / curvature : 0.0f;
+		float coarseBpm = rate * 60.0f / (lags[bestLag] + lagOffset);
+
+		// The autocorrelation can't tell a tempo from half of it when every other beat is as
+		// strong, double while the in between beats fit about as well and halve while they don't
+		const float octaveRatio = 0.9f;
+		auto combScore = [&](float bpm) { return scoreTempo(envelope, bpm, rate).score; };
+		while (coarseBpm * 2.0f <= maxBpm &&
+		       combScore(coarseBpm * 2.0f) >= combScore(coarseBpm) * octaveRatio)
+			coarseBpm *= 2.0f;
+
+		while (coarseBpm * 0.5f >= minBpm &&
+		       combScore(coarseBpm) < combScore(coarseBpm * 0.5f) * octaveRatio)
+			coarseBpm *= 0.5f;
+
+		progress = 0.85f;
+		if (cancelled)
+			return mmw::Result(mmw::ResultStatus::Warning, "Analysis cancelled");
+
+		// Refine the tempo and find the phase with a comb over the whole track
+		constexpr float bpmStep = 0.01f;
+		const float fromBpm = std::max(minBpm, coarseBpm * 0.98f);
+		const float toBpm = std::min(maxBpm, coarseBpm * 1.02f);
+		std::vector<CombScore> candidates(static_cast<size_t>((toBpm - fromBpm) / bpmStep) + 1);
+		for (size_t i = 0; i < candidates.size(); ++i)
+			candidates[i].bpm = fromBpm + i * bpmStep;
+
+		std::for_each(std::execution::par, candidates.begin(), candidates.end(),
+		              [&](CombScore& candidate)
+		              { candidate = scoreTempo(envelope, candidate.bpm, rate); });
+
+		CombScore best = *std::max_element(candidates.begin(), candidates.end(),
+		                                   [](const CombScore& a, const CombScore& b)
+		                                   { return a.score < b.score; });
+
+		// Charts mostly use whole tempos, prefer one if it fits about as well
+		const float roundedBpm = std::round(best.bpm);
+		if (roundedBpm != best.bpm && roundedBpm >= minBpm && roundedBpm <= maxBpm)
+		{
+			const CombScore rounded = scoreTempo(envelope, roundedBpm, rate);
+			if (rounded.score >= best.score * 0.99f)
+				best = rounded;
+		}
+
+		// The flux of an onset peaks as it crosses the steepest part of the window's fade in
+		const float period = 60.0f / best.bpm;
+		const float firstBeat =
+		    std::fmod((best.phase * hopSize + windowSize * 0.75f) / sampleRate, period);
+
+		estimate.bpm = best.bpm;
+		estimate.offset = std::fmod(period - firstBeat, period) * 1000.0f;
+		estimate.confidence =
+		    best.score > 0.0f ? std::clamp(1.0f - best.meanScore / best.score, 0.0f, 1.0f) : 0.0f;
+		onsets = std::move(envelope);
+
+		progress = 1.0f;
+		return mmw::Result::Ok();
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "Sound.h"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Audio
+{
+	struct TempoEstimate
+	{
+		float bpm{};
+
+		// Music offset putting the first beat at the start of the chart, in milliseconds
+		float offset{};
+
+		// How much the beats stand out from the rest of the onsets, from 0 to 1
+		float confidence{};
+	};
+
+	/**
+	 * @brief Estimates the tempo and first beat of a music file on a worker thread.
+	 * Onsets are detected by the spectral flux of short windows transformed in parallel, then
+	 * the tempo is picked by autocorrelation and refined together with the phase by a comb
+	 * over the whole track. Assumes a constant tempo.
+	 */
+	class TempoAnalysis
+	{
+	  public:
+		static constexpr ma_uint32 sampleRate{ 22050 };
+		static constexpr size_t windowSize{ 1024 };
+		static constexpr size_t hopSize{ 256 };
+		static constexpr float minBpm{ 60.0f };
+		static constexpr float maxBpm{ 240.0f };
+
+	  private:
+		std::thread worker;
+		std::atomic<float> progress{ 0.0f };
+		std::atomic<bool> cancelled{ false };
+		std::atomic<bool> finished{ false };
+		MikuMikuWorld::Result result = MikuMikuWorld::Result::Ok();
+
+		// Only valid once finished
+		TempoEstimate estimate{};
+		std::vector<float> onsets;
+
+		MikuMikuWorld::Result analyze(const std::string& filename);
+
+	  public:
+		TempoAnalysis() = default;
+		TempoAnalysis(const TempoAnalysis&) = delete;
+		TempoAnalysis& operator=(const TempoAnalysis&) = delete;
+		~TempoAnalysis();
+
+		void start(const std::string& filename);
+		MikuMikuWorld::Result finish();
+		void cancel();
+
+		inline bool isRunning() const { return worker.joinable(); }
+		inline bool isFinished() const { return finished.load(std::memory_order_acquire); }
+		inline float getProgress() const { return progress.load(std::memory_order_relaxed); }
+
+		inline const TempoEstimate& getEstimate() const { return estimate; }
+
+		/**
+		 * @brief Onset strength from 0 to 1 every hopSize samples at sampleRate
+		 */
+		inline const std::vector<float>& getOnsets() const { return onsets; }
+		static constexpr float getOnsetsRate() { return static_cast<float>(sampleRate) / hopSize; }
+	};
+}
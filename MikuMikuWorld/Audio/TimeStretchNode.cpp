@@ -0,0 +1,365 @@
+#include "TimeStretchNode.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TIME_STRETCH_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace Audio
+{
+	namespace
+	{
+		// Candidates are first compared every few frames, then around the best one
+		constexpr size_t coarseSearchStep = 4;
+
+		// Dot product of a and b, and the energy of b
+		void correlate(const float* a, const float* b, size_t count, float& dot, float& energy)
+		{
+			size_t index = 0;
+			dot = 0.0f;
+			energy = 0.0f;
+
+#ifdef TIME_STRETCH_USE_SSE2
+			__m128 dots = _mm_setzero_ps();
+			__m128 energies = _mm_setzero_ps();
+			for (; index + 4 <= count; index += 4)
+			{
+				const __m128 va = _mm_loadu_ps(a + index);
+				const __m128 vb = _mm_loadu_ps(b + index);
+				dots = _mm_add_ps(dots, _mm_mul_ps(va, vb));
+				energies = _mm_add_ps(energies, _mm_mul_ps(vb, vb));
+			}
+
+			alignas(16) float lanes[4];
+			_mm_store_ps(lanes, dots);
+			dot = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+			_mm_store_ps(lanes, energies);
+			energy = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+			for (; index < count; index++)
+			{
+				dot += a[index] * b[index];
+				energy += b[index] * b[index];
+			}
+		}
+
+		// output = from + (to - from) * fade
+		void crossFade(const float* from, const float* to, const float* fade, size_t count,
+		               float* output)
+		{
+			size_t index = 0;
+
+#ifdef TIME_STRETCH_USE_SSE2
+			for (; index + 4 <= count; index += 4)
+			{
+				const __m128 vfrom = _mm_loadu_ps(from + index);
+				const __m128 vto = _mm_loadu_ps(to + index);
+				const __m128 vfade = _mm_loadu_ps(fade + index);
+				_mm_storeu_ps(output + index,
+				              _mm_add_ps(vfrom, _mm_mul_ps(_mm_sub_ps(vto, vfrom), vfade)));
+			}
+#endif
+
+			for (; index < count; index++)
+				output[index] = from[index] + (to[index] - from[index]) * fade[index];
+		}
+	}
+
+	ma_result TimeStretchNode::initialize(ma_engine* engine, ma_node* output)
+	{
+		static ma_node_vtable vtable = { onProcess, onGetRequiredInputFrameCount, 1, 1,
+			                             MA_NODE_FLAG_DIFFERENT_PROCESSING_RATES };
+
+		channelCount = ma_engine_get_channels(engine);
+		sampleRate = ma_engine_get_sample_rate(engine);
+		node.stretcher = this;
+
+		// 40ms segments searched 10ms around their position, long enough for bass at 0.25x
+		hopFrames = sampleRate / 50;
+		searchFrames = sampleRate / 100 / coarseSearchStep * coarseSearchStep;
+		inputCapacity = (hopFrames + searchFrames) * 2 + 4096;
+
+		input.assign(inputCapacity * channelCount, 0.0f);
+		inputMono.assign(inputCapacity, 0.0f);
+		tail.assign(hopFrames * channelCount, 0.0f);
+		tailMono.assign(hopFrames, 0.0f);
+		this->output.assign(hopFrames * channelCount, 0.0f);
+
+		// Raised cosine, the fade out of the previous segment is its complement
+		fadeIn.resize(hopFrames * channelCount);
+		for (size_t frame = 0; frame < hopFrames; ++frame)
+		{
+			const float phase = static_cast<float>((frame + 0.5) / hopFrames * 1.5707963267948966);
+			std::fill_n(fadeIn.begin() + frame * channelCount, channelCount,
+			            std::sin(phase) * std::sin(phase));
+		}
+
+		ma_uint32 channels[1] = { channelCount };
+		ma_node_config config = ma_node_config_init();
+		config.vtable = &vtable;
+		config.pInputChannels = channels;
+		config.pOutputChannels = channels;
+
+		ma_result result = ma_node_init(ma_engine_get_node_graph(engine), &config, nullptr, &node);
+		if (result != MA_SUCCESS)
+			return result;
+
+		result = ma_node_attach_output_bus(&node, 0, output, 0);
+		if (result != MA_SUCCESS)
+		{
+			ma_node_uninit(&node, nullptr);
+			return result;
+		}
+
+		reset();
+		initialized = true;
+		return MA_SUCCESS;
+	}
+
+	void TimeStretchNode::dispose()
+	{
+		if (!initialized)
+			return;
+
+		ma_node_uninit(&node, nullptr);
+		initialized = false;
+	}
+
+	void TimeStretchNode::reset()
+	{
+		primed = false;
+		leadingSilence = 0.0;
+		inputFrames = 0;
+		readPosition = 0.0;
+		outputFrames = 0;
+		outputCursor = 0;
+	}
+
+	void TimeStretchNode::setSpeed(float speed)
+	{
+		// Going to or from 1x switches between stretching and passing through
+		if ((speed == 1.0f) != (this->speed == 1.0f))
+			reset();
+
+		this->speed = speed;
+	}
+
+	void TimeStretchNode::setEnabled(bool enabled)
+	{
+		if (enabled != this->enabled)
+			reset();
+
+		this->enabled = enabled;
+	}
+
+	void TimeStretchNode::onProcess(ma_node* node, const float** framesIn,
+	                                ma_uint32* frameCountIn, float** framesOut,
+	                                ma_uint32* frameCountOut)
+	{
+		static_cast<Node*>(node)->stretcher->process(framesIn ? framesIn[0] : nullptr,
+		                                             *frameCountIn, framesOut[0], *frameCountOut);
+	}
+
+	ma_result TimeStretchNode::onGetRequiredInputFrameCount(ma_node* node,
+	                                                        ma_uint32 outputFrameCount,
+	                                                        ma_uint32* inputFrameCount)
+	{
+		const TimeStretchNode& stretcher = *static_cast<Node*>(node)->stretcher;
+		*inputFrameCount =
+		    stretcher.isStretching()
+		        ? static_cast<ma_uint32>(std::ceil(outputFrameCount * stretcher.speed)) + 1
+		        : outputFrameCount;
+		return MA_SUCCESS;
+	}
+
+	void TimeStretchNode::process(const float* framesIn, ma_uint32& frameCountIn,
+	                              float* framesOut, ma_uint32& frameCountOut)
+	{
+		if (!isStretching() || framesIn == nullptr)
+		{
+			frameCountOut = std::min(frameCountIn, frameCountOut);
+			frameCountIn = frameCountOut;
+			if (framesIn != nullptr)
+				std::memcpy(framesOut, framesIn,
+				            sizeof(float) * static_cast<size_t>(frameCountOut) * channelCount);
+
+			load.store(0.0f, std::memory_order_relaxed);
+			return;
+		}
+
+		if (skipLeadingSilence(framesIn, frameCountIn, framesOut, frameCountOut))
+			return;
+
+		const auto processStart = std::chrono::steady_clock::now();
+
+		// Whatever doesn't fit stays cached by miniaudio for the next call
+		const size_t consumed = std::min<size_t>(frameCountIn, inputCapacity - inputFrames);
+		std::memcpy(input.data() + inputFrames * channelCount, framesIn,
+		            sizeof(float) * consumed * channelCount);
+		for (size_t frame = 0; frame < consumed; ++frame)
+		{
+			float sum = 0.0f;
+			for (size_t channel = 0; channel < channelCount; ++channel)
+				sum += framesIn[frame * channelCount + channel];
+
+			inputMono[inputFrames + frame] = sum;
+		}
+		inputFrames += consumed;
+
+		size_t produced = 0;
+		while (produced < frameCountOut)
+		{
+			if (outputCursor == outputFrames && !step())
+				break;
+
+			const size_t count = std::min(outputFrames - outputCursor, frameCountOut - produced);
+			std::memcpy(framesOut + produced * channelCount,
+			            output.data() + outputCursor * channelCount,
+			            sizeof(float) * count * channelCount);
+			outputCursor += count;
+			produced += count;
+		}
+
+		frameCountIn = static_cast<ma_uint32>(consumed);
+		frameCountOut = static_cast<ma_uint32>(produced);
+
+		if (produced > 0)
+		{
+			const std::chrono::duration<float> elapsed =
+			    std::chrono::steady_clock::now() - processStart;
+			const float blockLoad = elapsed.count() * sampleRate / produced;
+			load.store(load.load(std::memory_order_relaxed) * 0.95f + blockLoad * 0.05f,
+			           std::memory_order_relaxed);
+		}
+	}
+
+	bool TimeStretchNode::skipLeadingSilence(const float* framesIn, ma_uint32& frameCountIn,
+	                                         float* framesOut, ma_uint32& frameCountOut)
+	{
+		// The music is fed silence until its scheduled start. Buffering it would delay the music
+		// by the frames the first segment needs, so it is passed through at the stretched rate.
+		if (primed || inputFrames > 0)
+			return false;
+
+		const size_t maxFrames =
+		    std::min<size_t>(frameCountIn, static_cast<size_t>(frameCountOut * speed));
+		size_t silentFrames = 0;
+		for (; silentFrames < maxFrames; ++silentFrames)
+		{
+			const float* frame = framesIn + silentFrames * channelCount;
+			if (std::any_of(frame, frame + channelCount,
+			                [](float sample) { return sample != 0.0f; }))
+				break;
+		}
+
+		if (silentFrames == 0)
+			return false;
+
+		leadingSilence += silentFrames / static_cast<double>(speed);
+		const size_t outputCount =
+		    std::min<size_t>(frameCountOut, static_cast<size_t>(leadingSilence));
+		leadingSilence -= outputCount;
+		std::memset(framesOut, 0, sizeof(float) * outputCount * channelCount);
+
+		frameCountIn = static_cast<ma_uint32>(silentFrames);
+		frameCountOut = static_cast<ma_uint32>(outputCount);
+		return true;
+	}
+
+	bool TimeStretchNode::step()
+	{
+		const size_t nominal = static_cast<size_t>(readPosition);
+		if (nominal + searchFrames + hopFrames * 2 > inputFrames)
+			return false;
+
+		const size_t sampleCount = hopFrames * channelCount;
+		size_t start = nominal;
+		if (primed)
+		{
+			const size_t first = nominal > searchFrames ? nominal - searchFrames : 0;
+			start = findBestOffset(nominal, first, nominal + searchFrames);
+			crossFade(tail.data(), input.data() + start * channelCount, fadeIn.data(),
+			          sampleCount, output.data());
+		}
+		else
+		{
+			// Nothing to line up with yet
+			std::memcpy(output.data(), input.data() + start * channelCount,
+			            sizeof(float) * sampleCount);
+			primed = true;
+		}
+
+		// The second half fades out under the next segment and is what the next search matches
+		std::memcpy(tail.data(), input.data() + (start + hopFrames) * channelCount,
+		            sizeof(float) * sampleCount);
+		std::memcpy(tailMono.data(), inputMono.data() + start + hopFrames,
+		            sizeof(float) * hopFrames);
+
+		outputFrames = hopFrames;
+		outputCursor = 0;
+		readPosition += hopFrames * static_cast<double>(speed);
+
+		// Drop the input no later segment can reach
+		const size_t nextNominal = static_cast<size_t>(readPosition);
+		const size_t dropped = std::min(
+		    inputFrames, nextNominal > searchFrames ? nextNominal - searchFrames : size_t{ 0 });
+		if (dropped > 0)
+		{
+			std::memmove(input.data(), input.data() + dropped * channelCount,
+			             sizeof(float) * (inputFrames - dropped) * channelCount);
+			std::memmove(inputMono.data(), inputMono.data() + dropped,
+			             sizeof(float) * (inputFrames - dropped));
+			inputFrames -= dropped;
+			readPosition -= dropped;
+		}
+
+		return true;
+	}
+
+	size_t TimeStretchNode::findBestOffset(size_t start, size_t first, size_t last) const
+	{
+		auto score = [this](size_t position)
+		{
+			float dot{}, energy{};
+			correlate(tailMono.data(), inputMono.data() + position, hopFrames, dot, energy);
+			return dot / std::sqrt(energy + 1e-9f);
+		};
+
+		// Ties keep the nominal position so silence doesn't wander
+		size_t best = start;
+		float bestScore = score(start);
+		for (size_t position = first; position <= last; position += coarseSearchStep)
+		{
+			const float candidate = score(position);
+			if (candidate > bestScore)
+			{
+				best = position;
+				bestScore = candidate;
+			}
+		}
+
+		const size_t coarseBest = best;
+		const size_t refineFirst =
+		    std::max(first, coarseBest - std::min(coarseBest, coarseSearchStep - 1));
+		const size_t refineLast = std::min(last, coarseBest + coarseSearchStep - 1);
+		for (size_t position = refineFirst; position <= refineLast; ++position)
+		{
+			if (position == coarseBest)
+				continue;
+
+			const float candidate = score(position);
+			if (candidate > bestScore)
+			{
+				best = position;
+				bestScore = candidate;
+			}
+		}
+
+		return best;
+	}
+}
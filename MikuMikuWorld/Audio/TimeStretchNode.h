@@ -0,0 +1,95 @@
+#pragma once
+#include "Sound.h"
+#include <atomic>
+#include <vector>
+
+namespace Audio
+{
+	/**
+	 * @brief Miniaudio node changing the tempo of its input without changing the pitch (WSOLA).
+	 * Each output hop cross-fades in the input segment near the nominal read position that best
+	 * continues the previous one, so slowed down music keeps its pitch.
+	 * Passes its input through untouched at 1x or while disabled.
+	 */
+	class TimeStretchNode
+	{
+	  private:
+		// Miniaudio expects the node base first, the callback finds the stretcher through it
+		struct Node
+		{
+			ma_node_base base;
+			TimeStretchNode* stretcher;
+		};
+
+		Node node{};
+		bool initialized{ false };
+		ma_uint32 channelCount{};
+		ma_uint32 sampleRate{};
+
+		// Frames output per step, segments are twice as long and overlap by half
+		size_t hopFrames{};
+		// Frames the segment may move around its nominal position to line up with the last one
+		size_t searchFrames{};
+
+		// Allocated once in initialize, the audio thread only reuses them
+		std::vector<float> input;
+		std::vector<float> inputMono;
+		std::vector<float> tail;
+		std::vector<float> tailMono;
+		std::vector<float> output;
+		std::vector<float> fadeIn;
+		size_t inputCapacity{};
+
+		// Only touched by the audio thread (or while the device is stopped)
+		float speed{ 1.0f };
+		bool enabled{ true };
+		bool primed{ false };
+		double leadingSilence{};
+		size_t inputFrames{};
+		double readPosition{};
+		size_t outputFrames{};
+		size_t outputCursor{};
+
+		// Processing time over the played time of the last blocks
+		std::atomic<float> load{ 0.0f };
+
+		static void onProcess(ma_node* node, const float** framesIn, ma_uint32* frameCountIn,
+		                      float** framesOut, ma_uint32* frameCountOut);
+		static ma_result onGetRequiredInputFrameCount(ma_node* node, ma_uint32 outputFrameCount,
+		                                              ma_uint32* inputFrameCount);
+
+		void process(const float* framesIn, ma_uint32& frameCountIn, float* framesOut,
+		             ma_uint32& frameCountOut);
+		bool skipLeadingSilence(const float* framesIn, ma_uint32& frameCountIn, float* framesOut,
+		                        ma_uint32& frameCountOut);
+		bool step();
+		size_t findBestOffset(size_t start, size_t first, size_t last) const;
+
+	  public:
+		TimeStretchNode() = default;
+		TimeStretchNode(const TimeStretchNode&) = delete;
+		TimeStretchNode& operator=(const TimeStretchNode&) = delete;
+
+		/**
+		 * @brief Create the node and attach it to the input of another node (ex. a sound group)
+		 */
+		ma_result initialize(ma_engine* engine, ma_node* output);
+		void dispose();
+
+		inline ma_node* getNode() { return &node; }
+
+		// The following are for the audio thread, or any thread while the device is stopped
+
+		/**
+		 * @brief Drop the buffered audio (ex. after a seek)
+		 */
+		void reset();
+		void setSpeed(float speed);
+		void setEnabled(bool enabled);
+		inline float getSpeed() const { return speed; }
+		inline bool isEnabled() const { return enabled; }
+		inline bool isStretching() const { return enabled && speed != 1.0f; }
+
+		inline float getLoad() const { return load.load(std::memory_order_relaxed); }
+	};
+}
@@ -0,0 +1,347 @@
+#include "Waveform.h"
+#include "AudioCache.h"
+#include <execution>
+#include <numeric>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WAVEFORM_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace Audio
+{
+	namespace mmw = MikuMikuWorld;
+
+	void reduceFramesToPeaks(const int16_t* samples, uint32_t channelCount, uint32_t channelIndex,
+	                         size_t peakCount, WaveformPeak* output)
+	{
+		size_t index = 0;
+
+#ifdef WAVEFORM_USE_SSE2
+		// Every 32 bit lane of a result holds one peak with the min in its low half
+		const __m128i lowMask = _mm_set1_epi32(0x0000FFFF);
+		if (channelCount == 1)
+		{
+			for (; index + 4 <= peakCount; index += 4)
+			{
+				// Pair each sample with its neighbour by swapping the halves of every lane
+				const __m128i frames =
+				    _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + index * 2));
+				const __m128i swapped =
+				    _mm_or_si128(_mm_srli_epi32(frames, 16), _mm_slli_epi32(frames, 16));
+
+				const __m128i low = _mm_min_epi16(frames, swapped);
+				const __m128i high = _mm_max_epi16(frames, swapped);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(output + index),
+				                 _mm_or_si128(_mm_and_si128(low, lowMask),
+				                              _mm_andnot_si128(lowMask, high)));
+			}
+		}
+		else if (channelCount == 2)
+		{
+			for (; index + 4 <= peakCount; index += 4)
+			{
+				// Every lane holds one stereo frame, split them into even and odd frames
+				const __m128 a = _mm_castsi128_ps(
+				    _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + index * 4)));
+				const __m128 b = _mm_castsi128_ps(
+				    _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + index * 4 + 8)));
+				const __m128i even = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+				const __m128i odd = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+
+				const __m128i low = _mm_min_epi16(even, odd);
+				const __m128i high = _mm_max_epi16(even, odd);
+				const __m128i peaks =
+				    channelIndex == 0
+				        ? _mm_or_si128(_mm_and_si128(low, lowMask), _mm_slli_epi32(high, 16))
+				        : _mm_or_si128(_mm_srli_epi32(low, 16), _mm_andnot_si128(lowMask, high));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(output + index), peaks);
+			}
+		}
+#endif
+
+		for (; index < peakCount; index++)
+		{
+			const int16_t sampleA = samples[((index * 2 + 0) * channelCount) + channelIndex];
+			const int16_t sampleB = samples[((index * 2 + 1) * channelCount) + channelIndex];
+			output[index] = { std::min(sampleA, sampleB), std::max(sampleA, sampleB) };
+		}
+	}
+
+	void reducePeakPairs(const WaveformPeak* input, size_t peakCount, WaveformPeak* output)
+	{
+		size_t index = 0;
+
+#ifdef WAVEFORM_USE_SSE2
+		const __m128i lowMask = _mm_set1_epi32(0x0000FFFF);
+		for (; index + 4 <= peakCount; index += 4)
+		{
+			const __m128 a = _mm_castsi128_ps(
+			    _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + index * 2)));
+			const __m128 b = _mm_castsi128_ps(
+			    _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + index * 2 + 4)));
+			const __m128i even = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+			const __m128i odd = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+
+			// Mins of both peaks go to the low halves, maxes to the high halves
+			const __m128i low = _mm_min_epi16(even, odd);
+			const __m128i high = _mm_max_epi16(even, odd);
+			_mm_storeu_si128(
+			    reinterpret_cast<__m128i*>(output + index),
+			    _mm_or_si128(_mm_and_si128(low, lowMask), _mm_andnot_si128(lowMask, high)));
+		}
+#endif
+
+		for (; index < peakCount; index++)
+			output[index] = input[index * 2].combine(input[index * 2 + 1]);
+	}
+
+	void WaveformMipChain::reduceLevel(size_t level, size_t begin, size_t end)
+	{
+		const std::vector<WaveformPeak>& parentPeaks = mips[level - 1].peaks;
+		WaveformPeak* peaks = mips[level].peaks.data();
+
+		// The last peak of a level may only have one parent
+		const size_t pairedEnd = std::min(end, parentPeaks.size() / 2);
+		if (pairedEnd > begin)
+			reducePeakPairs(parentPeaks.data() + begin * 2, pairedEnd - begin, peaks + begin);
+
+		for (size_t index = std::max(begin, pairedEnd); index < end; index++)
+			peaks[index] = parentPeaks[index * 2];
+	}
+
+	void WaveformMipChain::generateChunk(const SoundBuffer& audioData, uint32_t channelIndex,
+	                                     size_t chunk, size_t levelCount)
+	{
+		const size_t begin = chunk * chunkSamples;
+		const size_t end = std::min(begin + chunkSamples, mips[0].peaks.size());
+
+		// The original full samples are already included in the sample buffer
+		// So we'll skip processing the full data mip to reduce memory usage
+		WaveformPeak* basePeaks = mips[0].peaks.data();
+		const size_t pairedEnd = std::min(end, static_cast<size_t>(audioData.frameCount / 2));
+		if (pairedEnd > begin)
+			reduceFramesToPeaks(audioData.samples.get() + begin * 2 * audioData.channelCount,
+			                    audioData.channelCount, channelIndex, pairedEnd - begin,
+			                    basePeaks + begin);
+
+		for (size_t index = std::max(begin, pairedEnd); index < end; index++)
+		{
+			const int16_t sample =
+			    audioData.samples[(index * 2 * audioData.channelCount) + channelIndex];
+			basePeaks[index] = { sample, sample };
+		}
+
+		reduceChunkLevels(chunk, levelCount);
+	}
+
+	void WaveformMipChain::reduceChunkLevels(size_t chunk, size_t levelCount)
+	{
+		const size_t begin = chunk * chunkSamples;
+		for (size_t level = 1; level < levelCount; level++)
+		{
+			const size_t levelBegin = begin >> level;
+			const size_t levelEnd =
+			    std::min((begin + chunkSamples) >> level, mips[level].peaks.size());
+			reduceLevel(level, levelBegin, levelEnd);
+		}
+	}
+
+	void WaveformMipChain::finishCoarseLevels(size_t levelCount)
+	{
+		// Coarser levels span several chunks so they are only finished with the whole track
+		for (size_t level = std::min(levelCount, chunkLevels); level < levelCount; level++)
+			reduceLevel(level, 0, mips[level].peaks.size());
+
+		readyMipCount.store(static_cast<int>(levelCount), std::memory_order_release);
+		complete = true;
+		version++;
+	}
+
+	size_t WaveformMipChain::allocateMips(uint64_t frameCount, uint32_t sampleRate)
+	{
+		// Level layout follows the power of two sample counts but buffers only cover the track
+		size_t levelCount = 0;
+		size_t powerOfTwoSampleCount = mmw::roundUpToPowerOfTwo(frameCount) / 2;
+		size_t sampleCount = (frameCount + 1) / 2;
+		double secondsPerSample = 2.0 / static_cast<double>(sampleRate);
+		while (levelCount < maxMipLevels)
+		{
+			WaveformMip& mip = mips[levelCount++];
+			mip.powerOfTwoSampleCount = powerOfTwoSampleCount;
+			mip.secondsPerSample = secondsPerSample;
+			mip.samplesPerSecond = 1.0 / secondsPerSample;
+			mip.peaks.resize(sampleCount);
+
+			if (powerOfTwoSampleCount <= minMipSamples || cancelRequested)
+				break;
+
+			powerOfTwoSampleCount /= 2;
+			sampleCount = (sampleCount + 1) / 2;
+			secondsPerSample *= 2.0;
+		}
+
+		return levelCount;
+	}
+
+	void WaveformMipChain::generateMips(const SoundBuffer& audioData, uint32_t channelIndex)
+	{
+		const size_t levelCount = allocateMips(audioData.frameCount, audioData.sampleRate);
+
+		// Levels fitting inside a chunk can be shown while the rest of the track is processed
+		const size_t chunkLevelCount = std::min(levelCount, chunkLevels);
+		readyMipCount.store(static_cast<int>(chunkLevelCount), std::memory_order_release);
+		version++;
+
+		const size_t chunkCount = (mips[0].peaks.size() + chunkSamples - 1) / chunkSamples;
+		const size_t batchSize = std::max(std::thread::hardware_concurrency(), 1u) * size_t{ 2 };
+		std::vector<size_t> batch;
+		for (size_t first = 0; first < chunkCount && !cancelRequested; first += batch.size())
+		{
+			batch.resize(std::min(batchSize, chunkCount - first));
+			std::iota(batch.begin(), batch.end(), first);
+			std::for_each(std::execution::par, batch.begin(), batch.end(),
+			              [&](size_t chunk)
+			              { generateChunk(audioData, channelIndex, chunk, chunkLevelCount); });
+
+			readyBaseSamples.store(
+			    std::min((first + batch.size()) * chunkSamples, mips[0].peaks.size()),
+			    std::memory_order_release);
+			version++;
+		}
+
+		if (cancelRequested)
+			return;
+
+		finishCoarseLevels(levelCount);
+	}
+
+	void WaveformMipChain::generateMipChainsFromSampleBuffer(const SoundBuffer& audioData,
+	                                                         uint32_t channelIndex)
+	{
+		clear();
+		if (!audioData.isValid())
+			return;
+
+		durationInSeconds =
+		    static_cast<float>(audioData.frameCount) / static_cast<float>(audioData.sampleRate);
+
+		// Mono tracks show the same channel on both sides
+		channelIndex = std::min(channelIndex, audioData.channelCount - 1);
+		worker = std::thread(&WaveformMipChain::generateMips, this, std::cref(audioData),
+		                     channelIndex);
+	}
+
+	void WaveformMipChain::beginStream(uint64_t frameCount, uint32_t sampleRate,
+	                                   uint32_t channelIndex)
+	{
+		clear();
+		if (frameCount == 0 || sampleRate == 0)
+			return;
+
+		durationInSeconds = static_cast<double>(frameCount) / static_cast<double>(sampleRate);
+		streamChannelIndex = channelIndex;
+		streamLevelCount = allocateMips(frameCount, sampleRate);
+		streamBasePeaks = 0;
+		streamPublishedChunks = 0;
+		hasStreamPendingSample = false;
+
+		readyMipCount.store(static_cast<int>(std::min(streamLevelCount, chunkLevels)),
+		                    std::memory_order_release);
+		streaming.store(true, std::memory_order_release);
+		version++;
+	}
+
+	void WaveformMipChain::appendFrames(const int16_t* samples, uint32_t channelCount,
+	                                    size_t frameCount)
+	{
+		if (!streaming || channelCount == 0 || frameCount == 0)
+			return;
+
+		// Mono tracks show the same channel on both sides
+		const uint32_t channelIndex = std::min(streamChannelIndex, channelCount - 1);
+		std::vector<WaveformPeak>& basePeaks = mips[0].peaks;
+		size_t frame = 0;
+
+		// A frame left over from the previous block pairs with the first one of this block
+		if (hasStreamPendingSample && streamBasePeaks < basePeaks.size())
+		{
+			const int16_t sample = samples[channelIndex];
+			basePeaks[streamBasePeaks++] = { std::min(streamPendingSample, sample),
+				                             std::max(streamPendingSample, sample) };
+			hasStreamPendingSample = false;
+			frame = 1;
+		}
+
+		const size_t pairCount =
+		    std::min((frameCount - frame) / 2, basePeaks.size() - streamBasePeaks);
+		if (pairCount > 0)
+		{
+			reduceFramesToPeaks(samples + frame * channelCount, channelCount, channelIndex,
+			                    pairCount, basePeaks.data() + streamBasePeaks);
+			streamBasePeaks += pairCount;
+			frame += pairCount * 2;
+		}
+
+		if (frame < frameCount && streamBasePeaks < basePeaks.size())
+		{
+			streamPendingSample = samples[frame * channelCount + channelIndex];
+			hasStreamPendingSample = true;
+		}
+
+		// Publish every chunk completed by this block
+		const size_t chunkLevelCount = std::min(streamLevelCount, chunkLevels);
+		const size_t completeChunks = streamBasePeaks / chunkSamples;
+		if (completeChunks == streamPublishedChunks)
+			return;
+
+		for (; streamPublishedChunks < completeChunks; streamPublishedChunks++)
+			reduceChunkLevels(streamPublishedChunks, chunkLevelCount);
+
+		readyBaseSamples.store(streamPublishedChunks * chunkSamples, std::memory_order_release);
+		version++;
+	}
+
+	void WaveformMipChain::finishStream()
+	{
+		if (!streaming)
+			return;
+
+		std::vector<WaveformPeak>& basePeaks = mips[0].peaks;
+		if (hasStreamPendingSample && streamBasePeaks < basePeaks.size())
+			basePeaks[streamBasePeaks++] = { streamPendingSample, streamPendingSample };
+
+		hasStreamPendingSample = false;
+
+		// The last chunk is usually partial, peaks the decoder never reached stay silent
+		const size_t chunkLevelCount = std::min(streamLevelCount, chunkLevels);
+		const size_t chunkCount = (basePeaks.size() + chunkSamples - 1) / chunkSamples;
+		for (; streamPublishedChunks < chunkCount; streamPublishedChunks++)
+			reduceChunkLevels(streamPublishedChunks, chunkLevelCount);
+
+		readyBaseSamples.store(basePeaks.size(), std::memory_order_release);
+		finishCoarseLevels(streamLevelCount);
+		streaming.store(false, std::memory_order_release);
+	}
+
+	void WaveformMipChain::loadCachedPeaks(uint64_t hash, uint64_t frameCount,
+	                                       uint32_t sampleRate, uint32_t channelIndex)
+	{
+		beginStream(frameCount, sampleRate, channelIndex);
+		if (!streaming)
+			return;
+
+		worker = std::thread(
+		    [this, hash, frameCount, channelIndex]
+		    {
+			    // A failed read leaves the waveform silent, the entry is regenerated next time
+			    std::vector<WaveformPeak>& basePeaks = mips[0].peaks;
+			    if (AudioCache::loadPeaks(hash, channelIndex, frameCount, basePeaks))
+				    streamBasePeaks = basePeaks.size();
+			    else
+				    std::fill(basePeaks.begin(), basePeaks.end(), WaveformPeak{});
+
+			    finishStream();
+		    });
+	}
+}
@@ -6,18 +6,34 @@
 #pragma once
 #include "../Math.h"
 #include "AudioManager.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <stdint.h>
+#include <thread>
 #include <vector>
 #include <limits>
 
 namespace Audio
 {
-	constexpr int16_t averageTwoInt16Samples(int16_t a, int16_t b)
+	constexpr int16_t int16_t_max = std::numeric_limits<int16_t>::max();
+
+	// Lowest and highest signed sample covered by one mip sample
+	struct WaveformPeak
 	{
-		return static_cast<int16_t>((static_cast<int32_t>(a) + static_cast<int32_t>(b)) / 2);
-	}
+		int16_t min{};
+		int16_t max{};
 
-	constexpr int16_t int16_t_max = std::numeric_limits<int16_t>::max();
+		constexpr WaveformPeak combine(const WaveformPeak& other) const
+		{
+			return { std::min(min, other.min), std::max(max, other.max) };
+		}
+
+		constexpr int32_t getMagnitude() const
+		{
+			return std::max(static_cast<int32_t>(max), -static_cast<int32_t>(min));
+		}
+	};
 
 	class WaveformMip
 	{
@@ -25,57 +41,53 @@ namespace Audio
 		size_t powerOfTwoSampleCount{};
 		double secondsPerSample{};
 		double samplesPerSecond{};
-		std::vector<int16_t> absoluteSamples;
+		std::vector<WaveformPeak> peaks;
 
 		double getDuration() const
 		{
-			return static_cast<double>(absoluteSamples.size()) / samplesPerSecond;
+			return static_cast<double>(peaks.size()) / samplesPerSecond;
 		}
 
-		int16_t getSampleAtIndex(size_t index) const
+		WaveformPeak getPeakAtIndex(size_t index) const
 		{
-			if (index >= absoluteSamples.size())
-				return 0;
+			if (index >= peaks.size())
+				return {};
 
-			return absoluteSamples[index];
+			return peaks[index];
 		}
 
-		int16_t linearSampleAtSeconds(double seconds) const
-		{
-			const float sampleIndexAsFloat = static_cast<float>(seconds * samplesPerSecond);
-			const float sampleIndexFraction =
-			    sampleIndexAsFloat - static_cast<int32_t>(sampleIndexAsFloat);
-
-			const size_t sampleIndexLo = std::max(0ull, static_cast<size_t>(sampleIndexAsFloat));
-			const size_t sampleIndexHi = sampleIndexLo + 1;
-
-			const float normalizedSampleLo =
-			    getSampleAtIndex(sampleIndexLo) / static_cast<float>(int16_t_max);
-			const float normalizedSampleHi =
-			    getSampleAtIndex(sampleIndexHi) / static_cast<float>(int16_t_max);
-			const float normalizedSample =
-			    MikuMikuWorld::lerp(normalizedSampleLo, normalizedSampleHi, sampleIndexFraction);
-
-			return static_cast<int16_t>(normalizedSample * static_cast<float>(int16_t_max));
-		}
-
-		float averageNormalizedSampleInTimeRange(double startTime, double endTime) const
+		/**
+		 * @param readyCount Peaks that can be read, the ones after it may still be written
+		 */
+		WaveformPeak peakInTimeRange(double startTime, double endTime, size_t readyCount) const
 		{
 			if (secondsPerSample <= 0)
 			{
 				assert(false);
-				return 0.0f;
+				return {};
 			}
 
-			int32_t sampleSum = 0, sampleCount = 0;
-			for (double t = startTime; t < endTime; t += secondsPerSample)
-			{
-				sampleSum += linearSampleAtSeconds(t);
-				sampleCount++;
-			}
+			const double first = std::floor(startTime * samplesPerSecond);
+			const double last = std::ceil(endTime * samplesPerSecond);
+			readyCount = std::min(readyCount, peaks.size());
+			if (last <= 0 || first >= static_cast<double>(readyCount))
+				return {};
+
+			const size_t begin = static_cast<size_t>(std::max(first, 0.0));
+			const size_t end = std::max(std::min(static_cast<size_t>(last), readyCount), begin + 1);
+
+			WaveformPeak peak = peaks[begin];
+			for (size_t index = begin + 1; index < end; index++)
+				peak = peak.combine(peaks[index]);
+
+			return peak;
+		}
 
-			const int32_t sampleAverage = sampleSum / std::max(sampleCount, 1);
-			return sampleAverage / static_cast<float>(int16_t_max);
+		float normalizedPeakInTimeRange(double startTime, double endTime, size_t readyCount) const
+		{
+			return std::min(peakInTimeRange(startTime, endTime, readyCount).getMagnitude() /
+			                    static_cast<float>(int16_t_max),
+			                1.0f);
 		}
 
 		void clear()
@@ -83,12 +95,47 @@ namespace Audio
 			powerOfTwoSampleCount = {};
 			secondsPerSample = {};
 			samplesPerSecond = {};
-			absoluteSamples.clear();
+			peaks.clear();
 		}
 	};
 
+	// Reduce pairs of frames of one channel in an interleaved buffer into peaks
+	void reduceFramesToPeaks(const int16_t* samples, uint32_t channelCount, uint32_t channelIndex,
+	                         size_t peakCount, WaveformPeak* output);
+
+	// Reduce pairs of consecutive peaks into their combined peak
+	void reducePeakPairs(const WaveformPeak* input, size_t peakCount, WaveformPeak* output);
+
 	class WaveformMipChain
 	{
+	  private:
+		// Samples of the first mip generated together before being published to the timeline
+		static constexpr size_t chunkLevels{ 16 };
+		static constexpr size_t chunkSamples{ size_t{ 1 } << (chunkLevels - 1) };
+
+		std::thread worker;
+		std::atomic<bool> cancelRequested{ false };
+		std::atomic<int> readyMipCount{ 0 };
+		std::atomic<size_t> readyBaseSamples{ 0 };
+		std::atomic<bool> complete{ false };
+
+		// State of an incremental generation, only touched by the thread feeding the frames
+		std::atomic<bool> streaming{ false };
+		uint32_t streamChannelIndex{};
+		size_t streamLevelCount{};
+		size_t streamBasePeaks{};
+		size_t streamPublishedChunks{};
+		int16_t streamPendingSample{};
+		bool hasStreamPendingSample{ false };
+
+		size_t allocateMips(uint64_t frameCount, uint32_t sampleRate);
+		void generateMips(const SoundBuffer& audioData, uint32_t channelIndex);
+		void generateChunk(const SoundBuffer& audioData, uint32_t channelIndex, size_t chunk,
+		                   size_t levelCount);
+		void reduceChunkLevels(size_t chunk, size_t levelCount);
+		void reduceLevel(size_t level, size_t begin, size_t end);
+		void finishCoarseLevels(size_t levelCount);
+
 	  public:
 		static constexpr size_t maxMipLevels{ 24 };
 		static constexpr size_t minMipSamples{ 256 };
@@ -96,33 +143,79 @@ namespace Audio
 		WaveformMip mips[maxMipLevels]{};
 		double durationInSeconds{};
 
-		bool isEmpty() const { return mips[0].powerOfTwoSampleCount == 0; }
+		// Bumped whenever the mips change so cached renders know to refresh
+		std::atomic<uint32_t> version{ 0 };
+
+		WaveformMipChain() = default;
+		WaveformMipChain(const WaveformMipChain&) = delete;
+		WaveformMipChain& operator=(const WaveformMipChain&) = delete;
+		~WaveformMipChain() { cancelGeneration(); }
+
+		bool isEmpty() const { return readyMipCount.load(std::memory_order_acquire) == 0; }
+		bool isComplete() const { return complete.load(std::memory_order_acquire); }
+		bool isGenerating() const
+		{
+			return (worker.joinable() || streaming.load(std::memory_order_acquire)) &&
+			       !isComplete();
+		}
+
+		size_t getBaseSampleCount() const { return isEmpty() ? 0 : mips[0].peaks.size(); }
+
+		/**
+		 * @brief Stop a running generation and wait for the worker to exit.
+		 * Must be called before the sample buffer being read is released.
+		 */
+		void cancelGeneration()
+		{
+			cancelRequested = true;
+			if (worker.joinable())
+				worker.join();
+
+			cancelRequested = false;
+		}
 
 		void clear()
 		{
+			cancelGeneration();
+			streaming = false;
+			readyMipCount = 0;
+			readyBaseSamples = 0;
+			complete = false;
+			durationInSeconds = 0;
 			for (auto& mip : mips)
 				mip.clear();
+
+			version++;
 		}
 
-		int getUsedMipCount() const
+		int getUsedMipCount() const { return readyMipCount.load(std::memory_order_acquire); }
+
+		/**
+		 * @brief Peaks of a mip that can be read, the rest are still being generated
+		 */
+		size_t getReadyPeakCount(const WaveformMip& mip) const
 		{
-			for (int i = 0; i < static_cast<int>(maxMipLevels); i++)
-			{
-				if (mips[i].powerOfTwoSampleCount == 0)
-					return i;
-			}
+			const size_t level = &mip - mips;
+			if (level >= static_cast<size_t>(getUsedMipCount()))
+				return 0;
 
-			return static_cast<int32_t>(maxMipLevels);
+			if (isComplete())
+				return mip.peaks.size();
+
+			// Chunks are published whole with every level that fits in one reduced alongside
+			const size_t baseSamples = readyBaseSamples.load(std::memory_order_acquire);
+			if (baseSamples >= mips[0].peaks.size())
+				return mip.peaks.size();
+
+			return std::min(baseSamples >> level, mip.peaks.size());
 		}
 
 		const WaveformMip& findClosestMip(double secondsPerPixel) const
 		{
+			const int usedMipCount = getUsedMipCount();
 			const WaveformMip* closestMip = &mips[0];
-			for (int i = 1; i < maxMipLevels; i++)
+			for (int i = 1; i < usedMipCount; i++)
 			{
-				if (mips[i].powerOfTwoSampleCount == 0)
-					break;
-
 				if (abs(mips[i].secondsPerSample - secondsPerPixel) <
 				    abs(closestMip->secondsPerSample - secondsPerPixel))
 					closestMip = &mips[i];
@@ -133,88 +226,31 @@ namespace Audio
 
 		float getAmplitudeAt(const WaveformMip& mip, double seconds, double secondsPerPixel) const
 		{
-			return mip.averageNormalizedSampleInTimeRange(seconds, seconds + secondsPerPixel);
+			// Parts of the track still being generated are drawn as silence
+			return mip.normalizedPeakInTimeRange(seconds, seconds + secondsPerPixel,
+			                                     getReadyPeakCount(mip));
 		}
 
-		void generateMipChainsFromSampleBuffer(const SoundBuffer& audioData, uint32_t channelIndex)
-		{
-			if (!audioData.isValid())
-			{
-				durationInSeconds = 0;
-				clear();
-
-				return;
-			}
-
-			durationInSeconds =
-			    static_cast<float>(audioData.frameCount) / static_cast<float>(audioData.sampleRate);
-
-			if (mips[0].powerOfTwoSampleCount != 0)
-				for (auto& mip : mips)
-					mip.clear();
-
-			WaveformMip& baseMip = mips[0];
-			baseMip.powerOfTwoSampleCount =
-			    MikuMikuWorld::roundUpToPowerOfTwo(audioData.frameCount);
-			baseMip.secondsPerSample = 1.0 / static_cast<double>(audioData.sampleRate);
-			baseMip.samplesPerSecond = audioData.sampleRate;
-
-			baseMip.powerOfTwoSampleCount /= 2;
-			baseMip.secondsPerSample *= 2.0;
-			baseMip.samplesPerSecond /= 2.0;
-			baseMip.absoluteSamples.resize(baseMip.powerOfTwoSampleCount);
-			const size_t samplesToFill = std::min(baseMip.absoluteSamples.size(),
-			                                      static_cast<size_t>(audioData.frameCount / 2));
-
-			// The original full samples are already included in the sample buffer
-			// So we'll skip processing the full data mip to reduce memory usage
-			for (size_t frameIndex = 0; frameIndex < samplesToFill; frameIndex++)
-			{
-				int16_t sampleA =
-				    audioData
-				        .samples[((frameIndex * 2 + 0) * audioData.channelCount) + channelIndex];
-				int16_t sampleB =
-				    audioData
-				        .samples[((frameIndex * 2 + 1) * audioData.channelCount) + channelIndex];
-				baseMip.absoluteSamples[frameIndex] =
-				    averageTwoInt16Samples(abs(sampleA), abs(sampleB));
-			}
-
-			// First loop to calculate sample counts
-			for (size_t i = 1; i < maxMipLevels; i++)
-			{
-				const WaveformMip& parentMip = mips[i - 1];
-				if (parentMip.powerOfTwoSampleCount <= minMipSamples)
-					break;
-
-				WaveformMip& newMip = mips[i];
-				newMip.powerOfTwoSampleCount = parentMip.powerOfTwoSampleCount / 2;
-				newMip.secondsPerSample = parentMip.secondsPerSample * 2.0;
-				newMip.samplesPerSecond = parentMip.samplesPerSecond / 2.0;
-			}
-
-			// Second loop to generate the actual mip sample buffers
-			for (size_t i = 1; i < maxMipLevels; i++)
-			{
-				const WaveformMip& parentMip = mips[i - 1];
-				if (parentMip.powerOfTwoSampleCount == 0)
-					break;
-
-				const size_t parentSampleCount = parentMip.absoluteSamples.size();
-				const int16_t* parentSamples = parentMip.absoluteSamples.data();
-
-				WaveformMip& currentMip = mips[i];
-				currentMip.absoluteSamples.resize(currentMip.powerOfTwoSampleCount);
-				const size_t samplesToFill =
-				    std::min(currentMip.absoluteSamples.size(), parentSampleCount / 2);
-
-				for (size_t index = 0; index < samplesToFill; index++)
-				{
-					currentMip.absoluteSamples[index] =
-					    averageTwoInt16Samples(parentSamples[0], parentSamples[1]);
-					parentSamples += 2;
-				}
-			}
-		}
+		/**
+		 * @brief Build the mips of one channel on a worker thread.
+		 * Levels become visible progressively as chunks of the track complete.
+		 */
+		void generateMipChainsFromSampleBuffer(const SoundBuffer& audioData, uint32_t channelIndex);
+
+		/**
+		 * @brief Build the mips of one channel from frames decoded elsewhere (ex. while the music
+		 * is streamed) so the whole track never has to be held in memory.
+		 * appendFrames and finishStream must be called from a single thread.
+		 */
+		void beginStream(uint64_t frameCount, uint32_t sampleRate, uint32_t channelIndex);
+		void appendFrames(const int16_t* samples, uint32_t channelCount, size_t frameCount);
+		void finishStream();
+
+		/**
+		 * @brief Read the base peaks from the audio cache on a worker thread and rebuild the
+		 * coarser levels from them
+		 */
+		void loadCachedPeaks(uint64_t hash, uint64_t frameCount, uint32_t sampleRate,
+		                     uint32_t channelIndex);
 	};
 }
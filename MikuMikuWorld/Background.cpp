@@ -1,35 +1,51 @@
 #include "Background.h"
-#include "Math.h"
-#include "ResourceManager.h"
-#include "Rendering/Renderer.h"
-#include "Rendering/Framebuffer.h"
+#include "File.h"
+#include <algorithm>
+#include <cmath>
 
 namespace MikuMikuWorld
 {
 	Background::Background()
-	    : blur{ 0.0f }, brightness{ 0.4f }, width{ 0 }, height{ 0 }, dirty{ false }
+	    : blur{ 0.0f }, brightness{ 0.4f }, width{ 0 }, height{ 0 }, sizeBucket{ 0 },
+	      dirty{ false }
 	{
-		framebuffer = std::make_unique<Framebuffer>(1, 1);
 	}
 
 	void Background::load(const std::string& filename)
 	{
 		this->filename = filename;
-		if (texture)
+		if (pendingImage)
 		{
-			texture->dispose();
-			texture = nullptr;
+			pendingImage->cancel();
+			pendingImage = nullptr;
 		}
 
 		if (filename.empty() || !IO::File::exists(filename))
+		{
+			disposeTexture();
+			dirty = false;
 			return;
-
-		texture = std::make_unique<Texture>(filename);
-		framebuffer->resize(texture->getWidth(), texture->getHeight());
+		}
 
 		dirty = true;
 	}
 
+	void Background::update()
+	{
+		if (pendingImage == nullptr || !pendingImage->isFinished())
+			return;
+
+		disposeTexture();
+		if (pendingImage->isValid())
+		{
+			texture = std::make_unique<Texture>(filename, pendingImage->width,
+			                                    pendingImage->height, pendingImage->pixels.data());
+			updateDisplaySize();
+		}
+
+		pendingImage = nullptr;
+	}
+
 	void Background::resizeByRatio(float& w, float& h, const Vector2& tgt, bool vertical)
 	{
 		if (vertical)
@@ -48,7 +64,24 @@ namespace MikuMikuWorld
 
 	void Background::resize(Vector2 target)
 	{
-		if (framebuffer == nullptr || texture == nullptr)
+		this->target = target;
+
+		const float largestSide = std::max(target.x, target.y);
+		const int bucket = std::max(
+		    static_cast<int>(std::ceil(largestSide / sizeBucketStep)) * sizeBucketStep,
+		    sizeBucketStep);
+		if (bucket != sizeBucket)
+		{
+			sizeBucket = bucket;
+			dirty = !filename.empty();
+		}
+
+		updateDisplaySize();
+	}
+
+	void Background::updateDisplaySize()
+	{
+		if (texture == nullptr || target.x <= 0 || target.y <= 0)
 			return;
 
 		float w = texture->getWidth();
@@ -72,40 +105,18 @@ namespace MikuMikuWorld
 		height = h;
 	}
 
-	void Background::process(Renderer* renderer)
+	void Background::process()
 	{
-		if (framebuffer == nullptr || texture == nullptr)
-			return;
-
-		int s = ResourceManager::getShader("basic2d");
-		if (s == -1)
-			return;
-
-		int w = texture->getWidth();
-		int h = texture->getHeight();
-
-		if (w < 1 || h < 1)
+		dirty = false;
+		if (filename.empty() || sizeBucket < 1)
 			return;
 
-		Shader* blur = ResourceManager::shaders[s];
-		blur->use();
-		blur->setMatrix4("projection", DirectX::XMMatrixOrthographicRH(w, -h, 0.001f, 100));
-
-		framebuffer->bind();
-		framebuffer->clear();
-		renderer->beginBatch();
-
-		// align background quad to canvas position
-		Vector2 posR;
-		Vector2 size(w, h);
-		Color tint(brightness, brightness, brightness, 1.0f);
+		if (pendingImage)
+			pendingImage->cancel();
 
-		renderer->drawSprite(posR, 0.0f, size, AnchorType::MiddleCenter, *texture, 0, tint);
-		renderer->endBatch();
-		glDisable(GL_DEPTH_TEST);
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-		dirty = false;
+		// Rounded so nearby slider values share cache entries
+		const float blurRadius = std::round(blur * 100.0f) / 100.0f * maxBlurRadius * sizeBucket;
+		pendingImage = ImageLoader::request(filename, sizeBucket, blurRadius, true);
 	}
 
 	std::string Background::getFilename() const { return filename; }
@@ -114,38 +125,39 @@ namespace MikuMikuWorld
 
 	int Background::getHeight() const { return height; }
 
-	int Background::getTextureID() const { return framebuffer->getTexture(); }
+	int Background::getTextureID() const { return texture ? texture->getID() : 0; }
 
 	float Background::getBlur() const { return blur; }
 
 	void Background::setBlur(float b)
 	{
 		blur = b;
-		dirty = true;
+		dirty = !filename.empty();
 	}
 
 	float Background::getBrightness() const { return brightness; }
 
-	void Background::setBrightness(float b)
-	{
-		brightness = b;
-		dirty = true;
-	}
+	void Background::setBrightness(float b) { brightness = b; }
 
 	bool Background::isDirty() const { return dirty; }
 
-	void Background::dispose()
+	void Background::disposeTexture()
 	{
-		if (framebuffer)
-		{
-			framebuffer->dispose();
-			framebuffer = nullptr;
-		}
-
 		if (texture)
 		{
 			texture->dispose();
 			texture = nullptr;
 		}
 	}
+
+	void Background::dispose()
+	{
+		if (pendingImage)
+		{
+			pendingImage->cancel();
+			pendingImage = nullptr;
+		}
+
+		disposeTexture();
+	}
 }
@@ -1,39 +1,57 @@
 #pragma once
 #include "Rendering/Texture.h"
-#include "Rendering/Framebuffer.h"
+#include "ImageLoader.h"
+#include "Math.h"
 #include <string>
 #include <memory>
 
 namespace MikuMikuWorld
 {
-	class Renderer;
 	class Texture;
-	struct Vector2;
 
 	class Background
 	{
 	  private:
 		std::string filename;
 		std::unique_ptr<Texture> texture;
-		std::unique_ptr<Framebuffer> framebuffer;
+		std::shared_ptr<ImageRequest> pendingImage;
+
+		// The processed image is regenerated only when the timeline crosses a multiple of this
+		static constexpr int sizeBucketStep = 512;
+		// Blur radius at full blur, relative to the size bucket
+		static constexpr float maxBlurRadius = 0.02f;
 
 		float blur;
 		float brightness;
 
 		float width;
 		float height;
+		Vector2 target;
+		int sizeBucket;
 
 		bool dirty;
 		bool useJacketBg;
 
 		void resizeByRatio(float& w, float& h, const Vector2& tgt, bool vertical);
+		void updateDisplaySize();
+		void disposeTexture();
 
 	  public:
 		Background();
 
+		/**
+		 * @brief Marks the image for processing, the current image stays visible until update
+		 * picks up the processed one
+		 */
 		void load(const std::string& filename);
+		void update();
 		void resize(Vector2 target);
-		void process(Renderer* renderer);
+
+		/**
+		 * @brief Requests the image blurred for the current size bucket from the image loader.
+		 * Results are kept in the texture cache so the same settings are never processed twice.
+		 */
+		void process();
 		void dispose();
 
 		std::string getFilename() const;
@@ -45,9 +63,11 @@ namespace MikuMikuWorld
 		float getBlur() const;
 		void setBlur(float b);
 
+		// Applied as a tint when drawing so changing it never reprocesses the image
 		float getBrightness() const;
 		void setBrightness(float b);
 
 		bool isDirty() const;
+		inline bool isLoading() const { return pendingImage != nullptr; }
 	};
 }
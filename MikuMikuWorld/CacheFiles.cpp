@@ -0,0 +1,120 @@
+#include "CacheFiles.h"
+#include "IO.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+namespace IO
+{
+	namespace
+	{
+		std::filesystem::path toPath(const std::string& filename)
+		{
+			return std::filesystem::path(mbToWideStr(filename));
+		}
+	}
+
+	uint64_t CacheFiles::hashBytes(const void* data, size_t size, uint64_t hash)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; ++i)
+			hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+
+		return hash;
+	}
+
+	uint64_t CacheFiles::hashFile(const std::string& filename)
+	{
+		if (filename.empty())
+			return 0;
+
+		std::ifstream file(toPath(filename), std::ios::binary);
+		if (!file)
+			return 0;
+
+		// Read in blocks since music files can be large
+		uint64_t hash = hashSeed;
+		std::vector<char> buffer(size_t{ 1 } << 20);
+		while (file)
+		{
+			file.read(buffer.data(), buffer.size());
+			hash = hashBytes(buffer.data(), static_cast<size_t>(file.gcount()), hash);
+		}
+
+		return hash;
+	}
+
+	bool CacheFiles::write(const std::string& filename, std::initializer_list<Bytes> parts)
+	{
+		const std::filesystem::path tempPath = toPath(filename + ".tmp");
+		std::ofstream file(tempPath, std::ios::binary);
+		for (const Bytes& part : parts)
+		{
+			if (!file.write(static_cast<const char*>(part.data), part.size))
+				return false;
+		}
+
+		file.close();
+		std::error_code error;
+		std::filesystem::rename(tempPath, toPath(filename), error);
+		return !error;
+	}
+
+	void CacheFiles::touch(const std::string& filename)
+	{
+		std::error_code error;
+		std::filesystem::last_write_time(toPath(filename),
+		                                 std::filesystem::file_time_type::clock::now(), error);
+	}
+
+	void CacheFiles::evict(const std::string& directory, uint64_t maxSize)
+	{
+		struct CacheEntry
+		{
+			std::vector<std::pair<std::filesystem::path, uint64_t>> files;
+			std::filesystem::file_time_type lastUsed{ std::filesystem::file_time_type::min() };
+		};
+
+		std::error_code error;
+		std::unordered_map<std::wstring, CacheEntry> entries;
+		uint64_t totalSize = 0;
+		for (const auto& file : std::filesystem::directory_iterator(toPath(directory), error))
+		{
+			if (!file.is_regular_file(error))
+				continue;
+
+			const std::wstring name = file.path().filename().wstring();
+			CacheEntry& entry = entries[name.substr(0, name.find(L'.'))];
+			const uint64_t size = file.file_size(error);
+			entry.files.emplace_back(file.path(), size);
+			entry.lastUsed = std::max(entry.lastUsed, file.last_write_time(error));
+			totalSize += size;
+		}
+
+		if (totalSize <= maxSize)
+			return;
+
+		std::vector<CacheEntry*> sorted;
+		sorted.reserve(entries.size());
+		for (auto& [key, entry] : entries)
+			sorted.push_back(&entry);
+
+		std::sort(sorted.begin(), sorted.end(), [](const CacheEntry* a, const CacheEntry* b)
+		          { return a->lastUsed < b->lastUsed; });
+
+		// Files still in use (ex. the wav being played) fail to delete and are simply kept
+		for (const CacheEntry* entry : sorted)
+		{
+			if (totalSize <= maxSize)
+				break;
+
+			for (const auto& [path, size] : entry->files)
+			{
+				if (std::filesystem::remove(path, error))
+					totalSize -= size;
+			}
+		}
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+
+namespace IO
+{
+	/**
+	 * @brief File handling shared by the on-disk caches (ex. decoded audio and textures)
+	 */
+	class CacheFiles
+	{
+	  public:
+		static constexpr uint64_t hashSeed{ 0xcbf29ce484222325ull };
+
+		struct Bytes
+		{
+			const void* data{};
+			size_t size{};
+		};
+
+		/**
+		 * @brief FNV-1a hash of some bytes, pass the previous hash to continue it
+		 */
+		static uint64_t hashBytes(const void* data, size_t size, uint64_t hash = hashSeed);
+
+		/**
+		 * @brief Hash the contents of a file, 0 if it can't be read
+		 */
+		static uint64_t hashFile(const std::string& filename);
+
+		/**
+		 * @brief Write the parts to a temporary file first so a crash never leaves a truncated
+		 * entry behind
+		 */
+		static bool write(const std::string& filename, std::initializer_list<Bytes> parts);
+
+		/**
+		 * @brief Mark an entry as recently used for the eviction
+		 */
+		static void touch(const std::string& filename);
+
+		/**
+		 * @brief Delete the least recently used entries until a directory fits a size limit.
+		 * Files named after the same key (the part before the first dot) are one entry and go
+		 * together.
+		 */
+		static void evict(const std::string& directory, uint64_t maxSize);
+	};
+}
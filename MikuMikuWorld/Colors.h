@@ -22,6 +22,11 @@ namespace MikuMikuWorld
 		ImGui::ColorConvertFloat4ToU32(ImVec4(0.16f, 0.33f, 0.64f, 0.70f));
 	const ImU32 feverColor = ImGui::ColorConvertFloat4ToU32(ImVec4(0.90f, 0.54f, 0.28f, 1.00f));
 	const ImU32 waypointColor = ImGui::ColorConvertFloat4ToU32(ImVec4(0.90f, 0.90f, 0.90f, 1.00f));
+	const ImU32 loopColor = ImGui::ColorConvertFloat4ToU32(ImVec4(0.30f, 0.75f, 0.95f, 1.00f));
+	const ImU32 loopRegionColor =
+	    ImGui::ColorConvertFloat4ToU32(ImVec4(0.30f, 0.75f, 0.95f, 0.12f));
+	const ImU32 inactiveLoopRegionColor =
+	    ImGui::ColorConvertFloat4ToU32(ImVec4(0.50f, 0.50f, 0.50f, 0.10f));
 	const ImU32 selectionColor1 =
 	    ImGui::ColorConvertFloat4ToU32(ImVec4(0.40f, 0.40f, 0.40f, 0.45f));
 	const ImU32 selectionColor2 =
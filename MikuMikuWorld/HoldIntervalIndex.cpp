@@ -0,0 +1,126 @@
+#include "HoldIntervalIndex.h"
+#include "Score.h"
+#include <algorithm>
+
+namespace MikuMikuWorld
+{
+	void HoldIntervalIndex::build(const Score& score)
+	{
+		intervals.clear();
+		intervals.reserve(score.holdNotes.size());
+		for (const auto& [id, hold] : score.holdNotes)
+		{
+			const int startTick = score.notes.at(hold.start.ID).tick;
+			const int endTick = score.notes.at(hold.end).tick;
+
+			// Steps are normally between both ends but their ticks are not guaranteed to be
+			Interval interval{ std::min(startTick, endTick), std::max(startTick, endTick), 0, id };
+			for (const auto& step : hold.steps)
+			{
+				const int tick = score.notes.at(step.ID).tick;
+				interval.start = std::min(interval.start, tick);
+				interval.end = std::max(interval.end, tick);
+			}
+
+			interval.maxEnd = interval.end;
+			intervals.push_back(interval);
+		}
+
+		std::sort(intervals.begin(), intervals.end(), [](const Interval& a, const Interval& b)
+		          { return a.start < b.start || (a.start == b.start && a.id < b.id); });
+
+		// Nodes at level k are the indices with exactly k trailing ones.
+		// Leaves (even indices) keep their own end, then each level aggregates its two children.
+		maxLevel = -1;
+		const size_t count = intervals.size();
+		if (count == 0)
+		{
+			dirty = false;
+			return;
+		}
+
+		size_t lastIndex = 0;
+		int lastMax = 0;
+		for (size_t i = 0; i < count; i += 2)
+		{
+			lastIndex = i;
+			lastMax = intervals[i].maxEnd;
+		}
+		maxLevel = 0;
+
+		for (int level = 1; (size_t{ 1 } << level) <= count; ++level)
+		{
+			const size_t x = size_t{ 1 } << (level - 1);
+			const size_t step = x << 2;
+			for (size_t i = (x << 1) - 1; i < count; i += step)
+			{
+				int maxEnd = std::max(intervals[i - x].maxEnd, intervals[i].end);
+				const int right = i + x < count ? intervals[i + x].maxEnd : lastMax;
+				maxEnd = std::max(maxEnd, right);
+				intervals[i].maxEnd = maxEnd;
+			}
+
+			// The rightmost node climbs to its parent, which may lie past the end of the array
+			lastIndex = ((lastIndex >> level) & 1) ? lastIndex - x : lastIndex + x;
+			if (lastIndex < count)
+				lastMax = std::max(lastMax, intervals[lastIndex].maxEnd);
+
+			maxLevel = level;
+		}
+
+		dirty = false;
+	}
+
+	size_t HoldIntervalIndex::query(int startTick, int endTick, std::vector<id_t>& result) const
+	{
+		if (maxLevel < 0 || startTick > endTick)
+			return 0;
+
+		struct Frame
+		{
+			size_t index;
+			int level;
+			bool leftDone;
+		};
+
+		const size_t count = intervals.size();
+		const size_t previousSize = result.size();
+
+		Frame stack[64];
+		int top = 0;
+		stack[top++] = { (size_t{ 1 } << maxLevel) - 1, maxLevel, false };
+		while (top > 0)
+		{
+			const Frame frame = stack[--top];
+			if (frame.level < 2)
+			{
+				// Small subtree: scan its three intervals at most
+				const size_t first = frame.index >> frame.level << frame.level;
+				const size_t last = std::min(first + (size_t{ 1 } << (frame.level + 1)) - 1, count);
+				for (size_t i = first; i < last && intervals[i].start <= endTick; ++i)
+				{
+					if (intervals[i].end >= startTick)
+						result.push_back(intervals[i].id);
+				}
+			}
+			else if (!frame.leftDone)
+			{
+				// Visit the left child only if something in it can still reach startTick
+				const size_t left = frame.index - (size_t{ 1 } << (frame.level - 1));
+				stack[top++] = { frame.index, frame.level, true };
+				if (left >= count || intervals[left].maxEnd >= startTick)
+					stack[top++] = { left, frame.level - 1, false };
+			}
+			else if (frame.index < count && intervals[frame.index].start <= endTick)
+			{
+				if (intervals[frame.index].end >= startTick)
+					result.push_back(intervals[frame.index].id);
+
+				stack[top++] = { frame.index + (size_t{ 1 } << (frame.level - 1)), frame.level - 1,
+					             false };
+			}
+		}
+
+		return result.size() - previousSize;
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "Constants.h"
+#include <cstddef>
+#include <vector>
+
+namespace MikuMikuWorld
+{
+	struct Score;
+
+	/**
+	 * @brief Implicit augmented interval tree over the tick span of every hold in a score.
+	 * Intervals are kept sorted by their first tick, each node stores the furthest tick
+	 * reached by its subtree so whole branches outside a query range are skipped.
+	 */
+	class HoldIntervalIndex
+	{
+	  private:
+		struct Interval
+		{
+			int start;
+			int end;
+			int maxEnd;
+			id_t id;
+		};
+
+		std::vector<Interval> intervals;
+		int maxLevel{ -1 };
+		bool dirty{ true };
+
+	  public:
+		void build(const Score& score);
+		void invalidate() { dirty = true; }
+		constexpr inline bool isDirty() const { return dirty; }
+
+		/**
+		 * @brief Collect the IDs of all holds overlapping the inclusive range [startTick, endTick]
+		 * @return The number of holds appended to result
+		 */
+		size_t query(int startTick, int endTick, std::vector<id_t>& result) const;
+
+		size_t size() const { return intervals.size(); }
+	};
+}
@@ -0,0 +1,305 @@
+#include "ImageLoader.h"
+#include "Application.h"
+#include "IO.h"
+#include "Rendering/TextureCache.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <execution>
+#include <filesystem>
+#include <numeric>
+
+namespace MikuMikuWorld
+{
+	std::thread ImageLoader::worker;
+	std::mutex ImageLoader::mutex;
+	std::condition_variable ImageLoader::condition;
+	std::deque<std::shared_ptr<ImageRequest>> ImageLoader::queue;
+	bool ImageLoader::stopping{ false };
+	ImageLoader::ScaledImage ImageLoader::lastImage;
+
+	namespace
+	{
+		std::vector<int> iotaVector(int count)
+		{
+			std::vector<int> values(count);
+			std::iota(values.begin(), values.end(), 0);
+			return values;
+		}
+
+		int64_t getWriteTime(const std::string& filename)
+		{
+			std::error_code error;
+			return std::filesystem::last_write_time(IO::mbToWideStr(filename), error)
+			    .time_since_epoch()
+			    .count();
+		}
+
+		// Running sum box blur with clamped edges
+		void boxBlurRow(const uint8_t* source, uint8_t* destination, int width, int radius)
+		{
+			auto pixelAt = [&](int x)
+			{ return source + static_cast<size_t>(std::clamp(x, 0, width - 1)) * 4; };
+
+			const uint32_t size = radius * 2 + 1;
+			uint32_t sum[4]{};
+			for (int x = -radius; x <= radius; ++x)
+			{
+				const uint8_t* pixel = pixelAt(x);
+				for (int c = 0; c < 4; ++c)
+					sum[c] += pixel[c];
+			}
+
+			for (int x = 0; x < width; ++x)
+			{
+				const uint8_t* added = pixelAt(x + radius + 1);
+				const uint8_t* removed = pixelAt(x - radius);
+				for (int c = 0; c < 4; ++c)
+				{
+					destination[x * 4 + c] = static_cast<uint8_t>((sum[c] + size / 2) / size);
+					sum[c] = sum[c] + added[c] - removed[c];
+				}
+			}
+		}
+
+		void boxBlurRows(const uint8_t* input, uint8_t* output, int width, int rowCount,
+		                 int radius)
+		{
+			const std::vector<int> rows = iotaVector(rowCount);
+			std::for_each(std::execution::par, rows.begin(), rows.end(),
+			              [&](int y)
+			              {
+				              const size_t offset = static_cast<size_t>(y) * width * 4;
+				              boxBlurRow(input + offset, output + offset, width, radius);
+			              });
+		}
+
+		// Columns are blurred as rows of the transposed image to stay cache friendly
+		void transpose(const uint8_t* input, uint8_t* output, int width, int height)
+		{
+			const std::vector<int> columns = iotaVector(width);
+			std::for_each(std::execution::par, columns.begin(), columns.end(),
+			              [&](int x)
+			              {
+				              uint8_t* destination = output + static_cast<size_t>(x) * height * 4;
+				              for (int y = 0; y < height; ++y)
+					              std::memcpy(destination + static_cast<size_t>(y) * 4,
+					                          input + (static_cast<size_t>(y) * width + x) * 4, 4);
+			              });
+		}
+	}
+
+	std::shared_ptr<ImageRequest> ImageLoader::request(const std::string& filename,
+	                                                   int targetSize, float blurRadius,
+	                                                   bool useCache)
+	{
+		auto request = std::make_shared<ImageRequest>(filename, targetSize, blurRadius, useCache);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!worker.joinable())
+			{
+				stopping = false;
+				worker = std::thread(&ImageLoader::run);
+			}
+
+			queue.push_back(request);
+		}
+
+		condition.notify_one();
+		return request;
+	}
+
+	void ImageLoader::run()
+	{
+		while (true)
+		{
+			std::shared_ptr<ImageRequest> request;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [] { return stopping || !queue.empty(); });
+				if (stopping)
+					return;
+
+				request = std::move(queue.front());
+				queue.pop_front();
+			}
+
+			if (!request->cancelled)
+				process(*request);
+
+			request->finished.store(true, std::memory_order_release);
+			if (!request->cancelled)
+				Application::requestRedraw();
+		}
+	}
+
+	bool ImageLoader::decode(const std::string& filename, int targetSize)
+	{
+		const int64_t writeTime = getWriteTime(filename);
+		if (!lastImage.pixels.empty() && lastImage.filename == filename &&
+		    lastImage.targetSize == targetSize && lastImage.writeTime == writeTime)
+			return true;
+
+		lastImage = {};
+		int width{}, height{}, channels{};
+		uint8_t* data = stbi_load(filename.c_str(), &width, &height, &channels, 4);
+		if (!data)
+			return false;
+
+		const int largestSide = std::max(width, height);
+		const int factor = targetSize > 0 ? std::max(largestSide / targetSize, 1) : 1;
+		if (factor > 1)
+		{
+			downscale(data, width, height, factor, lastImage.pixels);
+			lastImage.width = std::max(width / factor, 1);
+			lastImage.height = std::max(height / factor, 1);
+		}
+		else
+		{
+			lastImage.pixels.assign(data, data + static_cast<size_t>(width) * height * 4);
+			lastImage.width = width;
+			lastImage.height = height;
+		}
+
+		stbi_image_free(data);
+		lastImage.filename = filename;
+		lastImage.targetSize = targetSize;
+		lastImage.writeTime = writeTime;
+		return true;
+	}
+
+	void ImageLoader::process(ImageRequest& request)
+	{
+		const std::string variant =
+		    request.useCache
+		        ? IO::formatString("size%d_blur%.2f", request.targetSize, request.blurRadius)
+		        : "";
+
+		TextureCache::Entry entry;
+		if (request.useCache && TextureCache::load(request.filename, "", entry, variant))
+		{
+			request.width = entry.width;
+			request.height = entry.height;
+			request.pixels = std::move(entry.pixels);
+			return;
+		}
+
+		if (!decode(request.filename, request.targetSize) || request.cancelled)
+			return;
+
+		request.width = lastImage.width;
+		request.height = lastImage.height;
+		request.pixels = lastImage.pixels;
+		if (request.blurRadius > 0.0f)
+			gaussianBlur(request.pixels, request.width, request.height, request.blurRadius);
+
+		// Superseded results are likely intermediate slider values, don't fill the cache with them
+		if (!request.useCache || request.cancelled)
+			return;
+
+		entry.width = request.width;
+		entry.height = request.height;
+		entry.pixels = std::move(request.pixels);
+		TextureCache::save(request.filename, "", entry, variant);
+		request.pixels = std::move(entry.pixels);
+	}
+
+	void ImageLoader::downscale(const uint8_t* input, int width, int height, int factor,
+	                            std::vector<uint8_t>& output)
+	{
+		const int outputWidth = std::max(width / factor, 1);
+		const int outputHeight = std::max(height / factor, 1);
+		const int blockWidth = std::min(factor, width);
+		const int blockHeight = std::min(factor, height);
+		const uint32_t blockArea = static_cast<uint32_t>(blockWidth) * blockHeight;
+		output.resize(static_cast<size_t>(outputWidth) * outputHeight * 4);
+
+		const std::vector<int> rows = iotaVector(outputHeight);
+		std::for_each(
+		    std::execution::par, rows.begin(), rows.end(),
+		    [&](int y)
+		    {
+			    uint8_t* outputRow = output.data() + static_cast<size_t>(y) * outputWidth * 4;
+			    for (int x = 0; x < outputWidth; ++x)
+			    {
+				    uint32_t sum[4]{};
+				    for (int by = 0; by < blockHeight; ++by)
+				    {
+					    const uint8_t* source =
+					        input + ((static_cast<size_t>(y) * blockHeight + by) * width +
+					                 static_cast<size_t>(x) * blockWidth) *
+					                    4;
+					    for (int bx = 0; bx < blockWidth * 4; bx += 4)
+					    {
+						    sum[0] += source[bx + 0];
+						    sum[1] += source[bx + 1];
+						    sum[2] += source[bx + 2];
+						    sum[3] += source[bx + 3];
+					    }
+				    }
+
+				    for (int c = 0; c < 4; ++c)
+					    outputRow[x * 4 + c] =
+					        static_cast<uint8_t>((sum[c] + blockArea / 2) / blockArea);
+			    }
+		    });
+	}
+
+	void ImageLoader::gaussianBlur(std::vector<uint8_t>& pixels, int width, int height,
+	                               float sigma)
+	{
+		if (sigma <= 0.0f || width < 1 || height < 1)
+			return;
+
+		// Box sizes whose three passes best match the gaussian's variance
+		constexpr int passes = 3;
+		const float variance = 12.0f * sigma * sigma;
+		int lowerSize = static_cast<int>(std::floor(std::sqrt(variance / passes + 1.0f)));
+		if (lowerSize % 2 == 0)
+			lowerSize--;
+
+		const int upperSize = lowerSize + 2;
+		const int lowerPasses = static_cast<int>(
+		    std::round((variance - passes * lowerSize * lowerSize - 4 * passes * lowerSize -
+		                3 * passes) /
+		               (-4.0f * lowerSize - 4.0f)));
+
+		std::vector<uint8_t> temp(pixels.size());
+		auto blurRows = [&](int rowWidth, int rowCount)
+		{
+			for (int pass = 0; pass < passes; ++pass)
+			{
+				const int size = pass < lowerPasses ? lowerSize : upperSize;
+				boxBlurRows(pixels.data(), temp.data(), rowWidth, rowCount, (size - 1) / 2);
+				pixels.swap(temp);
+			}
+		};
+
+		blurRows(width, height);
+		transpose(pixels.data(), temp.data(), width, height);
+		pixels.swap(temp);
+
+		blurRows(height, width);
+		transpose(pixels.data(), temp.data(), height, width);
+		pixels.swap(temp);
+	}
+
+	void ImageLoader::shutdown()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+			for (auto& request : queue)
+				request->cancel();
+
+			queue.clear();
+		}
+
+		condition.notify_one();
+		if (worker.joinable())
+			worker.join();
+
+		lastImage = {};
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace MikuMikuWorld
+{
+	class ImageRequest
+	{
+	  private:
+		std::atomic<bool> cancelled{ false };
+		std::atomic<bool> finished{ false };
+
+		friend class ImageLoader;
+
+	  public:
+		const std::string filename;
+		// Images are downscaled by the largest integer factor keeping them at least this big
+		const int targetSize;
+		// Standard deviation of the gaussian blur in output pixels, 0 disables the blur
+		const float blurRadius;
+		// Whether to keep the result in the texture cache (only worth it for processed images)
+		const bool useCache;
+
+		// Only valid once the request is finished
+		int width{};
+		int height{};
+		std::vector<uint8_t> pixels;
+
+		ImageRequest(const std::string& filename, int targetSize, float blurRadius, bool useCache)
+		    : filename{ filename }, targetSize{ targetSize }, blurRadius{ blurRadius },
+		      useCache{ useCache }
+		{
+		}
+
+		inline bool isFinished() const { return finished.load(std::memory_order_acquire); }
+		inline bool isValid() const { return isFinished() && !pixels.empty(); }
+		inline void cancel() { cancelled = true; }
+	};
+
+	/**
+	 * @brief Decodes images on a worker thread so large jackets and backgrounds don't stall
+	 * the UI. The GPU upload is left to the owner of the request once it is finished.
+	 */
+	class ImageLoader
+	{
+	  private:
+		struct ScaledImage
+		{
+			std::string filename;
+			int targetSize{};
+			int64_t writeTime{};
+			int width{};
+			int height{};
+			std::vector<uint8_t> pixels;
+		};
+
+		static std::thread worker;
+		static std::mutex mutex;
+		static std::condition_variable condition;
+		static std::deque<std::shared_ptr<ImageRequest>> queue;
+		static bool stopping;
+
+		// Last decoded image, only touched by the worker. Lets repeated requests for the same
+		// image (ex. while dragging the blur slider) skip decoding.
+		static ScaledImage lastImage;
+
+		static void run();
+		static void process(ImageRequest& request);
+		static bool decode(const std::string& filename, int targetSize);
+
+	  public:
+		/**
+		 * @brief Queue an image to be decoded, downscaled and optionally blurred
+		 */
+		static std::shared_ptr<ImageRequest> request(const std::string& filename, int targetSize,
+		                                             float blurRadius = 0.0f,
+		                                             bool useCache = false);
+
+		/**
+		 * @brief Box filter an RGBA image down by an integer factor
+		 */
+		static void downscale(const uint8_t* input, int width, int height, int factor,
+		                      std::vector<uint8_t>& output);
+
+		/**
+		 * @brief Approximate a gaussian blur of an RGBA image with three separable box blurs
+		 */
+		static void gaussianBlur(std::vector<uint8_t>& pixels, int width, int height,
+		                         float sigma);
+
+		static void shutdown();
+	};
+}
@@ -13,35 +13,53 @@ namespace MikuMikuWorld
 
 	Jacket::Jacket() { clear(); }
 
-	void Jacket::load(const std::string& filename)
+	void Jacket::disposeTexture()
 	{
-		this->filename = filename;
 		if (texture)
 		{
 			texture->dispose();
 			texture = nullptr;
 		}
 
+		if (pendingImage)
+		{
+			pendingImage->cancel();
+			pendingImage = nullptr;
+		}
+	}
+
+	void Jacket::load(const std::string& filename)
+	{
+		this->filename = filename;
+		disposeTexture();
+
 		if (filename.empty() || !IO::File::exists(filename))
 			return;
 
-		texture = std::make_unique<Texture>(filename);
+		pendingImage = ImageLoader::request(filename, targetImageSize);
 	}
 
-	void Jacket::clear()
+	void Jacket::update()
 	{
-		if (texture)
-		{
-			texture->dispose();
-			texture = nullptr;
-		}
+		if (pendingImage == nullptr || !pendingImage->isFinished())
+			return;
 
+		if (pendingImage->isValid())
+			texture = std::make_unique<Texture>(filename, pendingImage->width,
+			                                    pendingImage->height, pendingImage->pixels.data());
+
+		pendingImage = nullptr;
+	}
+
+	void Jacket::clear()
+	{
+		disposeTexture();
 		filename = "";
 	}
 
 	void Jacket::draw()
 	{
-		if (texture == nullptr)
+		if (texture == nullptr && !isLoading())
 			return;
 
 		if (ImGui::IsItemHovered() && GImGui->HoveredIdTimer > 0.3f)
@@ -55,10 +73,26 @@ namespace MikuMikuWorld
 			ImGui::SetNextWindowBgAlpha(color.w);
 
 			ImGui::BeginTooltip();
-			ImGui::GetWindowDrawList()->AddImage(
-			    (void*)texture->getID(), ImGui::GetWindowPos() + imageOffset,
-			    ImGui::GetWindowPos() + imageOffset + imageSize, ImVec2{ 0.0, 0.0f },
-			    ImVec2{ 1.0f, 1.0f }, ImGui::ColorConvertFloat4ToU32(color));
+			const ImVec2 imageMin = ImGui::GetWindowPos() + imageOffset;
+			const ImVec2 imageMax = imageMin + imageSize;
+			if (texture)
+			{
+				ImGui::GetWindowDrawList()->AddImage(
+				    (void*)texture->getID(), imageMin, imageMax, ImVec2{ 0.0, 0.0f },
+				    ImVec2{ 1.0f, 1.0f }, ImGui::ColorConvertFloat4ToU32(color));
+			}
+			else
+			{
+				// Placeholder until the image is decoded
+				const char* text = "Loading...";
+				const ImVec2 textPos =
+				    imageMin + ((imageSize - ImGui::CalcTextSize(text)) * 0.5f);
+				ImGui::GetWindowDrawList()->AddRectFilled(
+				    imageMin, imageMax,
+				    ImGui::ColorConvertFloat4ToU32({ 0.2f, 0.2f, 0.2f, color.w }));
+				ImGui::GetWindowDrawList()->AddText(
+				    textPos, ImGui::ColorConvertFloat4ToU32({ 1.0f, 1.0f, 1.0f, color.w }), text);
+			}
 			ImGui::EndTooltip();
 		}
 	}
@@ -1,5 +1,6 @@
 #pragma once
 #include "Rendering/Texture.h"
+#include "ImageLoader.h"
 #include "ImGui/imgui.h"
 #include <memory>
 #include <string>
@@ -11,14 +12,27 @@ namespace MikuMikuWorld
 	  private:
 		std::string filename;
 		std::unique_ptr<Texture> texture;
+		std::shared_ptr<ImageRequest> pendingImage;
+
+		// Jackets are only shown in a 250x250 preview, larger images are downscaled towards this
+		static constexpr int targetImageSize = 512;
+
+		void disposeTexture();
 
 	  public:
 		Jacket();
 
+		/**
+		 * @brief Starts decoding the image in the background, the texture is created by a
+		 * later call to update once it is ready
+		 */
 		void load(const std::string& filename);
+		void update();
 		void draw();
 		void clear();
 
+		inline bool isLoading() const { return pendingImage != nullptr; }
+
 		const std::string& getFilename() const;
 		int getTexID() const;
 	};
@@ -1,4 +1,6 @@
 #include "Math.h"
+#include <algorithm>
+#include <cmath>
 
 namespace MikuMikuWorld
 {
@@ -61,6 +63,58 @@ namespace MikuMikuWorld
 		return lerp;
 	}
 
+	float getEaseCurvature(EaseType ease)
+	{
+		// Upper bound of |f''(t)| for an ease over a unit distance
+		switch (ease)
+		{
+		case EaseType::EaseIn:
+		case EaseType::EaseOut:
+			return 2.0f;
+		case EaseType::EaseInOut:
+		case EaseType::EaseOutIn:
+			return 4.0f;
+		default:
+			break;
+		}
+
+		return 0.0f;
+	}
+
+	EaseSliceRange getVisibleEaseSlices(EaseType ease, float deltaX, float startY, float endY,
+	                                    float minY, float maxY, float tolerance, int minSteps)
+	{
+		EaseSliceRange range{};
+
+		// A slice spanning h of the curve deviates from it by at most |f''| * h^2 / 8
+		const float curvature = getEaseCurvature(ease) * std::abs(deltaX);
+		if (curvature > 0 && tolerance > 0)
+			range.steps = static_cast<int>(std::ceil(std::sqrt(curvature / (8.0f * tolerance))));
+		range.steps = std::max({ range.steps, minSteps, 1 });
+
+		const float height = endY - startY;
+		if (height == 0)
+		{
+			if (isWithinRange(startY, minY, maxY))
+				range.last = range.steps - 1;
+
+			return range;
+		}
+
+		// y is linear along the curve so the visible span maps directly to a ratio range
+		float ratio1 = (minY - startY) / height;
+		float ratio2 = (maxY - startY) / height;
+		if (ratio1 > ratio2)
+			std::swap(ratio1, ratio2);
+
+		if (ratio2 < 0 || ratio1 > 1)
+			return range;
+
+		range.first = std::max(0, static_cast<int>(std::floor(ratio1 * range.steps)));
+		range.last = std::min(range.steps - 1, static_cast<int>(std::floor(ratio2 * range.steps)));
+		return range;
+	}
+
 	uint32_t gcf(uint32_t a, uint32_t b)
 	{
 		for (;;)
@@ -113,5 +113,18 @@ namespace MikuMikuWorld
 
 	std::function<float(float, float, float)> getEaseFunction(EaseType ease);
 
+	// Uniform slices of an eased segment and the subset of them that is visible
+	struct EaseSliceRange
+	{
+		int steps{ 1 };
+		int first{ 0 };
+		int last{ -1 };
+	};
+
+	float getEaseCurvature(EaseType ease);
+	EaseSliceRange getVisibleEaseSlices(EaseType ease, float deltaX, float startY, float endY,
+	                                    float minY, float maxY, float tolerance,
+	                                    int minSteps = 1);
+
 	uint32_t gcf(uint32_t a, uint32_t b);
 }
\ No newline at end of file
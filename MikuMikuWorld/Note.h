@@ -30,6 +30,10 @@ namespace MikuMikuWorld
 		                                 SE_CRITICAL_FLICK,  SE_CRITICAL_TICK, SE_CRITICAL_FRICTION,
 		                                 SE_CRITICAL_CONNECT };
 
+	// Generated instead of loaded from the sound effect profiles
+	constexpr const char* SE_METRONOME_DOWNBEAT = "metronome_downbeat";
+	constexpr const char* SE_METRONOME_BEAT = "metronome_beat";
+
 	constexpr float flickArrowWidths[] = { 0.95f, 1.25f, 1.8f, 2.3f, 2.6f, 3.2f };
 
 	constexpr float flickArrowHeights[] = { 1, 1.05f, 1.2f, 1.4f, 1.5f, 1.6f };
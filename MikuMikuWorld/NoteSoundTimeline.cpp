@@ -0,0 +1,153 @@
+#include "NoteSoundTimeline.h"
+#include "Score.h"
+
+namespace MikuMikuWorld
+{
+	void NoteSoundTimeline::build(const Score& score)
+	{
+		noteEvents.clear();
+		holdEvents.clear();
+		holdMaxEndTimes.clear();
+		noteEvents.reserve(score.notes.size());
+		holdEvents.reserve(score.holdNotes.size());
+
+		for (const auto& [id, note] : score.notes)
+		{
+			bool playSE = true;
+			if (note.getType() == NoteType::Hold)
+				playSE = score.holdNotes.at(note.ID).startType == HoldNoteType::Normal;
+			else if (note.getType() == NoteType::HoldEnd)
+				playSE = score.holdNotes.at(note.parentID).endType == HoldNoteType::Normal;
+
+			const std::string_view se = playSE ? getNoteSE(note, score) : "";
+			if (se.empty())
+				continue;
+
+			noteEvents.push_back(
+			    { accumulateDuration(note.tick, TICKS_PER_BEAT, score.tempoChanges), 0.0f, se });
+		}
+
+		for (const auto& [id, hold] : score.holdNotes)
+		{
+			if (hold.isGuide())
+				continue;
+
+			const Note& start = score.notes.at(hold.start.ID);
+			const Note& end = score.notes.at(hold.end);
+			holdEvents.push_back(
+			    { accumulateDuration(start.tick, TICKS_PER_BEAT, score.tempoChanges),
+			      accumulateDuration(end.tick, TICKS_PER_BEAT, score.tempoChanges),
+			      start.critical ? SE_CRITICAL_CONNECT : SE_CONNECT });
+		}
+
+		if (metronome)
+		{
+			float endTime = metronomeEndTime;
+			for (const Event& event : noteEvents)
+				endTime = std::max(endTime, event.time);
+			for (const Event& event : holdEvents)
+				endTime = std::max(endTime, event.endTime);
+
+			addMetronomeClicks(score, endTime);
+		}
+
+		auto byTime = [](const Event& a, const Event& b)
+		{ return a.time < b.time || (a.time == b.time && a.se < b.se); };
+		std::sort(noteEvents.begin(), noteEvents.end(), byTime);
+		std::sort(holdEvents.begin(), holdEvents.end(), byTime);
+
+		// Notes sharing a tick and a sound would only make it louder
+		noteEvents.erase(std::unique(noteEvents.begin(), noteEvents.end(),
+		                             [](const Event& a, const Event& b)
+		                             { return a.time == b.time && a.se == b.se; }),
+		                 noteEvents.end());
+
+		holdMaxEndTimes.reserve(holdEvents.size());
+		float maxEndTime = 0.0f;
+		for (const Event& event : holdEvents)
+		{
+			maxEndTime = std::max(maxEndTime, event.endTime);
+			holdMaxEndTimes.push_back(maxEndTime);
+		}
+
+		noteCursor = holdCursor = 0;
+		dirty = false;
+	}
+
+	void NoteSoundTimeline::addMetronomeClicks(const Score& score, float endTime)
+	{
+		const std::vector<Tempo>& tempos = score.tempoChanges;
+		if (tempos.empty() || score.timeSignatures.empty())
+			return;
+
+		// Each click is timed from the start of its tempo in double so none drift after a change
+		size_t tempo = 0;
+		double tempoStartTime = 0.0;
+		auto secondsPerTick = [&tempos](size_t index)
+		{
+			const double bpm = std::max(tempos[index].bpm, 1.0f);
+			return 60.0 / (bpm * TICKS_PER_BEAT);
+		};
+
+		// Ticks are visited in order so the tempo only ever moves forward
+		auto tickToSeconds = [&](int tick)
+		{
+			while (tempo + 1 < tempos.size() && tempos[tempo + 1].tick <= tick)
+			{
+				const int ticks = tempos[tempo + 1].tick - tempos[tempo].tick;
+				tempoStartTime += ticks * secondsPerTick(tempo);
+				++tempo;
+			}
+
+			return tempoStartTime + (tick - tempos[tempo].tick) * secondsPerTick(tempo);
+		};
+
+		auto signature = score.timeSignatures.begin();
+		int measureTick = 0;
+		for (int measure = signature->first;; ++measure)
+		{
+			auto next = std::next(signature);
+			if (next != score.timeSignatures.end() && next->first <= measure)
+				signature = next;
+
+			const int beatCount = std::max(signature->second.numerator, 1);
+			const int beatTicks =
+			    std::max(TICKS_PER_BEAT * 4 / std::max(signature->second.denominator, 1), 1);
+			for (int beat = 0; beat < beatCount; ++beat)
+			{
+				const double time = tickToSeconds(measureTick + beat * beatTicks);
+				if (time > endTime)
+					return;
+
+				noteEvents.push_back({ static_cast<float>(time), 0.0f,
+				                       beat == 0 ? SE_METRONOME_DOWNBEAT : SE_METRONOME_BEAT });
+			}
+
+			measureTick += beatCount * beatTicks;
+		}
+	}
+
+	void NoteSoundTimeline::setMetronome(bool enabled, float endTime)
+	{
+		if (metronome == enabled && (!enabled || metronomeEndTime == endTime))
+			return;
+
+		metronome = enabled;
+		metronomeEndTime = endTime;
+		dirty = true;
+	}
+
+	void NoteSoundTimeline::seek(float time)
+	{
+		auto firstAtOrAfter = [time](const std::vector<Event>& events)
+		{
+			auto it = std::lower_bound(events.begin(), events.end(), time,
+			                           [](const Event& event, float value)
+			                           { return event.time < value; });
+			return static_cast<size_t>(it - events.begin());
+		};
+
+		noteCursor = firstAtOrAfter(noteEvents);
+		holdCursor = firstAtOrAfter(holdEvents);
+	}
+}
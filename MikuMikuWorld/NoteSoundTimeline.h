@@ -0,0 +1,97 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+namespace MikuMikuWorld
+{
+	struct Score;
+
+	/**
+	 * @brief Hit sound effects of a score compiled into time sorted events.
+	 * Playback walks the events with a cursor so each frame only touches the events it plays.
+	 */
+	class NoteSoundTimeline
+	{
+	  public:
+		struct Event
+		{
+			// Chart time in seconds
+			float time;
+			// End of a hold's connect sound, unused by one-shot sounds
+			float endTime;
+			std::string_view se;
+		};
+
+	  private:
+		std::vector<Event> noteEvents;
+		std::vector<Event> holdEvents;
+		// Furthest end among the holds up to each index, bounds the search for active holds
+		std::vector<float> holdMaxEndTimes;
+		size_t noteCursor{};
+		size_t holdCursor{};
+		bool dirty{ true };
+		bool metronome{ false };
+		float metronomeEndTime{};
+
+		void addMetronomeClicks(const Score& score, float endTime);
+
+	  public:
+		void build(const Score& score);
+		void invalidate() { dirty = true; }
+		constexpr inline bool isDirty() const { return dirty; }
+
+		/**
+		 * @brief Click every beat along with the notes, from the start of the chart up to the
+		 * last note or a time, whichever is later. Invalidates the events if anything changed.
+		 */
+		void setMetronome(bool enabled, float endTime);
+
+		/**
+		 * @brief Move the cursors to the first events at or after a time
+		 */
+		void seek(float time);
+
+		/**
+		 * @brief Pass every event before a time, starting from the cursors
+		 * @param onNote Called with each one-shot event passed
+		 * @param onHold Called with each hold event passed
+		 */
+		template <typename NoteFunc, typename HoldFunc>
+		void advance(float time, NoteFunc&& onNote, HoldFunc&& onHold)
+		{
+			for (; noteCursor < noteEvents.size() && noteEvents[noteCursor].time < time;
+			     ++noteCursor)
+				onNote(noteEvents[noteCursor]);
+
+			for (; holdCursor < holdEvents.size() && holdEvents[holdCursor].time < time;
+			     ++holdCursor)
+				onHold(holdEvents[holdCursor]);
+		}
+
+		/**
+		 * @brief Visit the holds starting at or before startLimit that still sound after time
+		 */
+		template <typename HoldFunc>
+		void forEachActiveHold(float time, float startLimit, HoldFunc&& onHold) const
+		{
+			size_t index = std::upper_bound(holdEvents.begin(), holdEvents.end(), startLimit,
+			                                [](float limit, const Event& event)
+			                                { return limit < event.time; }) -
+			               holdEvents.begin();
+
+			// Walk back until no earlier hold can reach the time anymore
+			while (index > 0 && holdMaxEndTimes[index - 1] > time)
+			{
+				--index;
+				if (holdEvents[index].endTime > time)
+					onHold(holdEvents[index]);
+			}
+		}
+
+		const std::vector<Event>& getNoteEvents() const { return noteEvents; }
+		const std::vector<Event>& getHoldEvents() const { return holdEvents; }
+		size_t size() const { return noteEvents.size() + holdEvents.size(); }
+	};
+}
@@ -0,0 +1,96 @@
+#include "NoteSpatialGrid.h"
+#include "Score.h"
+#include <algorithm>
+#include <cmath>
+
+namespace MikuMikuWorld
+{
+	int NoteSpatialGrid::columnFromLane(float lane) const
+	{
+		// Clamp before converting so unbounded query lanes do not overflow
+		const float column = std::floor(lane) - firstLane;
+		return static_cast<int>(std::clamp(column, 0.0f, static_cast<float>(columns - 1)));
+	}
+
+	int NoteSpatialGrid::bandFromTick(int tick) const
+	{
+		return std::clamp(tick / ticksPerBand, 0, bands - 1);
+	}
+
+	void NoteSpatialGrid::build(const Score& score)
+	{
+		cells.clear();
+		bands = columns = 0;
+		dirty = false;
+
+		if (score.notes.empty())
+			return;
+
+		// Taps and circle damages are drawn centered on their lane, so cover half a width
+		// to the left of every note to stay conservative
+		std::vector<Entry> entries;
+		entries.reserve(score.notes.size());
+
+		int maxTick = 0;
+		float minLane = score.notes.begin()->second.lane;
+		float maxLane = minLane;
+		for (const auto& [id, note] : score.notes)
+		{
+			const float width = std::max(note.width, 0.0f);
+			Entry entry{ id, note.tick, 0, note.lane - width * 0.5f, note.lane + width };
+			entries.push_back(entry);
+
+			maxTick = std::max(maxTick, note.tick);
+			minLane = std::min(minLane, entry.minLane);
+			maxLane = std::max(maxLane, entry.maxLane);
+		}
+
+		firstLane = static_cast<int>(std::floor(minLane));
+		columns = static_cast<int>(std::floor(maxLane)) - firstLane + 1;
+		bands = maxTick / ticksPerBand + 1;
+		cells.resize(static_cast<size_t>(bands) * columns);
+
+		for (Entry& entry : entries)
+		{
+			const int band = bandFromTick(entry.tick);
+			const int first = columnFromLane(entry.minLane);
+			const int last = columnFromLane(entry.maxLane);
+
+			entry.firstColumn = first;
+			for (int column = first; column <= last; ++column)
+				cells[static_cast<size_t>(band) * columns + column].push_back(entry);
+		}
+	}
+
+	size_t NoteSpatialGrid::query(int minTick, int maxTick, float minLane, float maxLane,
+	                              std::vector<id_t>& result) const
+	{
+		if (cells.empty() || minTick > maxTick || minLane > maxLane)
+			return 0;
+
+		const size_t previousSize = result.size();
+		const int firstBand = bandFromTick(minTick);
+		const int lastBand = bandFromTick(maxTick);
+		const int firstColumn = columnFromLane(minLane);
+		const int lastColumn = columnFromLane(maxLane);
+
+		for (int band = firstBand; band <= lastBand; ++band)
+		{
+			for (int column = firstColumn; column <= lastColumn; ++column)
+			{
+				for (const Entry& entry : cells[static_cast<size_t>(band) * columns + column])
+				{
+					// A note spanning several columns is only reported from the first one queried
+					if (column != std::max(entry.firstColumn, firstColumn))
+						continue;
+
+					if (entry.tick >= minTick && entry.tick <= maxTick &&
+					    entry.maxLane >= minLane && entry.minLane <= maxLane)
+						result.push_back(entry.id);
+				}
+			}
+		}
+
+		return result.size() - previousSize;
+	}
+}
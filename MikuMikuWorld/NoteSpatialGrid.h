@@ -0,0 +1,51 @@
+#pragma once
+#include "Constants.h"
+#include <cstddef>
+#include <vector>
+
+namespace MikuMikuWorld
+{
+	struct Score;
+
+	/**
+	 * @brief Bucket grid of every note in a score keyed by tick band and lane column.
+	 * Lets the timeline look up the notes around a point or inside a rectangle without
+	 * walking the whole score.
+	 */
+	class NoteSpatialGrid
+	{
+	  private:
+		struct Entry
+		{
+			id_t id;
+			int tick;
+			int firstColumn;
+			float minLane;
+			float maxLane;
+		};
+
+		static constexpr int ticksPerBand = TICKS_PER_BEAT;
+
+		std::vector<std::vector<Entry>> cells;
+		int bands{};
+		int columns{};
+		int firstLane{};
+		bool dirty{ true };
+
+		int columnFromLane(float lane) const;
+		int bandFromTick(int tick) const;
+
+	  public:
+		void build(const Score& score);
+		void invalidate() { dirty = true; }
+		constexpr inline bool isDirty() const { return dirty; }
+
+		/**
+		 * @brief Collect the IDs of notes within [minTick, maxTick] whose lane span
+		 * overlaps [minLane, maxLane]. Each note is reported once.
+		 * @return The number of notes appended to result
+		 */
+		size_t query(int minTick, int maxTick, float minLane, float maxLane,
+		             std::vector<id_t>& result) const;
+	};
+}
@@ -0,0 +1,135 @@
+#include "Profiler.h"
+#include "IO.h"
+#include "Utilities.h"
+#include <algorithm>
+#include <fstream>
+#include <json.hpp>
+
+using json = nlohmann::json;
+
+namespace MikuMikuWorld
+{
+	Stopwatch Profiler::clock{};
+	std::array<ProfileFrame, Profiler::maxFrames> Profiler::frames{};
+	uint64_t Profiler::frameCount{};
+	size_t Profiler::currentFrame{};
+	int Profiler::depth{};
+	bool Profiler::enabled{ false };
+	bool Profiler::paused{ false };
+	bool Profiler::recording{ false };
+	std::thread::id Profiler::mainThread{};
+
+	void Profiler::setEnabled(bool value)
+	{
+		enabled = value;
+		if (!enabled)
+		{
+			for (auto& frame : frames)
+				frame.events.clear();
+
+			frameCount = 0;
+		}
+	}
+
+	void Profiler::beginFrame()
+	{
+		recording = enabled && !paused;
+		if (!recording)
+			return;
+
+		mainThread = std::this_thread::get_id();
+		currentFrame = frameCount % maxFrames;
+		depth = 0;
+
+		ProfileFrame& frame = frames[currentFrame];
+		frame.index = frameCount;
+		frame.start = clock.elapsed();
+		frame.duration = 0;
+		frame.events.clear();
+	}
+
+	void Profiler::endFrame()
+	{
+		if (!recording)
+			return;
+
+		ProfileFrame& frame = frames[currentFrame];
+		frame.duration = clock.elapsed() - frame.start;
+
+		++frameCount;
+		recording = false;
+	}
+
+	int Profiler::beginScope(const char* name)
+	{
+		// Worker threads are not recorded, their scopes would interleave with the main thread's
+		if (!recording || std::this_thread::get_id() != mainThread)
+			return -1;
+
+		ProfileFrame& frame = frames[currentFrame];
+		frame.events.push_back({ name, clock.elapsed(), 0, depth++ });
+		return static_cast<int>(frame.events.size() - 1);
+	}
+
+	void Profiler::endScope(int event)
+	{
+		// The frame may have ended while the scope was open (ex. profiler toggled mid-frame)
+		if (!recording)
+			return;
+
+		ProfileFrame& frame = frames[currentFrame];
+		if (event < 0 || static_cast<size_t>(event) >= frame.events.size())
+			return;
+
+		frame.events[event].duration = clock.elapsed() - frame.events[event].start;
+		depth = frame.events[event].depth;
+	}
+
+	size_t Profiler::getRecordedFrameCount()
+	{
+		return std::min<uint64_t>(frameCount, maxFrames);
+	}
+
+	const ProfileFrame& Profiler::getFrame(size_t age)
+	{
+		return frames[(frameCount - 1 - age) % maxFrames];
+	}
+
+	Result Profiler::writeChromeTrace(const std::string& filename)
+	{
+		constexpr double microseconds = 1000000.0;
+
+		json traceEvents = json::array();
+		for (size_t age = getRecordedFrameCount(); age-- > 0;)
+		{
+			const ProfileFrame& frame = getFrame(age);
+			traceEvents.push_back({ { "name", IO::formatString("Frame %llu", static_cast<unsigned long long>(frame.index)) },
+			                        { "ph", "X" },
+			                        { "ts", frame.start * microseconds },
+			                        { "dur", frame.duration * microseconds },
+			                        { "pid", 0 },
+			                        { "tid", 0 } });
+
+			for (const ProfileEvent& event : frame.events)
+			{
+				traceEvents.push_back({ { "name", event.name },
+				                        { "ph", "X" },
+				                        { "ts", event.start * microseconds },
+				                        { "dur", event.duration * microseconds },
+				                        { "pid", 0 },
+				                        { "tid", 0 } });
+			}
+		}
+
+		json trace{ { "traceEvents", traceEvents }, { "displayTimeUnit", "ms" } };
+
+		std::wstring wFilename = IO::mbToWideStr(filename);
+		std::ofstream traceFile(wFilename);
+		if (!traceFile.is_open())
+			return Result(ResultStatus::Error, "Failed to open " + filename);
+
+		traceFile << trace;
+		traceFile.close();
+		return Result::Ok();
+	}
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include "Stopwatch.h"
+#include <array>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace MikuMikuWorld
+{
+	class Result;
+
+	struct ProfileEvent
+	{
+		const char* name{};
+		double start{};
+		double duration{};
+		int depth{};
+	};
+
+	struct ProfileFrame
+	{
+		uint64_t index{};
+		double start{};
+		double duration{};
+		std::vector<ProfileEvent> events;
+	};
+
+	/**
+	 * @brief Records nested timings of the main thread into a ring buffer of recent frames.
+	 * When disabled, scopes only cost a single branch.
+	 */
+	class Profiler
+	{
+	  public:
+		static constexpr size_t maxFrames = 300;
+
+	  private:
+		static Stopwatch clock;
+		static std::array<ProfileFrame, maxFrames> frames;
+		static uint64_t frameCount;
+		static size_t currentFrame;
+		static int depth;
+		static bool enabled;
+		static bool paused;
+		static bool recording;
+		static std::thread::id mainThread;
+
+	  public:
+		static inline bool isEnabled() { return enabled; }
+		static void setEnabled(bool enabled);
+
+		static inline bool isPaused() { return paused; }
+		static inline void setPaused(bool paused) { Profiler::paused = paused; }
+
+		static void beginFrame();
+		static void endFrame();
+
+		/**
+		 * @brief Returns the index of the new event or -1 if nothing is being recorded
+		 */
+		static int beginScope(const char* name);
+		static void endScope(int event);
+
+		static size_t getRecordedFrameCount();
+
+		/**
+		 * @brief Get a recorded frame, 0 being the most recently completed one
+		 */
+		static const ProfileFrame& getFrame(size_t age);
+
+		/**
+		 * @brief Write the recorded frames in the Chrome trace event format
+		 * (chrome://tracing, Perfetto)
+		 */
+		static Result writeChromeTrace(const std::string& filename);
+	};
+
+	class ProfileScope
+	{
+	  private:
+		int event{ -1 };
+
+	  public:
+		explicit ProfileScope(const char* name)
+		{
+			if (Profiler::isEnabled())
+				event = Profiler::beginScope(name);
+		}
+
+		~ProfileScope()
+		{
+			if (event != -1)
+				Profiler::endScope(event);
+		}
+
+		ProfileScope(const ProfileScope&) = delete;
+		ProfileScope& operator=(const ProfileScope&) = delete;
+	};
+}
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+
+// The name must outlive the profiler (string literals)
+#define PROFILE_SCOPE(name)                                                                        \
+	::MikuMikuWorld::ProfileScope PROFILE_CONCAT(profileScope, __LINE__) { name }
@@ -1,14 +1,19 @@
 #include "Renderer.h"
+#include "../Profiler.h"
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <algorithm>
 
 namespace MikuMikuWorld
 {
-	Renderer::Renderer() : vBuffer{ VertexBuffer(maxQuads) }
+	Renderer::Renderer(bool headless) : vBuffer{ VertexBuffer(maxQuads) }, headless{ headless }
 	{
-		vBuffer.setup();
-		vBuffer.bind();
+		if (!headless)
+		{
+			vBuffer.setup();
+			vBuffer.bind();
+		}
+
 		quads.reserve(maxQuads);
 		init();
 	}
@@ -67,12 +72,32 @@ namespace MikuMikuWorld
 		vPos[3] = DirectX::XMVECTOR{ left, top, 0.0f, 1.0f };
 	}
 
+	unsigned int Renderer::getBatchTextureID(const Texture& tex) const
+	{
+		return atlas && atlas->findRegion(tex.getID()) ? atlas->getID() : tex.getID();
+	}
+
 	void Renderer::setUVCoords(const Texture& tex, float x1, float x2, float y1, float y2)
 	{
-		float left = x1 / tex.getWidth();
-		float right = x2 / tex.getWidth();
-		float top = y1 / tex.getHeight();
-		float bottom = y2 / tex.getHeight();
+		float textureWidth = tex.getWidth();
+		float textureHeight = tex.getHeight();
+
+		// Sprite rects are relative to their sheet, move them to where it was packed
+		const TextureAtlas::Region* region = atlas ? atlas->findRegion(tex.getID()) : nullptr;
+		if (region)
+		{
+			x1 += region->x;
+			x2 += region->x;
+			y1 += region->y;
+			y2 += region->y;
+			textureWidth = atlas->getWidth();
+			textureHeight = atlas->getHeight();
+		}
+
+		float left = x1 / textureWidth;
+		float right = x2 / textureWidth;
+		float top = y1 / textureHeight;
+		float bottom = y2 / textureHeight;
 
 		uvCoords[0] = DirectX::XMVECTOR{ right, top, 0.0f, 0.0f };
 		uvCoords[1] = DirectX::XMVECTOR{ right, bottom, 0.0f, 0.0f };
@@ -108,7 +133,7 @@ namespace MikuMikuWorld
 		setUVCoords(tex, x1, x2, y1, y2);
 		setAnchor(anchor);
 
-		pushQuad(vPos, uvCoords, model, color, tex.getID(), z);
+		pushQuad(vPos, uvCoords, model, color, getBatchTextureID(tex), z);
 	}
 
 	void Renderer::drawQuad(const Vector2& p1, const Vector2& p2, const Vector2& p3,
@@ -122,7 +147,7 @@ namespace MikuMikuWorld
 		vPos[3] = DirectX::XMVECTOR{ p3.x, p3.y, 0.0f, 1.0f };
 		DirectX::XMVECTOR color{ tint.r, tint.g, tint.b, tint.a };
 
-		pushQuad(vPos, uvCoords, DirectX::XMMatrixIdentity(), color, tex.getID(), z);
+		pushQuad(vPos, uvCoords, DirectX::XMMatrixIdentity(), color, getBatchTextureID(tex), z);
 	}
 
 	void Renderer::drawRectangle(Vector2 position, Vector2 size, const Texture& tex, float x1,
@@ -181,6 +206,8 @@ namespace MikuMikuWorld
 
 	void Renderer::endBatch()
 	{
+		PROFILE_SCOPE("Renderer::endBatch");
+
 		numBatchVertices = numVertices;
 		numBatchQuads = numQuads;
 
@@ -191,6 +218,15 @@ namespace MikuMikuWorld
 		std::stable_sort(quads.begin(), quads.end(),
 		                 [](const Quad& q1, const Quad& q2) { return q1.zIndex < q2.zIndex; });
 
+		if (softwareTarget)
+		{
+			softwareTarget->draw(quads);
+			return;
+		}
+
+		if (headless)
+			return;
+
 		bindTexture(quads[0].texture);
 		int vertexCount = 0;
 
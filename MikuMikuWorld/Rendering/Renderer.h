@@ -4,6 +4,8 @@
 #include "Texture.h"
 #include "AnchorType.h"
 #include "VertexBuffer.h"
+#include "SoftwareRenderer.h"
+#include "TextureAtlas.h"
 #include <vector>
 #include <array>
 
@@ -28,12 +30,21 @@ namespace MikuMikuWorld
 		unsigned int vao, vbo, ebo;
 		int texID;
 		bool batchStarted;
+		bool headless;
+		SoftwareRenderer* softwareTarget{ nullptr };
+		const TextureAtlas* atlas{ nullptr };
+
+		unsigned int getBatchTextureID(const Texture& tex) const;
 
 		void init();
 		void resetRenderStats();
 
 	  public:
-		Renderer();
+		/**
+		 * @param headless Skip the OpenGL buffers, batches are then only drawn into software
+		 * targets (ex. rendering from the command line)
+		 */
+		explicit Renderer(bool headless = false);
 
 		void drawSprite(const Vector2& pos, float rot, const Vector2& sz, AnchorType anchor,
 		                const Texture& tex, int spr, const Color& tint, int z = 0);
@@ -60,6 +71,17 @@ namespace MikuMikuWorld
 		void beginBatch();
 		void endBatch();
 
+		/**
+		 * @brief Rasterize batches on the CPU into the given target instead of OpenGL.
+		 * Pass nullptr to go back to drawing on the GPU.
+		 */
+		inline void setSoftwareTarget(SoftwareRenderer* target) { softwareTarget = target; }
+
+		/**
+		 * @brief Draw textures packed in the atlas from it so they share batches
+		 */
+		inline void setTextureAtlas(const TextureAtlas* textureAtlas) { atlas = textureAtlas; }
+
 		inline int getNumVertices() const { return numBatchVertices; }
 		inline int getNumQuads() const { return numBatchQuads; }
 	};
@@ -0,0 +1,310 @@
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#define STBIW_WINDOWS_UTF8
+
+#include "SoftwareRenderer.h"
+#include "../ResourceManager.h"
+#include "TextureCache.h"
+#include "stb_image_write.h"
+#include <algorithm>
+#include <cmath>
+#include <execution>
+#include <numeric>
+
+namespace MikuMikuWorld
+{
+	static int64_t min3(const int64_t values[3])
+	{
+		return std::min({ values[0], values[1], values[2] });
+	}
+
+	static int64_t max3(const int64_t values[3])
+	{
+		return std::max({ values[0], values[1], values[2] });
+	}
+
+	static uint8_t toByte(float value)
+	{
+		return static_cast<uint8_t>(std::clamp(value + 0.5f, 0.0f, 255.0f));
+	}
+
+	SoftwareRenderer::SoftwareRenderer(int width, int height)
+	    : projection{ DirectX::XMMatrixIdentity() }
+	{
+		resize(width, height);
+	}
+
+	void SoftwareRenderer::resize(int width, int height)
+	{
+		this->width = std::max(width, 1);
+		this->height = std::max(height, 1);
+		tilesX = (this->width + tileSize - 1) / tileSize;
+		tilesY = (this->height + tileSize - 1) / tileSize;
+
+		pixels.assign(static_cast<size_t>(this->width) * this->height * 4, 0);
+		tileTriangles.resize(static_cast<size_t>(tilesX) * tilesY);
+	}
+
+	void SoftwareRenderer::clear(const Color& color)
+	{
+		const uint8_t rgba[4]{ toByte(color.r * 255.0f), toByte(color.g * 255.0f),
+			                   toByte(color.b * 255.0f), toByte(color.a * 255.0f) };
+
+		for (size_t i = 0; i < pixels.size(); i += 4)
+			std::copy(rgba, rgba + 4, pixels.begin() + i);
+	}
+
+	void SoftwareRenderer::setProjection(const DirectX::XMMATRIX& projection)
+	{
+		this->projection = projection;
+	}
+
+	const SoftwareRenderer::TexturePixels* SoftwareRenderer::getTexturePixels(unsigned int textureID)
+	{
+		auto it = textures.find(textureID);
+		if (it != textures.end())
+			return it->second.pixels.empty() ? nullptr : &it->second;
+
+		// GPU textures do not keep their pixels around so decode the source image again
+		TexturePixels& texture = textures[textureID];
+		const TextureAtlas& atlas = ResourceManager::noteAtlas;
+		if (!atlas.isEmpty() && atlas.getID() == textureID)
+		{
+			texture.width = atlas.getWidth();
+			texture.height = atlas.getHeight();
+			texture.pixels = atlas.composePixels();
+			return &texture;
+		}
+
+		for (const Texture& tex : ResourceManager::textures)
+		{
+			if (tex.getID() != textureID)
+				continue;
+
+			TextureCache::Entry image;
+			if (TextureCache::loadPixels(tex.getFilename(), image))
+			{
+				texture.width = image.width;
+				texture.height = image.height;
+				texture.pixels = std::move(image.pixels);
+			}
+			break;
+		}
+
+		return texture.pixels.empty() ? nullptr : &texture;
+	}
+
+	void SoftwareRenderer::draw(const std::vector<Quad>& quads)
+	{
+		triangles.clear();
+		triangles.reserve(quads.size() * 2);
+		for (auto& bin : tileTriangles)
+			bin.clear();
+
+		// Same index order as VertexBuffer
+		constexpr int indices[2][3]{ { 0, 1, 2 }, { 2, 3, 0 } };
+		for (const Quad& quad : quads)
+		{
+			const TexturePixels* texture = getTexturePixels(quad.texture);
+			if (!texture)
+				continue;
+
+			constexpr float subpixelScale = 1 << subpixelBits;
+			constexpr float maxCoordinate = 1 << 22;
+
+			int64_t x[4], y[4];
+			for (int i = 0; i < 4; ++i)
+			{
+				DirectX::XMVECTOR position =
+				    DirectX::XMVector2Transform(quad.vertices[i].position, quad.matrix);
+				position = DirectX::XMVectorSetZ(position, 0.0f);
+				position = DirectX::XMVectorSetW(position, 1.0f);
+				position = DirectX::XMVector4Transform(position, projection);
+
+				const float w = DirectX::XMVectorGetW(position);
+				const float px = (DirectX::XMVectorGetX(position) / w + 1.0f) * 0.5f * width;
+				const float py = (DirectX::XMVectorGetY(position) / w + 1.0f) * 0.5f * height;
+				x[i] = std::llround(std::clamp(px, -maxCoordinate, maxCoordinate) * subpixelScale);
+				y[i] = std::llround(std::clamp(py, -maxCoordinate, maxCoordinate) * subpixelScale);
+			}
+
+			for (const auto& triangleIndices : indices)
+			{
+				Triangle triangle{};
+				for (int i = 0; i < 3; ++i)
+				{
+					const Vertex& vertex = quad.vertices[triangleIndices[i]];
+					triangle.x[i] = x[triangleIndices[i]];
+					triangle.y[i] = y[triangleIndices[i]];
+					triangle.u[i] = DirectX::XMVectorGetX(vertex.uv);
+					triangle.v[i] = DirectX::XMVectorGetY(vertex.uv);
+				}
+
+				// Keep every triangle counter-clockwise so the fill rule below holds for both
+				// halves of a quad
+				const int64_t area =
+				    (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) -
+				    (triangle.y[1] - triangle.y[0]) * (triangle.x[2] - triangle.x[0]);
+				if (area == 0)
+					continue;
+
+				if (area < 0)
+				{
+					std::swap(triangle.x[1], triangle.x[2]);
+					std::swap(triangle.y[1], triangle.y[2]);
+					std::swap(triangle.u[1], triangle.u[2]);
+					std::swap(triangle.v[1], triangle.v[2]);
+				}
+
+				DirectX::XMFLOAT4 color;
+				DirectX::XMStoreFloat4(&color, quad.vertices[0].color);
+				triangle.color[0] = color.x;
+				triangle.color[1] = color.y;
+				triangle.color[2] = color.z;
+				triangle.color[3] = color.w;
+				triangle.texture = texture;
+
+				const int minX = static_cast<int>(min3(triangle.x) >> subpixelBits);
+				const int maxX = static_cast<int>(max3(triangle.x) >> subpixelBits);
+				const int minY = static_cast<int>(min3(triangle.y) >> subpixelBits);
+				const int maxY = static_cast<int>(max3(triangle.y) >> subpixelBits);
+				if (maxX < 0 || maxY < 0 || minX >= width || minY >= height)
+					continue;
+
+				const uint32_t triangleIndex = static_cast<uint32_t>(triangles.size());
+				triangles.push_back(triangle);
+
+				const int firstTileX = std::clamp(minX / tileSize, 0, tilesX - 1);
+				const int lastTileX = std::clamp(maxX / tileSize, 0, tilesX - 1);
+				const int firstTileY = std::clamp(minY / tileSize, 0, tilesY - 1);
+				const int lastTileY = std::clamp(maxY / tileSize, 0, tilesY - 1);
+				for (int tileY = firstTileY; tileY <= lastTileY; ++tileY)
+					for (int tileX = firstTileX; tileX <= lastTileX; ++tileX)
+						tileTriangles[static_cast<size_t>(tileY) * tilesX + tileX].push_back(
+						    triangleIndex);
+			}
+		}
+
+		std::vector<int> tiles(tileTriangles.size());
+		std::iota(tiles.begin(), tiles.end(), 0);
+		std::for_each(std::execution::par, tiles.begin(), tiles.end(),
+		              [this](int tile) { rasterizeTile(tile); });
+	}
+
+	void SoftwareRenderer::rasterizeTile(int tile)
+	{
+		const std::vector<uint32_t>& bin = tileTriangles[tile];
+		if (bin.empty())
+			return;
+
+		const int tileMinX = (tile % tilesX) * tileSize;
+		const int tileMinY = (tile / tilesX) * tileSize;
+		const int tileMaxX = std::min(tileMinX + tileSize, width) - 1;
+		const int tileMaxY = std::min(tileMinY + tileSize, height) - 1;
+
+		for (uint32_t triangleIndex : bin)
+		{
+			const Triangle& t = triangles[triangleIndex];
+			const int minX = std::max(tileMinX, static_cast<int>(min3(t.x) >> subpixelBits));
+			const int maxX = std::min(tileMaxX, static_cast<int>(max3(t.x) >> subpixelBits));
+			const int minY = std::max(tileMinY, static_cast<int>(min3(t.y) >> subpixelBits));
+			const int maxY = std::min(tileMaxY, static_cast<int>(max3(t.y) >> subpixelBits));
+
+			const float area = static_cast<float>((t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) -
+			                                      (t.y[1] - t.y[0]) * (t.x[2] - t.x[0]));
+
+			// Edge i is opposite to vertex i, edges shared by two triangles only belong to one
+			int64_t edgeX[3], edgeY[3];
+			bool inclusive[3];
+			for (int i = 0; i < 3; ++i)
+			{
+				const int a = (i + 1) % 3, b = (i + 2) % 3;
+				edgeX[i] = t.x[b] - t.x[a];
+				edgeY[i] = t.y[b] - t.y[a];
+				inclusive[i] = edgeY[i] > 0 || (edgeY[i] == 0 && edgeX[i] < 0);
+			}
+
+			// Pixels are sampled at their centers
+			constexpr int64_t halfPixel = 1 << (subpixelBits - 1);
+			const TexturePixels& texture = *t.texture;
+			for (int py = minY; py <= maxY; ++py)
+			{
+				const int64_t sampleY = (static_cast<int64_t>(py) << subpixelBits) + halfPixel;
+				uint8_t* row = pixels.data() + (static_cast<size_t>(py) * width) * 4;
+				for (int px = minX; px <= maxX; ++px)
+				{
+					const int64_t sampleX = (static_cast<int64_t>(px) << subpixelBits) + halfPixel;
+
+					float weights[3];
+					bool inside = true;
+					for (int i = 0; i < 3; ++i)
+					{
+						const int a = (i + 1) % 3;
+						const int64_t edge =
+						    edgeX[i] * (sampleY - t.y[a]) - edgeY[i] * (sampleX - t.x[a]);
+						if (edge < 0 || (edge == 0 && !inclusive[i]))
+						{
+							inside = false;
+							break;
+						}
+						weights[i] = static_cast<float>(edge);
+					}
+
+					if (!inside)
+						continue;
+
+					const float u =
+					    (weights[0] * t.u[0] + weights[1] * t.u[1] + weights[2] * t.u[2]) / area;
+					const float v =
+					    (weights[0] * t.v[0] + weights[1] * t.v[1] + weights[2] * t.v[2]) / area;
+
+					// Bilinear filtering with repeat wrapping like the GPU textures
+					const float texelX = u * texture.width - 0.5f;
+					const float texelY = v * texture.height - 0.5f;
+					const float floorX = std::floor(texelX), floorY = std::floor(texelY);
+					const float fracX = texelX - floorX, fracY = texelY - floorY;
+					const int x0 = static_cast<int>(floorX), y0 = static_cast<int>(floorY);
+
+					float sampled[4]{};
+					for (int corner = 0; corner < 4; ++corner)
+					{
+						const int cx = ((x0 + (corner & 1)) % texture.width + texture.width) %
+						               texture.width;
+						const int cy = ((y0 + (corner >> 1)) % texture.height + texture.height) %
+						               texture.height;
+						const float weight = ((corner & 1) ? fracX : 1.0f - fracX) *
+						                     ((corner >> 1) ? fracY : 1.0f - fracY);
+
+						const uint8_t* texel =
+						    texture.pixels.data() + (static_cast<size_t>(cy) * texture.width + cx) * 4;
+						for (int c = 0; c < 4; ++c)
+							sampled[c] += texel[c] * weight;
+					}
+
+					// Same as the GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA
+					// blending used by the OpenGL renderer
+					uint8_t* destination = row + static_cast<size_t>(px) * 4;
+					const float sourceAlpha = sampled[3] / 255.0f * t.color[3];
+					for (int c = 0; c < 3; ++c)
+					{
+						const float source = sampled[c] * t.color[c];
+						destination[c] =
+						    toByte(source * sourceAlpha + destination[c] * (1.0f - sourceAlpha));
+					}
+
+					destination[3] =
+					    toByte(sourceAlpha * 255.0f + destination[3] * (1.0f - sourceAlpha));
+				}
+			}
+		}
+	}
+
+	bool SoftwareRenderer::writePng(const std::string& filename, bool flipVertically) const
+	{
+		stbi_flip_vertically_on_write(flipVertically ? 1 : 0);
+		const int result =
+		    stbi_write_png(filename.c_str(), width, height, 4, pixels.data(), width * 4);
+		stbi_flip_vertically_on_write(0);
+
+		return result != 0;
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "Quad.h"
+#include "../Math.h"
+#include <DirectXMath.h>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace MikuMikuWorld
+{
+	/**
+	 * @brief CPU rasterizer for the quads produced by Renderer.
+	 * The target is split into tiles that are rasterized in parallel, each tile drawing its
+	 * triangles in submission order so the result matches the OpenGL batches.
+	 */
+	class SoftwareRenderer
+	{
+	  private:
+		struct TexturePixels
+		{
+			int width{};
+			int height{};
+			std::vector<uint8_t> pixels;
+		};
+
+		// Vertex positions are snapped to fixed point so edges shared by two triangles are
+		// evaluated exactly the same way by both of them
+		struct Triangle
+		{
+			int64_t x[3];
+			int64_t y[3];
+			float u[3];
+			float v[3];
+			float color[4];
+			const TexturePixels* texture;
+		};
+
+		static constexpr int tileSize = 64;
+		static constexpr int subpixelBits = 8;
+
+		int width{};
+		int height{};
+		int tilesX{};
+		int tilesY{};
+		std::vector<uint8_t> pixels;
+		DirectX::XMMATRIX projection;
+
+		std::vector<Triangle> triangles;
+		std::vector<std::vector<uint32_t>> tileTriangles;
+		std::unordered_map<unsigned int, TexturePixels> textures;
+
+		const TexturePixels* getTexturePixels(unsigned int textureID);
+		void rasterizeTile(int tile);
+
+	  public:
+		SoftwareRenderer(int width, int height);
+
+		void resize(int width, int height);
+		void clear(const Color& color = { 0.0f, 0.0f, 0.0f, 0.0f });
+		void setProjection(const DirectX::XMMATRIX& projection);
+
+		/**
+		 * @brief Rasterize quads already sorted in drawing order
+		 */
+		void draw(const std::vector<Quad>& quads);
+
+		inline int getWidth() const { return width; }
+		inline int getHeight() const { return height; }
+
+		// RGBA8 pixels, first row is the bottom of the projection like an OpenGL framebuffer
+		inline const std::vector<uint8_t>& getPixels() const { return pixels; }
+
+		bool writePng(const std::string& filename, bool flipVertically = false) const;
+	};
+}
@@ -11,24 +11,54 @@ using namespace IO;
 
 namespace MikuMikuWorld
 {
+	bool Texture::headless{ false };
+	unsigned int Texture::lastHeadlessID{ 0 };
+
 	Texture::Texture(const std::string& filename)
 	    : Texture(filename, TextureFilterMode::Linear, TextureFilterMode::Linear)
 	{
 	}
 
-	Texture::Texture(const std::string& filename, TextureFilterMode min, TextureFilterMode mag)
+	Texture::Texture(const std::string& filename, TextureFilterMode min, TextureFilterMode mag,
+	                 bool useCache)
 	{
 		this->filename = filename;
 		name = File::getFilenameWithoutExtension(filename);
-		read(filename, min, mag);
 
 		std::string sprSheet = File::getFilepath(filename) + "spr/" + name + ".txt";
-		if (File::exists(sprSheet))
+		const bool hasSprSheet = File::exists(sprSheet);
+		if (!hasSprSheet)
+			sprSheet.clear();
+
+		TextureCache::Entry entry;
+		if (useCache && TextureCache::load(filename, sprSheet, entry))
 		{
-			readSprites(sprSheet);
+			for (const auto& rect : entry.sprites)
+				sprites.push_back(Sprite(name, rect[0], rect[1], rect[2], rect[3]));
 		}
 		else
 		{
+			decode(filename, entry);
+			if (hasSprSheet)
+				readSprites(sprSheet);
+
+			if (useCache && !entry.pixels.empty())
+			{
+				for (const Sprite& sprite : sprites)
+					entry.sprites.push_back({ sprite.getX(), sprite.getY(), sprite.getWidth(),
+					                          sprite.getHeight() });
+
+				TextureCache::save(filename, sprSheet, entry);
+			}
+		}
+
+		width = entry.width;
+		height = entry.height;
+		upload(entry.pixels.empty() ? nullptr : entry.pixels.data(), min, mag);
+
+		if (!hasSprSheet)
+		{
+			sprites.clear();
 			sprites.push_back(Sprite(name, 0, 0, width, height));
 		}
 	}
@@ -38,9 +68,22 @@ namespace MikuMikuWorld
 	{
 	}
 
+	Texture::Texture(const std::string& filename, int width, int height, const uint8_t* pixels,
+	                 TextureFilterMode min, TextureFilterMode mag)
+	    : filename{ filename }, width{ width }, height{ height }
+	{
+		name = File::getFilenameWithoutExtension(filename);
+		upload(pixels, min, mag);
+		sprites.push_back(Sprite(name, 0, 0, width, height));
+	}
+
 	void Texture::bind() const { glBindTexture(GL_TEXTURE_2D, glID); }
 
-	void Texture::dispose() const { glDeleteTextures(1, &glID); }
+	void Texture::dispose() const
+	{
+		if (!headless)
+			glDeleteTextures(1, &glID);
+	}
 
 	void Texture::readSprites(const std::string& filename)
 	{
@@ -71,12 +114,37 @@ namespace MikuMikuWorld
 	void Texture::read(const std::string& filename, TextureFilterMode minFilter,
 	                   TextureFilterMode magFilter)
 	{
-		glGenTextures(1, &glID);
-		glBindTexture(GL_TEXTURE_2D, glID);
+		TextureCache::Entry entry;
+		decode(filename, entry);
+
+		width = entry.width;
+		height = entry.height;
+		upload(entry.pixels.empty() ? nullptr : entry.pixels.data(), minFilter, magFilter);
+	}
 
+	void Texture::decode(const std::string& filename, TextureCache::Entry& entry)
+	{
 		int nrChannels;
 		stbi_set_flip_vertically_on_load(0);
-		auto data = stbi_load(filename.c_str(), &width, &height, &nrChannels, 4);
+		auto data = stbi_load(filename.c_str(), &entry.width, &entry.height, &nrChannels, 4);
+		if (!data)
+			return;
+
+		entry.pixels.assign(data, data + static_cast<size_t>(entry.width) * entry.height * 4);
+		stbi_image_free(data);
+	}
+
+	void Texture::upload(const uint8_t* data, TextureFilterMode minFilter,
+	                     TextureFilterMode magFilter)
+	{
+		if (headless)
+		{
+			glID = ++lastHeadlessID;
+			return;
+		}
+
+		glGenTextures(1, &glID);
+		glBindTexture(GL_TEXTURE_2D, glID);
 
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
 		glGenerateMipmap(GL_TEXTURE_2D);
@@ -86,6 +154,5 @@ namespace MikuMikuWorld
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, (GLint)magFilter);
 
 		glBindTexture(GL_TEXTURE_2D, 0);
-		free(data);
 	}
 }
@@ -2,6 +2,7 @@
 #include <string>
 #include <vector>
 #include "Sprite.h"
+#include "TextureCache.h"
 #include "../File.h"
 #include <glad/glad.h>
 
@@ -32,15 +33,28 @@ namespace MikuMikuWorld
 		int height;
 		unsigned int glID;
 
+		static bool headless;
+		static unsigned int lastHeadlessID;
+
 		Sprite parseSprite(const IO::File& f, const std::string& line);
+		void decode(const std::string& filename, TextureCache::Entry& entry);
+		void upload(const uint8_t* data, TextureFilterMode minFilter, TextureFilterMode magFilter);
 
 	  public:
 		std::vector<Sprite> sprites;
 
-		Texture(const std::string& filename, TextureFilterMode min, TextureFilterMode mag);
+		Texture(const std::string& filename, TextureFilterMode min, TextureFilterMode mag,
+		        bool useCache = false);
 		Texture(const std::string& filename, TextureFilterMode filter);
 		Texture(const std::string& filename);
 
+		/**
+		 * @brief Create a single sprite texture from already decoded RGBA pixels
+		 */
+		Texture(const std::string& filename, int width, int height, const uint8_t* pixels,
+		        TextureFilterMode min = TextureFilterMode::Linear,
+		        TextureFilterMode mag = TextureFilterMode::Linear);
+
 		inline int getWidth() const { return width; }
 		inline int getHeight() const { return height; }
 		inline unsigned int getID() const { return glID; }
@@ -53,5 +67,12 @@ namespace MikuMikuWorld
 		          TextureFilterMode minFilter = TextureFilterMode::Linear,
 		          TextureFilterMode magFilter = TextureFilterMode::Linear);
 		void readSprites(const std::string& filename);
+
+		/**
+		 * @brief Skip OpenGL when there is no context (ex. rendering from the command line).
+		 * Textures still get unique IDs so software targets can find their pixels.
+		 */
+		static void setHeadless(bool value) { headless = value; }
+		static bool isHeadless() { return headless; }
 	};
 }
\ No newline at end of file
@@ -0,0 +1,132 @@
+#include "TextureAtlas.h"
+#include "TextureCache.h"
+#include <algorithm>
+
+namespace MikuMikuWorld
+{
+	// Copy an image into the atlas and repeat its outermost pixels into the padding
+	static void blitExtruded(std::vector<uint8_t>& atlas, int atlasWidth, const uint8_t* image,
+	                         const TextureAtlas::Region& region, int padding)
+	{
+		for (int y = -padding; y < region.height + padding; ++y)
+		{
+			const int sourceY = std::clamp(y, 0, region.height - 1);
+			uint8_t* row = atlas.data() + (static_cast<size_t>(region.y + y) * atlasWidth) * 4;
+			for (int x = -padding; x < region.width + padding; ++x)
+			{
+				const int sourceX = std::clamp(x, 0, region.width - 1);
+				const uint8_t* source =
+				    image + (static_cast<size_t>(sourceY) * region.width + sourceX) * 4;
+				std::copy(source, source + 4, row + static_cast<size_t>(region.x + x) * 4);
+			}
+		}
+	}
+
+	bool TextureAtlas::pack(std::vector<std::pair<unsigned int, Region>>& sheets, int maxSize)
+	{
+		// Shelf packing, tallest sheets first so each shelf wastes as little height as possible
+		std::stable_sort(sheets.begin(), sheets.end(), [](const auto& a, const auto& b)
+		                 { return a.second.height > b.second.height; });
+
+		int atlasWidth = preferredWidth;
+		for (const auto& [id, sheet] : sheets)
+			atlasWidth = std::max(atlasWidth, sheet.width + padding * 2);
+
+		int shelfX = 0, shelfY = 0, shelfHeight = 0;
+		for (auto& [id, sheet] : sheets)
+		{
+			const int paddedWidth = sheet.width + padding * 2;
+			const int paddedHeight = sheet.height + padding * 2;
+			if (shelfX + paddedWidth > atlasWidth)
+			{
+				shelfY += shelfHeight;
+				shelfX = shelfHeight = 0;
+			}
+
+			sheet.x = shelfX + padding;
+			sheet.y = shelfY + padding;
+			shelfX += paddedWidth;
+			shelfHeight = std::max(shelfHeight, paddedHeight);
+		}
+
+		width = atlasWidth;
+		height = shelfY + shelfHeight;
+		return width <= maxSize && height <= maxSize;
+	}
+
+	bool TextureAtlas::build(const std::vector<const Texture*>& textures)
+	{
+		dispose();
+
+		std::vector<std::pair<unsigned int, Region>> sheets;
+		for (const Texture* texture : textures)
+		{
+			if (!texture || texture->getWidth() <= 0 || texture->getHeight() <= 0)
+				continue;
+
+			sheets.push_back({ texture->getID(),
+			                   { texture->getFilename(), 0, 0, texture->getWidth(),
+			                     texture->getHeight() } });
+		}
+
+		if (sheets.empty())
+			return false;
+
+		int maxTextureSize{};
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+		if (!pack(sheets, maxTextureSize))
+		{
+			width = height = 0;
+			return false;
+		}
+
+		regions.insert(sheets.begin(), sheets.end());
+		std::vector<uint8_t> pixels = composePixels();
+
+		glGenTextures(1, &glID);
+		glBindTexture(GL_TEXTURE_2D, glID);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+		             pixels.data());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, maxMipLevel);
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		return true;
+	}
+
+	void TextureAtlas::dispose()
+	{
+		if (glID)
+			glDeleteTextures(1, &glID);
+
+		glID = 0;
+		width = height = 0;
+		regions.clear();
+	}
+
+	const TextureAtlas::Region* TextureAtlas::findRegion(unsigned int textureID) const
+	{
+		auto it = regions.find(textureID);
+		return it != regions.end() ? &it->second : nullptr;
+	}
+
+	std::vector<uint8_t> TextureAtlas::composePixels() const
+	{
+		std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4, 0);
+		for (const auto& [id, region] : regions)
+		{
+			TextureCache::Entry image;
+			if (!TextureCache::loadPixels(region.filename, image))
+				continue;
+
+			if (image.width == region.width && image.height == region.height)
+				blitExtruded(pixels, width, image.pixels.data(), region, padding);
+		}
+
+		return pixels;
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "Texture.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace MikuMikuWorld
+{
+	/**
+	 * @brief Packs several sprite sheets into one texture so quads using any of them can be
+	 * drawn in the same batch. The source textures are left untouched for other uses (ex. ImGui).
+	 */
+	class TextureAtlas
+	{
+	  public:
+		struct Region
+		{
+			std::string filename;
+			int x{};
+			int y{};
+			int width{};
+			int height{};
+		};
+
+	  private:
+		// Extruded border around every sheet to keep filtering and mipmaps from bleeding.
+		// A bilinear sample at mip level n reaches up to 2^(n+1) - 1 pixels past a sheet's edge,
+		// so the mip chain stops at the last level the padding still covers.
+		static constexpr int padding = 8;
+		static constexpr int maxMipLevel = 2;
+		static constexpr int preferredWidth = 2048;
+
+		unsigned int glID{};
+		int width{};
+		int height{};
+		std::unordered_map<unsigned int, Region> regions;
+
+		bool pack(std::vector<std::pair<unsigned int, Region>>& sheets, int maxSize);
+
+	  public:
+		/**
+		 * @brief Decode the source images of the given textures and upload them as one texture.
+		 * Leaves the atlas empty if they do not fit in a single texture.
+		 */
+		bool build(const std::vector<const Texture*>& textures);
+		void dispose();
+
+		/**
+		 * @brief Get where a texture was placed in the atlas, nullptr if it is not part of it
+		 */
+		const Region* findRegion(unsigned int textureID) const;
+
+		/**
+		 * @brief Decode the atlas contents again on the CPU (RGBA8, width * height)
+		 */
+		std::vector<uint8_t> composePixels() const;
+
+		inline bool isEmpty() const { return regions.empty(); }
+		inline unsigned int getID() const { return glID; }
+		inline int getWidth() const { return width; }
+		inline int getHeight() const { return height; }
+	};
+}
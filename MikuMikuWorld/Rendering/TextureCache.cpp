@@ -0,0 +1,182 @@
+#include "TextureCache.h"
+#include "../CacheFiles.h"
+#include "../File.h"
+#include "../IO.h"
+#include "stb_image.h"
+#include <cstring>
+#include <filesystem>
+
+namespace MikuMikuWorld
+{
+	std::string TextureCache::directory{};
+	uint64_t TextureCache::maxSize{ TextureCache::defaultMaxSize };
+
+	namespace
+	{
+		constexpr uint32_t cacheMagic = 0x54574D4D; // "MMWT"
+		constexpr uint32_t cacheVersion = 1;
+
+		struct SourceInfo
+		{
+			uint64_t size{};
+			int64_t writeTime{};
+			uint64_t hash{};
+		};
+
+		struct CacheHeader
+		{
+			uint32_t magic{};
+			uint32_t version{};
+			SourceInfo image{};
+			SourceInfo sprites{};
+			int32_t width{};
+			int32_t height{};
+			uint32_t spriteCount{};
+			uint32_t reserved{};
+		};
+
+		// Size and write time only, the hash is filled in when the contents are read
+		SourceInfo getSourceInfo(const std::string& filename)
+		{
+			SourceInfo info{};
+			if (filename.empty())
+				return info;
+
+			std::error_code error;
+			const std::filesystem::path path(IO::mbToWideStr(filename));
+			const auto size = std::filesystem::file_size(path, error);
+			if (error)
+				return info;
+
+			info.size = size;
+			info.writeTime =
+			    std::filesystem::last_write_time(path, error).time_since_epoch().count();
+			return info;
+		}
+
+		bool isSourceUnchanged(const SourceInfo& cached, const SourceInfo& current,
+		                       const std::string& filename)
+		{
+			if (cached.size != current.size)
+				return false;
+
+			// Checkouts and copies touch files without changing them, hashing is still far
+			// cheaper than decoding
+			return cached.writeTime == current.writeTime ||
+			       cached.hash == IO::CacheFiles::hashFile(filename);
+		}
+	}
+
+	void TextureCache::setDirectory(const std::string& value)
+	{
+		directory = value;
+		if (!directory.empty() && directory.back() != '\\' && directory.back() != '/')
+			directory.push_back('\\');
+	}
+
+	void TextureCache::setMaxSize(uint64_t bytes) { maxSize = bytes; }
+
+	std::string TextureCache::getCacheFilename(const std::string& filename,
+	                                           const std::string& variant)
+	{
+		uint64_t key = IO::CacheFiles::hashBytes(filename.data(), filename.size());
+		if (!variant.empty())
+			key = IO::CacheFiles::hashBytes(variant.data(), variant.size(), key);
+
+		return directory + IO::formatString("%016llx.bin", static_cast<unsigned long long>(key));
+	}
+
+	bool TextureCache::load(const std::string& filename, const std::string& spriteFilename,
+	                        Entry& entry, const std::string& variant)
+	{
+		if (!isEnabled())
+			return false;
+
+		const std::string cacheFilename = getCacheFilename(filename, variant);
+		if (!IO::File::exists(cacheFilename))
+			return false;
+
+		IO::File cacheFile(IO::mbToWideStr(cacheFilename), L"rb");
+		const std::vector<uint8_t> bytes = cacheFile.readAllBytes();
+		cacheFile.close();
+
+		CacheHeader header{};
+		if (bytes.size() < sizeof(header))
+			return false;
+
+		std::memcpy(&header, bytes.data(), sizeof(header));
+		if (header.magic != cacheMagic || header.version != cacheVersion || header.width <= 0 ||
+		    header.height <= 0)
+			return false;
+
+		const size_t spritesSize = header.spriteCount * sizeof(std::array<float, 4>);
+		const size_t pixelsSize = static_cast<size_t>(header.width) * header.height * 4;
+		if (bytes.size() != sizeof(header) + spritesSize + pixelsSize)
+			return false;
+
+		if (!isSourceUnchanged(header.image, getSourceInfo(filename), filename))
+			return false;
+
+		if (!spriteFilename.empty() &&
+		    !isSourceUnchanged(header.sprites, getSourceInfo(spriteFilename), spriteFilename))
+			return false;
+
+		const uint8_t* data = bytes.data() + sizeof(header);
+		entry.width = header.width;
+		entry.height = header.height;
+		entry.sprites.resize(header.spriteCount);
+		if (spritesSize)
+			std::memcpy(entry.sprites.data(), data, spritesSize);
+
+		entry.pixels.assign(data + spritesSize, data + spritesSize + pixelsSize);
+		IO::CacheFiles::touch(cacheFilename);
+		return true;
+	}
+
+	void TextureCache::save(const std::string& filename, const std::string& spriteFilename,
+	                        const Entry& entry, const std::string& variant)
+	{
+		const size_t pixelsSize = static_cast<size_t>(entry.width) * entry.height * 4;
+		if (!isEnabled() || entry.pixels.size() != pixelsSize)
+			return;
+
+		CacheHeader header{};
+		header.magic = cacheMagic;
+		header.version = cacheVersion;
+		header.image = getSourceInfo(filename);
+		header.image.hash = IO::CacheFiles::hashFile(filename);
+		header.sprites = getSourceInfo(spriteFilename);
+		header.sprites.hash = IO::CacheFiles::hashFile(spriteFilename);
+		header.width = entry.width;
+		header.height = entry.height;
+		header.spriteCount = static_cast<uint32_t>(entry.sprites.size());
+
+		std::error_code error;
+		std::filesystem::create_directories(IO::mbToWideStr(directory), error);
+		if (error)
+			return;
+
+		if (IO::CacheFiles::write(getCacheFilename(filename, variant),
+		                          { { &header, sizeof(header) },
+		                            { entry.sprites.data(),
+		                              entry.sprites.size() * sizeof(std::array<float, 4>) },
+		                            { entry.pixels.data(), entry.pixels.size() } }))
+			IO::CacheFiles::evict(directory, maxSize);
+	}
+
+	bool TextureCache::loadPixels(const std::string& filename, Entry& entry)
+	{
+		if (load(filename, "", entry))
+			return true;
+
+		int channels{};
+		stbi_set_flip_vertically_on_load(0);
+		uint8_t* data = stbi_load(filename.c_str(), &entry.width, &entry.height, &channels, 4);
+		if (!data)
+			return false;
+
+		entry.pixels.assign(data, data + static_cast<size_t>(entry.width) * entry.height * 4);
+		stbi_image_free(data);
+		return true;
+	}
+}
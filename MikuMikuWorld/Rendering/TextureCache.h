@@ -0,0 +1,58 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace MikuMikuWorld
+{
+	/**
+	 * @brief On-disk cache of decoded images and their parsed sprite sheets.
+	 * Entries are validated against the size and write time of the source files and fall back
+	 * to comparing content hashes when only the write time changed. The least recently used
+	 * entries are evicted past a size limit since every blurred background adds one.
+	 */
+	class TextureCache
+	{
+	  public:
+		struct Entry
+		{
+			int width{};
+			int height{};
+			std::vector<uint8_t> pixels;
+			std::vector<std::array<float, 4>> sprites;
+		};
+
+	  private:
+		static std::string directory;
+		static uint64_t maxSize;
+
+		static std::string getCacheFilename(const std::string& filename,
+		                                    const std::string& variant);
+
+	  public:
+		static constexpr uint64_t defaultMaxSize{ uint64_t{ 512 } << 20 };
+
+		/**
+		 * @brief Set where cache files are stored, an empty directory disables the cache
+		 */
+		static void setDirectory(const std::string& directory);
+		static void setMaxSize(uint64_t bytes);
+		static inline bool isEnabled() { return !directory.empty(); }
+
+		/**
+		 * @brief Load a cached entry in a single read.
+		 * An empty sprite filename skips validating (and loading) the sprite table.
+		 * The variant keeps processed versions of the same image apart (ex. blurred backgrounds).
+		 */
+		static bool load(const std::string& filename, const std::string& spriteFilename,
+		                 Entry& entry, const std::string& variant = {});
+		static void save(const std::string& filename, const std::string& spriteFilename,
+		                 const Entry& entry, const std::string& variant = {});
+
+		/**
+		 * @brief Get the RGBA8 pixels of an image from the cache or by decoding it
+		 */
+		static bool loadPixels(const std::string& filename, Entry& entry);
+	};
+}
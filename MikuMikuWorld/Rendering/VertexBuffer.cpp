@@ -67,6 +67,10 @@ namespace MikuMikuWorld
 		delete[] buffer;
 		delete[] indices;
 
+		// Never set up when the renderer only draws into software targets
+		if (!vao)
+			return;
+
 		glDeleteVertexArrays(1, &vao);
 		glDeleteBuffers(1, &vbo);
 		glDeleteBuffers(1, &ebo);
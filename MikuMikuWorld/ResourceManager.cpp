@@ -6,6 +6,7 @@ namespace MikuMikuWorld
 {
 	std::vector<Texture> ResourceManager::textures;
 	std::vector<Shader*> ResourceManager::shaders;
+	TextureAtlas ResourceManager::noteAtlas;
 
 	void ResourceManager::loadTexture(const std::string& filename, TextureFilterMode minFilter,
 	                                  TextureFilterMode magFilter)
@@ -23,7 +24,7 @@ namespace MikuMikuWorld
 				return;
 		}
 
-		Texture tex(filename, minFilter, magFilter);
+		Texture tex(filename, minFilter, magFilter, true);
 		textures.push_back(tex);
 	}
 
@@ -72,4 +73,23 @@ namespace MikuMikuWorld
 			}
 		}
 	}
+
+	bool ResourceManager::buildNoteAtlas(const std::vector<int>& textureIndices)
+	{
+		std::vector<const Texture*> atlasTextures;
+		for (int index : textureIndices)
+		{
+			if (index >= 0 && index < textures.size())
+				atlasTextures.push_back(&textures[index]);
+		}
+
+		if (!noteAtlas.build(atlasTextures))
+		{
+			printf("WARNING: ResourceManager::buildNoteAtlas() Note textures do not fit in an "
+			       "atlas, drawing them separately\n");
+			return false;
+		}
+
+		return true;
+	}
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include <vector>
 #include "Rendering/Texture.h"
 #include "Rendering/Shader.h"
+#include "Rendering/TextureAtlas.h"
 
 namespace MikuMikuWorld
 {
@@ -10,6 +11,7 @@ namespace MikuMikuWorld
 	  public:
 		static std::vector<Texture> textures;
 		static std::vector<Shader*> shaders;
+		static TextureAtlas noteAtlas;
 
 		static void loadTexture(const std::string& filename,
 		                        TextureFilterMode minFilter = TextureFilterMode::Linear,
@@ -21,5 +23,10 @@ namespace MikuMikuWorld
 		static int getShader(const std::string& name);
 
 		static void disposeTexture(int texID);
+
+		/**
+		 * @brief Pack the textures at the given indices into noteAtlas
+		 */
+		static bool buildNoteAtlas(const std::vector<int>& textureIndices);
 	};
 }
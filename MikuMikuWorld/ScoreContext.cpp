@@ -1,4 +1,5 @@
 #include "ScoreContext.h"
+#include "Audio/AudioCache.h"
 #include "Constants.h"
 #include "IO.h"
 #include "UI.h"
@@ -1388,6 +1389,9 @@ namespace MikuMikuWorld
 			upToDate = false;
 
 			scoreStats.calculateStats(score);
+			holdIndex.invalidate();
+			noteSounds.invalidate();
+			noteGrid.invalidate();
 		}
 	}
 
@@ -1405,6 +1409,9 @@ namespace MikuMikuWorld
 			upToDate = false;
 
 			scoreStats.calculateStats(score);
+			holdIndex.invalidate();
+			noteSounds.invalidate();
+			noteGrid.invalidate();
 		}
 	}
 
@@ -1416,10 +1423,71 @@ namespace MikuMikuWorld
 		                                                : windowUntitled) +
 		                   "*");
 		scoreStats.calculateStats(score);
+		holdIndex.invalidate();
+		noteSounds.invalidate();
+		noteGrid.invalidate();
 
 		upToDate = false;
 	}
 
+	void ScoreContext::generateWaveforms()
+	{
+		Audio::MusicStream& music = *audio.musicStream;
+		const uint64_t hash = music.sourceHash;
+		const uint64_t frameCount = music.frameCount;
+		music.stopScan();
+		if (music.isValid() && Audio::AudioCache::hasPeaks(hash, 0, frameCount) &&
+		    Audio::AudioCache::hasPeaks(hash, 1, frameCount))
+		{
+			waveformL.loadCachedPeaks(hash, frameCount, music.sampleRate, 0);
+			waveformR.loadCachedPeaks(hash, frameCount, music.sampleRate, 1);
+			return;
+		}
+
+		waveformL.beginStream(frameCount, music.sampleRate, 0);
+		waveformR.beginStream(frameCount, music.sampleRate, 1);
+		if (!music.isValid())
+			return;
+
+		// The scan decodes the whole track anyway, keep its frames for the next time it's opened
+		std::shared_ptr<Audio::AudioCache::PcmWriter> pcmWriter;
+		if (!music.isDecodedFromCache)
+			pcmWriter = std::make_shared<Audio::AudioCache::PcmWriter>(hash, music.channelCount,
+			                                                           music.sampleRate);
+
+		music.startScan(
+		    [this, pcmWriter](const int16_t* samples, ma_uint32 channels, ma_uint64 frames)
+		    {
+			    waveformL.appendFrames(samples, channels, frames);
+			    waveformR.appendFrames(samples, channels, frames);
+			    if (pcmWriter)
+				    pcmWriter->write(samples, frames);
+		    },
+		    [this, pcmWriter, hash, frameCount]
+		    {
+			    waveformL.finishStream();
+			    waveformR.finishStream();
+			    if (pcmWriter)
+				    pcmWriter->commit();
+
+			    Audio::AudioCache::savePeaks(hash, 0, frameCount, waveformL.mips[0].peaks);
+			    Audio::AudioCache::savePeaks(hash, 1, frameCount, waveformR.mips[0].peaks);
+		    });
+	}
+
+	void ScoreContext::updateSpectrogram()
+	{
+		const Audio::MusicStream& music = *audio.musicStream;
+		const std::wstring musicPath = music.isValid() ? music.getPath() : std::wstring{};
+		if (spectrogram.getFilename() == musicPath)
+			return;
+
+		if (musicPath.empty())
+			spectrogram.clear();
+		else
+			spectrogram.generateFromFile(musicPath, music.sourceHash);
+	}
+
 	bool ScoreContext::selectionHasEase() const
 	{
 		return std::any_of(selectedNotes.begin(), selectedNotes.end(),
@@ -1,10 +1,14 @@
 #pragma once
 #include "Audio/AudioManager.h"
+#include "Audio/Spectrogram.h"
 #include "Audio/Waveform.h"
 #include "Constants.h"
 #include "HistoryManager.h"
+#include "HoldIntervalIndex.h"
 #include "Jacket.h"
 #include "JsonIO.h"
+#include "NoteSoundTimeline.h"
+#include "NoteSpatialGrid.h"
 #include "Score.h"
 #include "ScoreStats.h"
 #include "TimelineMode.h"
@@ -85,6 +89,10 @@ namespace MikuMikuWorld
 		std::unordered_set<id_t> selectedHiSpeedChanges;
 
 		Audio::WaveformMipChain waveformL, waveformR;
+		Audio::SpectrogramMipChain spectrogram;
+		HoldIntervalIndex holdIndex;
+		NoteSpatialGrid noteGrid;
+		NoteSoundTimeline noteSounds;
 
 		int currentTick{};
 		bool upToDate{ true };
@@ -124,6 +132,31 @@ namespace MikuMikuWorld
 			return holds;
 		}
 
+		/**
+		 * @brief Collect the holds whose tick span overlaps [startTick, endTick].
+		 * The index is rebuilt on demand after the score changed.
+		 */
+		size_t findHoldsInRange(int startTick, int endTick, std::vector<id_t>& holds)
+		{
+			if (holdIndex.isDirty())
+				holdIndex.build(score);
+
+			return holdIndex.query(startTick, endTick, holds);
+		}
+
+		/**
+		 * @brief Collect the notes in [startTick, endTick] overlapping the lanes [minLane, maxLane].
+		 * The grid is rebuilt on demand after the score changed.
+		 */
+		size_t findNotesInRange(int startTick, int endTick, float minLane, float maxLane,
+		                        std::vector<id_t>& notes)
+		{
+			if (noteGrid.isDirty())
+				noteGrid.build(score);
+
+			return noteGrid.query(startTick, endTick, minLane, maxLane, notes);
+		}
+
 		double getTimeAtCurrentTick() const
 		{
 			return accumulateDuration(currentTick, TICKS_PER_BEAT, score.tempoChanges);
@@ -185,5 +218,16 @@ namespace MikuMikuWorld
 		void undo();
 		void redo();
 		void pushHistory(std::string description, const Score& prev, const Score& current);
+
+		/**
+		 * @brief Build both waveform channels while the music stream's worker scans the track
+		 */
+		void generateWaveforms();
+
+		/**
+		 * @brief Start building the spectrogram of the music unless it already is.
+		 * Only called while it is shown so it is never computed otherwise.
+		 */
+		void updateSpectrogram();
 	};
 }
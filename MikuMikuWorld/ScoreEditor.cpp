@@ -7,6 +7,8 @@
 #include "ApplicationConfiguration.h"
 #include "Constants.h"
 #include "File.h"
+#include "Profiler.h"
+#include "ResourceManager.h"
 #include "SUS.h"
 #include "ScoreConverter.h"
 #include "SusExporter.h"
@@ -37,11 +39,13 @@ namespace MikuMikuWorld
 	ScoreEditor::ScoreEditor()
 	{
 		renderer = std::make_unique<Renderer>();
+		renderer->setTextureAtlas(&ResourceManager::noteAtlas);
 
 		context.audio.initializeAudioEngine();
 		context.audio.setMasterVolume(config.masterVolume);
 		context.audio.setMusicVolume(config.bgmVolume);
 		context.audio.setSoundEffectsVolume(config.seVolume);
+		context.audio.setPreservePitch(config.preservePitch);
 		context.audio.loadSoundEffects();
 		context.audio.setSoundEffectsProfileIndex(config.seProfileIndex);
 
@@ -164,6 +168,8 @@ namespace MikuMikuWorld
 
 	void ScoreEditor::update()
 	{
+		PROFILE_SCOPE("ScoreEditor::update");
+
 		drawMenubar();
 		drawToolbar();
 
@@ -253,6 +259,9 @@ namespace MikuMikuWorld
 		if (config.backgroundBrightness != timeline.background.getBrightness())
 			timeline.background.setBrightness(config.backgroundBrightness);
 
+		if (config.backgroundBlur != timeline.background.getBlur())
+			timeline.background.setBlur(config.backgroundBlur);
+
 		if (settingsWindow.isBackgroundChangePending)
 		{
 			static const std::string defaultBackgroundPath =
@@ -262,12 +271,17 @@ namespace MikuMikuWorld
 			settingsWindow.isBackgroundChangePending = false;
 		}
 
+		context.workingData.jacket.update();
+
 		if (config.seProfileIndex != context.audio.getSoundEffectsProfileIndex())
 		{
 			context.audio.stopSoundEffects(false);
 			context.audio.setSoundEffectsProfileIndex(config.seProfileIndex);
 		}
 
+		if (config.preservePitch != context.audio.getPreservePitch())
+			context.audio.setPreservePitch(config.preservePitch);
+
 		if (propertiesWindow.isPendingLoadMusic)
 		{
 			loadMusic(propertiesWindow.pendingLoadMusicFilename);
@@ -275,6 +289,16 @@ namespace MikuMikuWorld
 			propertiesWindow.isPendingLoadMusic = false;
 		}
 
+		if (propertiesWindow.isPendingCancelMusicLoad)
+		{
+			cancelMusicLoad();
+			propertiesWindow.isPendingCancelMusicLoad = false;
+		}
+
+		updateMusicLoad();
+		updateAudioExport();
+		propertiesWindow.updateTempoAnalysis();
+
 		if (config.autoSaveEnabled && autoSaveTimer.elapsedMinutes() >= config.autoSaveInterval)
 		{
 			autoSave();
@@ -300,12 +324,14 @@ namespace MikuMikuWorld
 
 		if (config.debugEnabled)
 		{
-			debugWindow.update(context, timeline);
+			PROFILE_SCOPE("DebugWindow::update");
+			debugWindow.update(context, timeline, renderer.get());
 		}
 
 		if (ImGui::Begin(IMGUI_TITLE(ICON_FA_ALIGN_LEFT, "chart_properties"), NULL,
 		                 ImGuiWindowFlags_Static))
 		{
+			PROFILE_SCOPE("ScorePropertiesWindow::update");
 			propertiesWindow.update(context);
 		}
 		ImGui::End();
@@ -313,12 +339,14 @@ namespace MikuMikuWorld
 		if (ImGui::Begin(IMGUI_TITLE(ICON_FA_WRENCH, "note_properties"), NULL,
 		                 ImGuiWindowFlags_Static))
 		{
+			PROFILE_SCOPE("ScoreNotePropertiesWindow::update");
 			notePropertiesWindow.update(context);
 		}
 		ImGui::End();
 
 		if (ImGui::Begin(IMGUI_TITLE(ICON_FA_WRENCH, "options"), NULL, ImGuiWindowFlags_Static))
 		{
+			PROFILE_SCOPE("ScoreOptionsWindow::update");
 			optionsWindow.update(context, edit, timeline.getMode());
 		}
 		ImGui::End();
@@ -326,12 +354,14 @@ namespace MikuMikuWorld
 		if (ImGui::Begin(IMGUI_TITLE(ICON_FA_DRAFTING_COMPASS, "presets"), NULL,
 		                 ImGuiWindowFlags_Static))
 		{
+			PROFILE_SCOPE("PresetsWindow::update");
 			presetsWindow.update(context, presetManager);
 		}
 		ImGui::End();
 
 		if (ImGui::Begin(IMGUI_TITLE(ICON_FA_LAYER_GROUP, "layers"), NULL, ImGuiWindowFlags_Static))
 		{
+			PROFILE_SCOPE("LayersWindow::update");
 			layersWindow.update(context);
 		}
 		ImGui::End();
@@ -339,6 +369,7 @@ namespace MikuMikuWorld
 		if (ImGui::Begin(IMGUI_TITLE(ICON_FA_LOCATION_ARROW, "waypoints"), NULL,
 		                 ImGuiWindowFlags_Static))
 		{
+			PROFILE_SCOPE("WaypointsWindow::update");
 			waypointsWindow.update(context);
 		}
 		ImGui::End();
@@ -371,6 +402,11 @@ namespace MikuMikuWorld
 		context.workingData = {};
 		context.history.clear();
 		context.scoreStats.reset();
+		context.holdIndex.invalidate();
+		context.noteSounds.invalidate();
+		context.noteGrid.invalidate();
+		// Stops the waveform scan before the waveforms are cleared
+		context.audio.cancelMusicLoad();
 		context.audio.disposeMusic();
 		context.waveformL.clear();
 		context.waveformR.clear();
@@ -382,45 +418,54 @@ namespace MikuMikuWorld
 		UI::setWindowTitle(windowUntitled);
 	}
 
+	Score ScoreEditor::readScoreFile(const std::string& filename, std::string& workingFilename)
+	{
+		std::string extension = IO::File::getFileExtension(filename);
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+		Score score;
+		if (extension == SUS_EXTENSION)
+		{
+			SusParser susParser;
+			score = ScoreConverter::susToScore(susParser.parse(filename));
+		}
+		else if (extension == USC_EXTENSION)
+		{
+			std::wstring wFilename = IO::mbToWideStr(filename);
+			std::ifstream uscfile(wFilename);
+			json usc;
+			uscfile >> usc;
+			uscfile.close();
+
+			//score = ScoreConverter::uscToScore(usc);
+			score = ScoreConverter::tougekiToScore(usc);
+		}
+		else if (extension == MMWS_EXTENSION || extension == CC_MMWS_EXTENSION)
+		{
+			score = deserializeScore(filename);
+			workingFilename = filename;
+		}
+
+		return score;
+	}
+
 	void ScoreEditor::loadScore(std::string filename)
 	{
 		if (!IO::File::exists(filename))
 			return;
 
-		std::string extension = IO::File::getFileExtension(filename);
-		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
-
 		// Backup next note ID in case of an import failure
 		try
 		{
 			std::string workingFilename;
-			Score newScore;
-
-			if (extension == SUS_EXTENSION)
-			{
-				SusParser susParser;
-				newScore = ScoreConverter::susToScore(susParser.parse(filename));
-			}
-			else if (extension == USC_EXTENSION)
-			{
-				std::wstring wFilename = IO::mbToWideStr(filename);
-				std::ifstream uscfile(wFilename);
-				json usc;
-				uscfile >> usc;
-				uscfile.close();
-
-				//newScore = ScoreConverter::uscToScore(usc);
-				newScore = ScoreConverter::tougekiToScore(usc);
-			}
-			else if (extension == MMWS_EXTENSION || extension == CC_MMWS_EXTENSION)
-			{
-				newScore = deserializeScore(filename);
-				workingFilename = filename;
-			}
+			Score newScore = readScoreFile(filename, workingFilename);
 
 			context.clearSelection();
 			context.history.clear();
 			context.score = std::move(newScore);
+			context.holdIndex.invalidate();
+			context.noteSounds.invalidate();
+			context.noteGrid.invalidate();
 			context.workingData = EditorScoreData(context.score.metadata, workingFilename);
 
 			loadMusic(context.workingData.musicFilename);
@@ -449,8 +494,29 @@ namespace MikuMikuWorld
 
 	void ScoreEditor::loadMusic(std::string filename)
 	{
-		Result result = context.audio.loadMusic(filename);
-		if (result.isOk() || filename.empty())
+		if (!filename.empty())
+		{
+			// Opened in the background, the score stays usable meanwhile
+			context.audio.loadMusicAsync(filename);
+			return;
+		}
+
+		context.audio.cancelMusicLoad();
+		timeline.setPlaying(context, false);
+		context.audio.disposeMusic();
+		context.workingData.musicFilename = filename;
+		context.generateWaveforms();
+	}
+
+	void ScoreEditor::updateMusicLoad()
+	{
+		if (!context.audio.isMusicLoadFinished())
+			return;
+
+		const std::string filename = context.audio.getPendingMusicFilename();
+		timeline.setPlaying(context, false);
+		Result result = context.audio.finishMusicLoad();
+		if (result.isOk())
 		{
 			context.workingData.musicFilename = filename;
 		}
@@ -464,9 +530,17 @@ namespace MikuMikuWorld
 			               IO::MessageBoxIcon::Error);
 		}
 
-		context.waveformL.generateMipChainsFromSampleBuffer(context.audio.musicBuffer, 0);
-		context.waveformR.generateMipChainsFromSampleBuffer(context.audio.musicBuffer, 1);
-		timeline.setPlaying(context, false);
+		context.generateWaveforms();
+	}
+
+	void ScoreEditor::cancelMusicLoad()
+	{
+		context.audio.cancelMusicLoad();
+
+		// Keep the part of the waveform scanned so far
+		context.audio.musicStream->stopScan();
+		context.waveformL.finishStream();
+		context.waveformR.finishStream();
 	}
 
 	void ScoreEditor::open()
@@ -631,6 +705,53 @@ namespace MikuMikuWorld
 		}
 	}
 
+	void ScoreEditor::exportAudio()
+	{
+		if (audioRenderer.isRunning())
+			return;
+
+		IO::FileDialog fileDialog{};
+		fileDialog.title = "Export Audio";
+		fileDialog.filters = { { "Waveform Audio", "*.wav" } };
+		fileDialog.defaultExtension = "wav";
+		fileDialog.parentWindowHandle = Application::windowState.windowHandle;
+		fileDialog.inputFilename =
+		    IO::File::getFilenameWithoutExtension(context.workingData.filename);
+
+		if (fileDialog.saveFile() != IO::FileDialogResult::OK)
+			return;
+
+		Audio::OfflineRenderSettings settings{};
+		settings.musicFilename = context.workingData.musicFilename;
+		settings.musicOffset = context.workingData.musicOffset / 1000.0f;
+		settings.sampleRate = context.audio.getDeviceSampleRate();
+		settings.channelCount = context.audio.getDeviceChannelCount();
+		settings.soundEffectsProfileIndex = config.seProfileIndex;
+		settings.masterVolume = context.audio.getMasterVolume();
+		settings.musicVolume = context.audio.getMusicVolume();
+		settings.soundEffectsVolume = context.audio.getSoundEffectsVolume();
+
+		// The editor's timeline keeps a playback cursor, render from a copy built now
+		NoteSoundTimeline sounds;
+		sounds.setMetronome(config.renderMetronome, context.audio.getMusicEndTime());
+		sounds.build(context.score);
+		audioRenderer.renderAsync(std::move(sounds), std::move(settings),
+		                          fileDialog.outputFilename);
+	}
+
+	void ScoreEditor::updateAudioExport()
+	{
+		if (!audioRenderer.isFinished() || !audioRenderer.isRunning())
+			return;
+
+		Result result = audioRenderer.finish();
+		if (result.getStatus() == ResultStatus::Error)
+			IO::messageBox(APP_NAME,
+			               IO::formatString("An error occurred while exporting the audio\n%s",
+			                                result.getMessage().c_str()),
+			               IO::MessageBoxButtons::Ok, IO::MessageBoxIcon::Error);
+	}
+
 	void ScoreEditor::drawMenubar()
 	{
 		ImGui::BeginMainMenuBar();
@@ -689,6 +810,10 @@ namespace MikuMikuWorld
 			if (ImGui::MenuItem(getString("export_usc"), ToShortcutString(config.input.exportUsc)))
 				exportUsc();
 
+			if (ImGui::MenuItem(getString("export_audio"), nullptr, false,
+			                    !audioRenderer.isRunning()))
+				exportAudio();
+
 			if (config.showSusExport)
 			{
 
@@ -791,6 +916,7 @@ namespace MikuMikuWorld
 			ImGui::MenuItem(getString("return_to_last_tick"), NULL,
 			                &config.returnToLastSelectedTickOnPause);
 			ImGui::MenuItem(getString("draw_waveform"), NULL, &config.drawWaveform);
+			ImGui::MenuItem(getString("draw_spectrogram"), NULL, &config.drawSpectrogram);
 
 			ImGui::EndMenu();
 		}
@@ -832,6 +958,7 @@ namespace MikuMikuWorld
 				glfwSwapInterval(config.vsync);
 
 			ImGui::MenuItem(getString("show_fps"), NULL, &config.showFPS);
+			ImGui::MenuItem(getString("idle_throttling"), NULL, &config.idleThrottling);
 
 			ImGui::EndMenu();
 		}
@@ -847,13 +974,24 @@ namespace MikuMikuWorld
 			ImGui::EndMenu();
 		}
 
+		if (audioRenderer.isRunning())
+		{
+			std::string rendering = IO::formatString("%s %.0f%%", getString("rendering_audio"),
+			                                         audioRenderer.getProgress() * 100);
+			ImGui::TextUnformatted(rendering.c_str());
+			if (ImGui::SmallButton(ICON_FA_TIMES))
+				audioRenderer.cancel();
+		}
+
 		if (config.showFPS)
 		{
-			std::string fps = IO::formatString("%.3fms (%.1fFPS)", ImGui::GetIO().DeltaTime * 1000,
-			                                   ImGui::GetIO().Framerate);
+			const FrameStatistics& stats = Application::frameStatistics;
+			std::string fps = IO::formatString(
+			    "%.3fms (%.1fFPS) | %d redraws/s, %.0f%% idle", ImGui::GetIO().DeltaTime * 1000,
+			    ImGui::GetIO().Framerate, stats.framesPerSecond, stats.idleRatio * 100);
 			ImGui::SetCursorPosX(ImGui::GetWindowSize().x - ImGui::CalcTextSize(fps.c_str()).x -
 			                     ImGui::GetStyle().WindowPadding.x);
-			ImGui::Text(fps.c_str());
+			ImGui::TextUnformatted(fps.c_str());
 		}
 
 		ImGui::PopStyleVar();
@@ -962,6 +1100,14 @@ namespace MikuMikuWorld
 		ShellExecuteW(0, 0, L"https://github.com/crash5band/MikuMikuWorld/wiki", 0, 0, SW_SHOW);
 	}
 
+	bool ScoreEditor::needsContinuousRedraw() const
+	{
+		return timeline.isAnimating() || ImGui::IsAnyMouseDown() ||
+		       context.waveformL.isGenerating() || context.waveformR.isGenerating() ||
+		       context.spectrogram.isGenerating() ||
+		       audioRenderer.isRunning() || propertiesWindow.isEstimatingTempo();
+	}
+
 	void ScoreEditor::autoSave()
 	{
 		std::wstring wAutoSaveDir = IO::mbToWideStr(autoSavePath);
@@ -1,4 +1,5 @@
 #include "ScoreEditorWindows.h"
+#include "Audio/OfflineRenderer.h"
 #include <future>
 
 namespace MikuMikuWorld
@@ -24,6 +25,8 @@ namespace MikuMikuWorld
 		AboutDialog aboutDialog{};
 		UpdateAvailableDialog updateAvailableDialog{};
 
+		Audio::OfflineRenderer audioRenderer;
+
 		Stopwatch autoSaveTimer;
 		std::string autoSavePath;
 		bool showImGuiDemoWindow;
@@ -41,14 +44,31 @@ namespace MikuMikuWorld
 		void create();
 		void open();
 		void loadScore(std::string filename);
+
+		/**
+		 * @brief Parse a score file without touching the editor's state
+		 * @param workingFilename Set to the filename if the editor can save back to it
+		 */
+		static Score readScoreFile(const std::string& filename, std::string& workingFilename);
+
 		void loadMusic(std::string filename);
+		void updateMusicLoad();
+		void cancelMusicLoad();
 		void exportSus();
 		bool exportUsc();
+		void exportAudio();
+		void updateAudioExport();
 		bool saveAs();
 		bool trySave(std::string);
 		void autoSave();
 		int deleteOldAutoSave(int count);
 
+		/**
+		 * @brief Whether the next frame must be drawn even without input
+		 * (ex. playback, smooth scrolling or a dragged mouse)
+		 */
+		bool needsContinuousRedraw() const;
+
 		void drawMenubar();
 		void drawToolbar();
 		void help();
@@ -3,12 +3,14 @@
 #include "ApplicationConfiguration.h"
 #include "Colors.h"
 #include "Constants.h"
+#include "Profiler.h"
 #include "ResourceManager.h"
 #include "Tempo.h"
 #include "Score.h"
 #include "UI.h"
 #include "Utilities.h"
 #include <algorithm>
+#include <limits>
 #include <string>
 
 namespace MikuMikuWorld
@@ -214,14 +216,22 @@ namespace MikuMikuWorld
 		maxOffset = std::max(offset / zoom, (maxTick * unitHeight) + 1000);
 	}
 
+	bool ScoreEditorTimeline::isAnimating() const
+	{
+		return playing || abs(offset - visualOffset) > 0.5f;
+	}
+
 	void ScoreEditorTimeline::updateScrollingPosition()
 	{
 		if (config.useSmoothScrolling)
 		{
 			float scrollAmount = offset - visualOffset;
 			float remainingScroll = abs(scrollAmount);
-			float delta =
-			    scrollAmount / (config.smoothScrollingTime / (ImGui::GetIO().DeltaTime * 1000));
+
+			// The first frame after an idle wait can have a long delta time, don't overshoot
+			float factor =
+			    std::min(1.0f, (ImGui::GetIO().DeltaTime * 1000) / config.smoothScrollingTime);
+			float delta = scrollAmount * factor;
 
 			visualOffset += std::min(remainingScroll, delta);
 			remainingScroll = std::max(0.0f, remainingScroll - abs(delta));
@@ -392,12 +402,49 @@ namespace MikuMikuWorld
 				}
 				ImGui::EndMenu();
 			}
+
+			ImGui::Separator();
+			const int defaultLoopLength = TICKS_PER_BEAT * 4;
+			if (ImGui::MenuItem(getString("set_loop_start")))
+			{
+				const int endTick = loopEndTick > context.currentTick
+				                        ? loopEndTick
+				                        : context.currentTick + defaultLoopLength;
+				setLoopRegion(context, context.currentTick, endTick);
+			}
+
+			if (ImGui::MenuItem(getString("set_loop_end"), NULL, false, context.currentTick > 0))
+			{
+				const int startTick = loopStartTick < context.currentTick
+				                          ? loopStartTick
+				                          : std::max(0, context.currentTick - defaultLoopLength);
+				setLoopRegion(context, startTick, context.currentTick);
+			}
+
+			if (ImGui::MenuItem(getString("loop_selection"), NULL, false,
+			                    !context.selectedNotes.empty()))
+			{
+				auto [minTick, maxTick] = std::minmax_element(
+				    context.selectedNotes.begin(), context.selectedNotes.end(),
+				    [&context](id_t a, id_t b)
+				    { return context.score.notes.at(a).tick < context.score.notes.at(b).tick; });
+
+				const int startTick = context.score.notes.at(*minTick).tick;
+				const int endTick = context.score.notes.at(*maxTick).tick;
+				setLoopRegion(context, startTick, std::max(endTick, startTick + TICKS_PER_BEAT));
+			}
+
+			if (ImGui::MenuItem(getString("clear_loop"), NULL, false, hasLoopRegion()))
+				setLoopRegion(context, 0, 0);
+
 			ImGui::EndPopup();
 		}
 	}
 
 	void ScoreEditorTimeline::update(ScoreContext& context, EditArgs& edit, Renderer* renderer)
 	{
+		PROFILE_SCOPE("ScoreEditorTimeline::update");
+
 		prevSize = size;
 		prevPos = position;
 
@@ -415,24 +462,24 @@ namespace MikuMikuWorld
 		drawList->PushClipRect(boundaries.Min, boundaries.Max, true);
 		drawList->AddRectFilled(boundaries.Min, boundaries.Max, 0xff202020);
 
-		if (background.isDirty())
-		{
+		background.update();
+		if (background.isDirty() || prevSize.x != size.x || prevSize.y != size.y)
 			background.resize({ size.x, size.y });
-			background.process(renderer);
-		}
-		else if (prevSize.x != size.x || prevSize.y != size.y)
-		{
-			background.resize({ size.x, size.y });
-		}
 
-		if (config.drawBackground)
+		if (background.isDirty())
+			background.process();
+
+		if (config.drawBackground && background.getTextureID())
 		{
 			const float bgWidth = static_cast<float>(background.getWidth());
 			const float bgHeight = static_cast<float>(background.getHeight());
+			const float brightness = background.getBrightness();
 			ImVec2 bgPos{ position.x - (abs(bgWidth - size.x) / 2.0f),
 				          position.y - (abs(bgHeight - size.y) / 2.0f) };
 			drawList->AddImage((ImTextureID)background.getTextureID(), bgPos,
-			                   bgPos + ImVec2{ bgWidth, bgHeight });
+			                   bgPos + ImVec2{ bgWidth, bgHeight }, ImVec2{ 0, 0 }, ImVec2{ 1, 1 },
+			                   ImGui::ColorConvertFloat4ToU32(
+			                       { brightness, brightness, brightness, 1.0f }));
 		}
 
 		// Remember whether the last mouse click was in the timeline or not
@@ -459,7 +506,7 @@ namespace MikuMikuWorld
 			}
 
 			if (!isHoveringNote && !isHoldingNote && !insertingHold && !pasting &&
-			    currentMode == TimelineMode::Select)
+			    !isHoveringCursor && !isDraggingCursor && currentMode == TimelineMode::Select)
 			{
 				// Clicked inside timeline, the current mouse position is the first drag point
 				if (ImGui::IsMouseClicked(0))
@@ -500,8 +547,16 @@ namespace MikuMikuWorld
 			}
 
 			float yThreshold = (notesHeight * 0.5f) + 2.0f;
-			for (const auto& [id, note] : context.score.notes)
+
+			// Only look at the grid cells under the selection rectangle
+			noteQueryResults.clear();
+			context.findNotesInRange(positionToTick(-(bottom + yThreshold)) - 1,
+			                         positionToTick(-(top - yThreshold)) + 1,
+			                         positionToLane(left) - 1, positionToLane(right) + 1,
+			                         noteQueryResults);
+			for (id_t id : noteQueryResults)
 			{
+				const Note& note = context.score.notes.at(id);
 				const bool layerHidden = context.score.layers.at(note.layer).hidden;
 				if ((layerHidden || note.layer != context.selectedLayer) && !context.showAllLayers)
 					continue;
@@ -562,6 +617,9 @@ namespace MikuMikuWorld
 		if (config.drawWaveform)
 			drawWaveform(context);
 
+		if (config.drawSpectrogram)
+			drawSpectrogram(context);
+
 		// Draw lanes
 		// mod minlineʼ MAX_LANE
 		for (int l = MIN_LANE; l <= MAX_LANE; ++l)
@@ -682,6 +740,22 @@ namespace MikuMikuWorld
 		hoveringNote = -1;
 		isHoveringNote = false;
 
+		// Draw the loop region behind the cursor
+		if (hasLoopRegion())
+		{
+			const float loopY1 = position.y - tickToPosition(loopStartTick) + visualOffset;
+			const float loopY2 = position.y - tickToPosition(loopEndTick) + visualOffset;
+			drawList->AddRectFilled(ImVec2(exX1, loopY2), ImVec2(exX2, loopY1),
+			                        loopEnabled ? loopRegionColor : inactiveLoopRegionColor);
+			if (loopEnabled)
+			{
+				drawList->AddLine(ImVec2(exX1, loopY1), ImVec2(exX2, loopY1), loopColor,
+				                  primaryLineThickness);
+				drawList->AddLine(ImVec2(exX1, loopY2), ImVec2(exX2, loopY2), loopColor,
+				                  primaryLineThickness);
+			}
+		}
+
 		// Draw cursor behind notes
 		const float y = position.y - tickToPosition(context.currentTick) + visualOffset;
 		const int triPtOffset = 6;
@@ -692,6 +766,25 @@ namespace MikuMikuWorld
 		drawList->AddLine(ImVec2(exX1, y), ImVec2(exX2, y), cursorColor,
 		                  primaryLineThickness + 1.0f);
 
+		// Dragging the cursor's handle while paused scrubs through the music, it only snaps once
+		// released so the music under it plays continuously
+		ImGui::SetCursorScreenPos(ImVec2(triXPos, y - triPtOffset));
+		ImGui::InvisibleButton("##cursor_handle", ImVec2(triPtOffset * 2, triPtOffset * 2));
+		isHoveringCursor = !playing && ImGui::IsItemHovered();
+		isDraggingCursor = !playing && ImGui::IsItemActive();
+		if (isHoveringCursor || isDraggingCursor)
+			ImGui::SetMouseCursor(ImGuiMouseCursor_ResizeNS);
+
+		if (isDraggingCursor)
+		{
+			context.currentTick = std::max(positionToTick(-mousePos.y), 0);
+		}
+		else if (!playing && ImGui::IsItemDeactivated())
+		{
+			context.currentTick = hoverTick;
+			lastSelectedTick = context.currentTick;
+		}
+
 		contextMenu(context);
 
 		// Update hi-speed changes
@@ -784,8 +877,8 @@ namespace MikuMikuWorld
 
 		// Update cursor tick after determining whether a note is hovered
 		// The cursor tick should not change if a note is hovered
-		if (ImGui::IsMouseClicked(0) && !isHoveringNote && mouseInTimeline && !playing &&
-		    !pasting && !UI::isAnyPopupOpen() && currentMode == TimelineMode::Select &&
+		if (ImGui::IsMouseClicked(0) && !isHoveringNote && !isHoveringCursor && mouseInTimeline &&
+		    !playing && !pasting && !UI::isAnyPopupOpen() && currentMode == TimelineMode::Select &&
 		    ImGui::IsWindowFocused())
 		{
 			context.currentTick = hoverTick;
@@ -872,6 +965,32 @@ namespace MikuMikuWorld
 		if (UI::transparentButton(ICON_FA_FORWARD, UI::btnSmall, true, !playing))
 			nextTick(context);
 
+		ImGui::SameLine();
+		if (loopEnabled)
+			ImGui::PushStyleColor(ImGuiCol_Text, ImGui::GetStyleColorVec4(ImGuiCol_CheckMark));
+
+		const bool toggleLoop =
+		    UI::transparentButton(ICON_FA_SYNC, UI::btnSmall, false, hasLoopRegion());
+		if (loopEnabled)
+			ImGui::PopStyleColor();
+
+		UI::tooltip(getString("loop_playback"));
+		if (toggleLoop)
+			setLoopEnabled(context, !loopEnabled);
+
+		ImGui::SameLine();
+		const bool metronomeEnabled = config.metronome;
+		if (metronomeEnabled)
+			ImGui::PushStyleColor(ImGuiCol_Text, ImGui::GetStyleColorVec4(ImGuiCol_CheckMark));
+
+		if (UI::transparentButton(ICON_FA_DRUM, UI::btnSmall, false))
+			config.metronome = !config.metronome;
+
+		if (metronomeEnabled)
+			ImGui::PopStyleColor();
+
+		UI::tooltip(getString("metronome"));
+
 		ImGui::PopStyleColor();
 		ImGui::SameLine();
 		ImGui::SeparatorEx(ImGuiSeparatorFlags_Vertical);
@@ -987,10 +1106,26 @@ namespace MikuMikuWorld
 		if (playing)
 		{
 			time += ImGui::GetIO().DeltaTime * playbackSpeed;
+
+			// The audio engine wraps the music and sound effects by itself, the cursor follows
+			const bool wrapped = isLooping && time >= loopStartTime + loopLength;
+			if (wrapped)
+			{
+				const float passes = std::floor((time - loopStartTime) / loopLength);
+				time -= passes * loopLength;
+				loopPass += static_cast<int>(passes);
+			}
+
 			context.currentTick = accumulateTicks(time, TICKS_PER_BEAT, context.score.tempoChanges);
+			lastScrubTick = -1;
 
 			float cursorY = tickToPosition(context.currentTick);
-			if (config.followCursorInPlayback)
+			if (wrapped)
+			{
+				const float timelineOffset = size.y * (1.0f - config.cursorPositionThreshold);
+				visualOffset = offset = std::max(minOffset, cursorY + timelineOffset);
+			}
+			else if (config.followCursorInPlayback)
 			{
 				float timelineOffset = size.y * (1.0f - config.cursorPositionThreshold);
 				if (cursorY >= offset - timelineOffset)
@@ -1005,35 +1140,94 @@ namespace MikuMikuWorld
 		{
 			time =
 			    accumulateDuration(context.currentTick, TICKS_PER_BEAT, context.score.tempoChanges);
+
+			// Moving the cursor while paused plays a grain of the music under it
+			if (config.scrubAudio && lastScrubTick != -1 && context.currentTick != lastScrubTick)
+				context.audio.scrubMusic(time);
+
+			lastScrubTick = context.currentTick;
 		}
 	}
 
+	void ScoreEditorTimeline::findNotesNearMouse(ScoreContext& context)
+	{
+		notesNearMouse.clear();
+
+		// The held note's controls must keep being submitted until it is released, wherever it is
+		updateAllNotes = isHoldingNote;
+		if (updateAllNotes || !mouseInTimeline)
+			return;
+
+		// A note's controls can stick out of narrow notes by up to four control widths
+		const float laneMargin = (noteControlWidth * 4 + 4.0f) / laneWidth;
+		const float mouseLane = positionToLane(mousePos.x);
+
+		// Notes are laid out with the smoothed scroll offset while mousePos uses the target one
+		const float mouseY = mousePos.y + offset - visualOffset;
+		const int minTick = positionToTick(-mouseY - notesHeight * 0.5f) - 1;
+		const int maxTick = positionToTick(-mouseY + notesHeight * 0.5f) + 1;
+
+		context.findNotesInRange(minTick, maxTick, mouseLane - laneMargin, mouseLane + laneMargin,
+		                         notesNearMouse);
+	}
+
+	bool ScoreEditorTimeline::isNoteNearMouse(const Note& note) const
+	{
+		return updateAllNotes || std::find(notesNearMouse.begin(), notesNearMouse.end(), note.ID) !=
+		                             notesNearMouse.end();
+	}
+
 	void ScoreEditorTimeline::updateNotes(ScoreContext& context, EditArgs& edit, Renderer* renderer)
 	{
 		// directxmath dies
 		if (size.y < 10 || size.x < 10)
 			return;
 
+		PROFILE_SCOPE("ScoreEditorTimeline::updateNotes");
+
 		Shader* shader = ResourceManager::shaders[0];
 		shader->use();
 		shader->setMatrix4("projection", camera.getOffCenterOrthographicProjection(
 		                                     0, size.x, position.y, position.y + size.y));
 
+		// Made on first draw so previews can be rendered without an OpenGL context
+		if (!framebuffer)
+			framebuffer = std::make_unique<Framebuffer>(1920, 1080);
+
 		glEnable(GL_FRAMEBUFFER_SRGB);
 		framebuffer->bind();
 		framebuffer->clear();
 		renderer->beginBatch();
 
+		// Notes move without a history entry while dragged so the indices can not be trusted
+		if (isHoldingNote)
+		{
+			context.holdIndex.invalidate();
+			context.noteSounds.invalidate();
+			context.noteGrid.invalidate();
+		}
+
+		// Only notes and holds crossing the visible area (plus a note's height) need drawing
+		const int minVisibleTick = positionToTick(visualOffset - size.y - position.y - notesHeight) - 1;
+		const int maxVisibleTick = positionToTick(visualOffset + 100 + notesHeight) + 1;
+
+		findNotesNearMouse(context);
+
 		minNoteYDistance = INT_MAX;
-		for (auto& [id, note] : context.score.notes)
+		noteQueryResults.clear();
+		context.findNotesInRange(minVisibleTick, maxVisibleTick, std::numeric_limits<float>::lowest(),
+		                         std::numeric_limits<float>::max(), noteQueryResults);
+		for (id_t id : noteQueryResults)
 		{
+			Note& note = context.score.notes.at(id);
 			const bool layerHidden = context.score.layers.at(note.layer).hidden;
 			if (!isNoteVisible(note) || (layerHidden && !context.showAllLayers))
 				continue;
 
 			if (note.getType() == NoteType::Tap)
 			{
-				updateNote(context, edit, note);
+				if (isNoteNearMouse(note))
+					updateNote(context, edit, note);
 				drawNote(note, renderer,
 				         (context.showAllLayers || note.layer == context.selectedLayer)
 				             ? noteTint
@@ -1042,7 +1236,8 @@ namespace MikuMikuWorld
 			}
 			if (note.getType() == NoteType::Damage)
 			{
-				updateNote(context, edit, note);
+				if (isNoteNearMouse(note))
+					updateNote(context, edit, note);
 				drawCcNote(note, renderer,
 				           (context.showAllLayers || note.layer == context.selectedLayer)
 				               ? noteTint
@@ -1051,8 +1246,11 @@ namespace MikuMikuWorld
 			}
 		}
 
-		for (auto& [id, hold] : context.score.holdNotes)
+		holdQueryResults.clear();
+		context.findHoldsInRange(minVisibleTick, maxVisibleTick, holdQueryResults);
+		for (id_t id : holdQueryResults)
 		{
+			HoldNote& hold = context.score.holdNotes.at(id);
 			Note& start = context.score.notes.at(hold.start.ID);
 			Note& end = context.score.notes.at(hold.end);
 
@@ -1061,15 +1259,15 @@ namespace MikuMikuWorld
 			if ((startLayerHidden || endLayerHidden) && !context.showAllLayers)
 				continue;
 
-			if (isNoteVisible(start))
+			if (isNoteVisible(start) && isNoteNearMouse(start))
 				updateNote(context, edit, start);
-			if (isNoteVisible(end))
+			if (isNoteVisible(end) && isNoteNearMouse(end))
 				updateNote(context, edit, end);
 
 			for (const auto& step : hold.steps)
 			{
 				Note& mid = context.score.notes.at(step.ID);
-				if (isNoteVisible(mid))
+				if (isNoteVisible(mid) && isNoteNearMouse(mid))
 					updateNote(context, edit, mid);
 				if (skipUpdateAfterSortingSteps)
 					break;
@@ -1135,6 +1333,88 @@ namespace MikuMikuWorld
 		drawSteps.clear();
 	}
 
+	Result ScoreEditorTimeline::renderPreviewImage(ScoreContext& context, Renderer* renderer,
+	                                               int startTick, int endTick,
+	                                               const std::string& filename)
+	{
+		constexpr int maxImageHeight = 16384;
+
+		if (endTick < startTick)
+			std::swap(startTick, endTick);
+
+		const int extension = context.score.metadata.laneExtension;
+		const float margin = notesHeight;
+		const int width = static_cast<int>(laneWidth * (NUM_LANES + extension * 2) + margin * 2);
+		const int height = static_cast<int>(tickToPosition(endTick - startTick) + margin * 2);
+		if (height > maxImageHeight)
+			return Result(ResultStatus::Error, "The preview range is too long for the current zoom");
+
+		// Lay the timeline out over the image instead of the window and put it back afterwards
+		const ImVec2 prevPosition = position, prevSize = size;
+		const float prevLaneOffset = laneOffset, prevVisualOffset = visualOffset;
+
+		position = ImVec2(0, 0);
+		size = ImVec2(width, height);
+		laneOffset = laneWidth * extension + margin;
+		visualOffset = height - margin + tickToPosition(startTick);
+
+		SoftwareRenderer target(width, height);
+		target.clear(Color(0.12f, 0.1f, 0.11f, 1.0f));
+		target.setProjection(
+		    camera.getOffCenterOrthographicProjection(0, size.x, position.y, position.y + size.y));
+
+		renderingPreview = true;
+		renderer->setSoftwareTarget(&target);
+		renderer->beginBatch();
+
+		noteQueryResults.clear();
+		context.findNotesInRange(startTick - 1, endTick + 1, std::numeric_limits<float>::lowest(),
+		                         std::numeric_limits<float>::max(), noteQueryResults);
+		for (id_t id : noteQueryResults)
+		{
+			const Note& note = context.score.notes.at(id);
+			if (context.score.layers.at(note.layer).hidden && !context.showAllLayers)
+				continue;
+
+			if (note.getType() == NoteType::Tap)
+				drawNote(note, renderer, noteTint);
+			else if (note.getType() == NoteType::Damage)
+				drawCcNote(note, renderer, noteTint);
+		}
+
+		holdQueryResults.clear();
+		context.findHoldsInRange(startTick, endTick, holdQueryResults);
+		for (id_t id : holdQueryResults)
+		{
+			const HoldNote& hold = context.score.holdNotes.at(id);
+			const Note& start = context.score.notes.at(hold.start.ID);
+			const Note& end = context.score.notes.at(hold.end);
+			if ((context.score.layers.at(start.layer).hidden ||
+			     context.score.layers.at(end.layer).hidden) &&
+			    !context.showAllLayers)
+				continue;
+
+			drawHoldNote(context.score.notes, hold, renderer, noteTint);
+		}
+
+		renderer->endBatch();
+		renderer->setSoftwareTarget(nullptr);
+		renderingPreview = false;
+
+		// Step outlines are drawn with ImGui and have no place in the image
+		drawSteps.clear();
+
+		position = prevPosition;
+		size = prevSize;
+		laneOffset = prevLaneOffset;
+		visualOffset = prevVisualOffset;
+
+		if (!target.writePng(filename))
+			return Result(ResultStatus::Error, "Failed to write " + filename);
+
+		return Result::Ok();
+	}
+
 	void ScoreEditorTimeline::previewPaste(ScoreContext& context, Renderer* renderer)
 	{
 		context.pasteData.offsetLane =
@@ -1442,12 +1722,15 @@ namespace MikuMikuWorld
 		float xt = laneToPosition(lane);
 		float yt = getNoteYPosFromTick(tick);
 
-		for (const auto& [id, hold] : context.score.holdNotes)
+		// No need to search holds outside the cursor's reach
+		holdQueryResults.clear();
+		context.findHoldsInRange(tick, tick, holdQueryResults);
+		for (id_t id : holdQueryResults)
 		{
+			const HoldNote& hold = context.score.holdNotes.at(id);
 			const Note& start = context.score.notes.at(hold.start.ID);
 			const Note& end = context.score.notes.at(hold.end);
 
-			// No need to search holds outside the cursor's reach
 			if (start.tick > tick || end.tick < tick)
 				continue;
 
@@ -1969,9 +2252,23 @@ namespace MikuMikuWorld
 		int left = spr.getX() + holdCutoffX;
 		int right = spr.getX() + spr.getWidth() - holdCutoffX;
 
+		const float deltaX = std::max(abs(endX1 - startX1), abs(endX2 - startX2));
+		const bool layerSplit = selectedLayer != -1 &&
+		                        (n1.layer == selectedLayer) != (n2.layer == selectedLayer);
+
+		// Fading and cross-layer segments still need enough slices for a smooth tint gradient
+		int minSteps = layerSplit ? 2 : 1;
+		if (!isGuide && (startAlpha != endAlpha || layerSplit))
+			minSteps = std::max(minSteps, static_cast<int>(std::ceil(abs(endY - startY) / 10)));
+
+		// Only the slices that intersect the timeline are generated
+		const EaseSliceRange slices =
+		    getVisibleEaseSlices(ease, deltaX, startY, endY, 0, size.y + position.y + 100,
+		                         holdCurveTolerance, minSteps);
+
 		auto easeFunc = getEaseFunction(ease);
-		float steps = std::max(5.0f, std::ceilf(abs((endY - startY)) / 10));
-		for (int y = 0; y < steps; ++y)
+		const float steps = slices.steps;
+		for (int y = slices.first; y <= slices.last; ++y)
 		{
 			Color inactiveTint = tint * otherLayerTint;
 			const float percent1 = y / steps;
@@ -1988,13 +2285,6 @@ namespace MikuMikuWorld
 			            ? (int)ZIndex::zCount
 			            : 0;
 
-			if (y2 <= 0)
-				continue;
-
-			// rest of hold no longer visible
-			if (y1 > size.y + size.y + position.y + 100)
-				break;
-
 			// mod guildColor
 			Color localTint;
 			if (isGuide)
@@ -2545,7 +2835,7 @@ namespace MikuMikuWorld
 
 		//-------------------------------------------------- By Cursor text Ϊ1ʱ
 
-		if (note.extraSpeed != 1)
+		if (note.extraSpeed != 1 && !renderingPreview)
 		{
 			std::string extraSpeedStr = IO::formatString("%.2fx", note.extraSpeed);
 
@@ -2666,7 +2956,7 @@ namespace MikuMikuWorld
 
 		//-------------------------------------------------- By Cursor text Ϊ1ʱ
 
-		if (note.extraSpeed != 1)
+		if (note.extraSpeed != 1 && !renderingPreview)
 		{
 			std::string extraSpeedStr = IO::formatString("%.2fx", note.extraSpeed);
 
@@ -3187,7 +3477,6 @@ namespace MikuMikuWorld
 
 	ScoreEditorTimeline::ScoreEditorTimeline()
 	{
-		framebuffer = std::make_unique<Framebuffer>(1920, 1080);
 		playbackSpeed = 1.0f;
 
 		background.load(config.backgroundImage.empty()
@@ -3213,6 +3502,24 @@ namespace MikuMikuWorld
 		if (playing)
 		{
 			playStartTime = time;
+
+			// The loop only applies when playback starts before its end
+			const float loopEndTime =
+			    accumulateDuration(loopEndTick, TICKS_PER_BEAT, context.score.tempoChanges);
+			isLooping = loopEnabled && hasLoopRegion() && time < loopEndTime;
+			loopPass = 0;
+			if (isLooping)
+			{
+				loopStartTime =
+				    accumulateDuration(loopStartTick, TICKS_PER_BEAT, context.score.tempoChanges);
+				loopLength =
+				    static_cast<float>(context.audio.setMusicLoop(loopStartTime, loopEndTime));
+			}
+			else
+			{
+				context.audio.clearMusicLoop();
+			}
+
 			context.audio.seekMusic(time);
 			context.audio.playMusic(time);
 			context.audio.setLastPlaybackTime(time);
@@ -3233,6 +3540,33 @@ namespace MikuMikuWorld
 		}
 	}
 
+	void ScoreEditorTimeline::restartPlayback(ScoreContext& context)
+	{
+		context.audio.stopSoundEffects(false);
+		context.audio.stopMusic();
+		playing = false;
+		setPlaying(context, true);
+	}
+
+	void ScoreEditorTimeline::setLoopRegion(ScoreContext& context, int startTick, int endTick)
+	{
+		loopStartTick = startTick;
+		loopEndTick = endTick;
+		loopEnabled = hasLoopRegion();
+		if (playing)
+			restartPlayback(context);
+	}
+
+	void ScoreEditorTimeline::setLoopEnabled(ScoreContext& context, bool enabled)
+	{
+		if (loopEnabled == (enabled && hasLoopRegion()))
+			return;
+
+		loopEnabled = enabled && hasLoopRegion();
+		if (playing)
+			restartPlayback(context);
+	}
+
 	void ScoreEditorTimeline::stop(ScoreContext& context)
 	{
 		playing = false;
@@ -3249,78 +3583,198 @@ namespace MikuMikuWorld
 		if (!playing)
 			return;
 
-		static auto singleNoteSEFunc = [&context, this](const Note& note, float notePlayTime)
-		{
-			bool playSE = true;
-			if (note.getType() == NoteType::Hold)
-			{
-				playSE = context.score.holdNotes.at(note.ID).startType == HoldNoteType::Normal;
-			}
-			else if (note.getType() == NoteType::HoldEnd)
-			{
-				playSE = context.score.holdNotes.at(note.parentID).endType == HoldNoteType::Normal;
-			}
+		PROFILE_SCOPE("ScoreEditorTimeline::updateNoteSE");
 
-			if (playSE)
-			{
-				std::string_view se = getNoteSE(note, context.score);
-				std::string key = std::to_string(note.tick) + "-" + se.data();
-				if (!se.empty() && (playingNoteSounds.find(key) == playingNoteSounds.end()))
-				{
-					context.audio.playSoundEffect(se.data(), notePlayTime, -1, time);
-					playingNoteSounds.insert(key);
-				}
-			}
-		};
+		using SoundEvent = NoteSoundTimeline::Event;
+		NoteSoundTimeline& sounds = context.noteSounds;
+		sounds.setMetronome(config.metronome, context.audio.getMusicEndTime());
+		const bool rebuilt = sounds.isDirty();
+		if (rebuilt)
+			sounds.build(context.score);
+
+		const float lookAhead = audioLookAhead * playbackSpeed;
+		const float loopEndTime = loopStartTime + loopLength;
 
-		static auto holdNoteSEFunc = [&context, this](const Note& note, float startTime)
+		// Sounds are scheduled on the engine timeline, which keeps running across loop passes
+		const float elapsedTime = time + loopPass * loopLength;
+		auto playNoteSE = [&](const SoundEvent& event, int pass)
 		{
-			int endTick = context.score.notes.at(context.score.holdNotes.at(note.ID).end).tick;
-			float endTime = accumulateDuration(endTick, TICKS_PER_BEAT, context.score.tempoChanges);
+			const float startTime =
+			    event.time - playStartTime - audioOffsetCorrection + pass * loopLength;
+			context.audio.playSoundEffect(event.se, startTime, -1, elapsedTime);
+		};
 
-			float adjustedEndTime = endTime - playStartTime + audioOffsetCorrection;
-			context.audio.playSoundEffect(note.critical ? SE_CRITICAL_CONNECT : SE_CONNECT,
-			                              startTime, adjustedEndTime, time);
+		auto playHoldSE = [&](const SoundEvent& event, float startTime, int pass)
+		{
+			const float endTime = isLooping ? std::min(event.endTime, loopEndTime) : event.endTime;
+			const float adjustedEndTime =
+			    endTime - playStartTime + audioOffsetCorrection + pass * loopLength;
+			if (adjustedEndTime > startTime)
+				context.audio.playSoundEffect(event.se, startTime, adjustedEndTime, elapsedTime);
 		};
 
-		playingNoteSounds.clear();
-		for (const auto& [id, note] : context.score.notes)
+		if (time == playStartTime && loopPass == 0)
+		{
+			// Playback just started
+			const float windowEnd =
+			    isLooping ? std::min(time + lookAhead, loopEndTime) : time + lookAhead;
+			sounds.seek(time);
+			sounds.advance(
+			    windowEnd,
+			    [&](const SoundEvent& event)
+			    { context.audio.playSoundEffect(event.se, event.time - playStartTime, -1, time); },
+			    [](const SoundEvent&) {});
+
+			// Playback started mid-hold
+			sounds.forEachActiveHold(
+			    time, std::min(time + audioLookAhead, windowEnd), [&](const SoundEvent& event)
+			    { playHoldSE(event, std::max(0.0f, event.time - playStartTime), 0); });
+
+			schedulePass = 0;
+			scheduleTime = windowEnd;
+			sounds.seek(scheduleTime);
+			return;
+		}
+
+		// The cursors are lost after an edit
+		if (rebuilt)
+			sounds.seek(scheduleTime);
+
+		// Where the look ahead window ends once wrapped into the loop
+		int targetPass = loopPass;
+		float targetTime = time + lookAhead;
+		while (isLooping && targetTime >= loopEndTime)
+		{
+			targetTime -= loopLength;
+			++targetPass;
+		}
+
+		// Only events entering the look ahead window since the last frame are scheduled, a
+		// window crossing the loop end continues from the loop start on the next pass
+		while (schedulePass < targetPass || scheduleTime < targetTime)
 		{
-			float noteTime =
-			    accumulateDuration(note.tick, TICKS_PER_BEAT, context.score.tempoChanges);
-			float notePlayTime = noteTime - playStartTime;
-			float offsetNoteTime = noteTime - (audioLookAhead * playbackSpeed);
+			const float windowStart = scheduleTime;
+			const float windowEnd = schedulePass < targetPass ? loopEndTime : targetTime;
+			sounds.advance(
+			    windowEnd,
+			    [&](const SoundEvent& event)
+			    {
+				    if (event.time >= windowStart)
+					    playNoteSE(event, schedulePass);
+			    },
+			    [&](const SoundEvent& event)
+			    {
+				    if (event.time >= windowStart)
+					    playHoldSE(event, event.time - playStartTime - audioOffsetCorrection +
+					                          schedulePass * loopLength,
+					               schedulePass);
+			    });
 
-			if (offsetNoteTime >= timeLastFrame && offsetNoteTime < time)
+			if (schedulePass == targetPass)
 			{
-				singleNoteSEFunc(note, notePlayTime - audioOffsetCorrection);
-				if (note.getType() == NoteType::Hold &&
-				    !context.score.holdNotes.at(note.ID).isGuide())
-					holdNoteSEFunc(note, notePlayTime - audioOffsetCorrection);
+				scheduleTime = windowEnd;
+				break;
 			}
-			else if (time == playStartTime)
+
+			++schedulePass;
+			scheduleTime = loopStartTime;
+			sounds.seek(loopStartTime);
+
+			// Holds crossing the loop start sound again from it
+			sounds.forEachActiveHold(loopStartTime, std::nextafter(loopStartTime, -1.0f),
+			                         [&](const SoundEvent& event)
+			                         {
+				                         playHoldSE(event,
+				                                    loopStartTime - playStartTime -
+				                                        audioOffsetCorrection +
+				                                        schedulePass * loopLength,
+				                                    schedulePass);
+			                         });
+		}
+	}
+
+	bool ScoreEditorTimeline::isWaveformStripValid(const ScoreContext& context, int firstRow,
+	                                               int lastRow) const
+	{
+		const WaveformStrip& strip = waveformStrip;
+		if (strip.zoom != zoom || strip.musicOffset != context.workingData.musicOffset)
+			return false;
+
+		if (strip.versions[0] != context.waveformL.version ||
+		    strip.versions[1] != context.waveformR.version)
+			return false;
+
+		if (firstRow < strip.firstRow || lastRow >= strip.firstRow + strip.getRowCount())
+			return false;
+
+		return std::equal(context.score.tempoChanges.begin(), context.score.tempoChanges.end(),
+		                  strip.tempoChanges.begin(), strip.tempoChanges.end(),
+		                  [](const Tempo& a, const Tempo& b)
+		                  { return a.tick == b.tick && a.bpm == b.bpm; });
+	}
+
+	void ScoreEditorTimeline::updateWaveformStrip(const ScoreContext& context, int firstRow,
+	                                              int lastRow)
+	{
+		WaveformStrip& strip = waveformStrip;
+		strip.zoom = zoom;
+		strip.musicOffset = context.workingData.musicOffset;
+		strip.versions[0] = context.waveformL.version;
+		strip.versions[1] = context.waveformR.version;
+		strip.tempoChanges = context.score.tempoChanges;
+
+		// Keep a screen's worth of rows above and below so scrolling rarely rebuilds the strip
+		const int margin = lastRow - firstRow + 1;
+		strip.firstRow = firstRow - margin;
+		const int rowCount = lastRow + margin - strip.firstRow + 1;
+
+		const std::vector<double> rowSeconds = getRowSeconds(context, strip.firstRow, rowCount);
+		for (size_t index = 0; index < 2; index++)
+		{
+			const Audio::WaveformMipChain& waveform =
+			    index == 1 ? context.waveformR : context.waveformL;
+			std::vector<float>& amplitudes = strip.amplitudes[index];
+			amplitudes.assign(rowCount, 0.0f);
+			if (waveform.isEmpty())
+				continue;
+
+			for (int row = 0; row < rowCount; row++)
 			{
-				// Playback just started
-				if (noteTime >= time && offsetNoteTime < time)
-					singleNoteSEFunc(note, notePlayTime);
+				const double secondsAtPixel = rowSeconds[row];
+				if (secondsAtPixel < 0 || secondsAtPixel > waveform.durationInSeconds)
+					continue;
 
-				// Playback started mid-hold
-				if (note.getType() == NoteType::Hold &&
-				    !context.score.holdNotes.at(note.ID).isGuide())
-				{
-					int endTick =
-					    context.score.notes.at(context.score.holdNotes.at(note.ID).end).tick;
-					float endTime =
-					    accumulateDuration(endTick, TICKS_PER_BEAT, context.score.tempoChanges);
-					if ((noteTime - time) <= audioLookAhead && endTime > time)
-						holdNoteSEFunc(note, std::max(0.0f, notePlayTime));
-				}
+				// Cover the time until the next row so no peak falls between two rows
+				double secondsPerPixel = rowSeconds[row + 1] - secondsAtPixel;
+				if (secondsPerPixel <= 0)
+					secondsPerPixel = waveformSecondsPerPixel / zoom;
+
+				const Audio::WaveformMip& mip = waveform.findClosestMip(secondsPerPixel);
+				amplitudes[row] = waveform.getAmplitudeAt(mip, secondsAtPixel, secondsPerPixel);
 			}
 		}
 	}
 
+	std::vector<double> ScoreEditorTimeline::getRowSeconds(const ScoreContext& context,
+	                                                       int firstRow, int rowCount) const
+	{
+		const double musicOffsetInSeconds = context.workingData.musicOffset / 1000.0f;
+		std::vector<double> rowSeconds(rowCount + 1);
+		for (int row = 0; row <= rowCount; row++)
+		{
+			// Small accuracy loss by converting to ticks but shouldn't be too noticeable
+			const int tick = positionToTick(firstRow + row);
+			rowSeconds[row] = accumulateDuration(tick, TICKS_PER_BEAT, context.score.tempoChanges) -
+			                  musicOffsetInSeconds;
+		}
+
+		return rowSeconds;
+	}
+
 	void ScoreEditorTimeline::drawWaveform(ScoreContext& context)
 	{
+		PROFILE_SCOPE("ScoreEditorTimeline::drawWaveform");
+
 		ImDrawList* drawList = ImGui::GetWindowDrawList();
 		if (!drawList)
 			return;
@@ -3328,12 +3782,13 @@ namespace MikuMikuWorld
 		constexpr ImU32 waveformColorL = 0x80646464;
 		constexpr ImU32 waveformColorR = 0x80585858;
 
-		// Ideally this should be calculated based on the current BPM
-		const double secondsPerPixel = waveformSecondsPerPixel / zoom;
-		const double durationSeconds = context.waveformL.durationInSeconds;
-		const double musicOffsetInSeconds = context.workingData.musicOffset / 1000.0f;
+		const int firstRow = visualOffset - size.y;
+		const int lastRow = std::max(firstRow, static_cast<int>(std::ceil(visualOffset)) - 1);
+		if (!isWaveformStripValid(context, firstRow, lastRow))
+			updateWaveformStrip(context, firstRow, lastRow);
 
 		const float timelineMidPosition = midpoint(getTimelineStartX(), getTimelineEndX());
+		const float maxBarWidth = std::min(laneWidth * 6, 180.0f);
 
 		for (size_t index = 0; index < 2; index++)
 		{
@@ -3344,27 +3799,15 @@ namespace MikuMikuWorld
 				continue;
 
 			const ImU32 waveformColor = rightChannel ? waveformColorR : waveformColorL;
-			const Audio::WaveformMip& mip = waveform.findClosestMip(secondsPerPixel);
+			const std::vector<float>& amplitudes = waveformStrip.amplitudes[index];
 
-			for (int y = visualOffset - size.y; y < visualOffset; y += 1)
+			for (int y = firstRow; y < visualOffset; y += 1)
 			{
-				int tick = positionToTick(y);
-
-				// Small accuracy loss by converting to ticks but shouldn't be too noticeable
-				const double secondsAtPixel =
-				    accumulateDuration(tick, TICKS_PER_BEAT, context.score.tempoChanges) -
-				    musicOffsetInSeconds;
-				const bool outOfBounds =
-				    secondsAtPixel < 0 || secondsAtPixel > waveform.durationInSeconds;
-
-				float amplitude =
-				    std::max(waveform.getAmplitudeAt(mip, secondsAtPixel, secondsPerPixel), 0.0f);
-				float barValue = outOfBounds ? 0.0f : (amplitude * std::min(laneWidth * 6, 180.0f));
+				float barValue = amplitudes[y - waveformStrip.firstRow] * maxBarWidth;
 				float rectYPosition = floorf(position.y + visualOffset - y);
 				// WARNING: A thickness of 0.5 or less does not draw with integrated graphics
 				// (optimization? limitation?)
 
-				float timelineMidPosition = midpoint(getTimelineStartX(), getTimelineEndX());
 				ImVec2 rect1(timelineMidPosition, rectYPosition);
 				ImVec2 rect2(timelineMidPosition +
 				                 (std::max(0.75f, barValue) * (rightChannel ? 1 : -1)),
@@ -3374,6 +3817,132 @@ namespace MikuMikuWorld
 		}
 	}
 
+	bool ScoreEditorTimeline::isSpectrogramStripValid(const ScoreContext& context, int firstRow,
+	                                                  int lastRow) const
+	{
+		const SpectrogramStrip& strip = spectrogramStrip;
+		if (!strip.texture || strip.zoom != zoom ||
+		    strip.musicOffset != context.workingData.musicOffset ||
+		    strip.version != context.spectrogram.version)
+			return false;
+
+		if (firstRow < strip.firstRow || lastRow >= strip.firstRow + strip.rowCount)
+			return false;
+
+		return std::equal(context.score.tempoChanges.begin(), context.score.tempoChanges.end(),
+		                  strip.tempoChanges.begin(), strip.tempoChanges.end(),
+		                  [](const Tempo& a, const Tempo& b)
+		                  { return a.tick == b.tick && a.bpm == b.bpm; });
+	}
+
+	void ScoreEditorTimeline::updateSpectrogramStrip(const ScoreContext& context, int firstRow,
+	                                                 int lastRow)
+	{
+		using Spectrogram = Audio::SpectrogramMipChain;
+
+		// Transparent when quiet, then from blue to orange to white as the level rises
+		static const std::array<std::array<uint8_t, 4>, 256> palette = []
+		{
+			constexpr float stops[][4] = { { 0.05f, 0.05f, 0.30f, 0.00f },
+				                           { 0.20f, 0.20f, 0.85f, 0.55f },
+				                           { 0.95f, 0.45f, 0.15f, 0.85f },
+				                           { 1.00f, 1.00f, 0.85f, 0.95f } };
+			constexpr int segments = sizeof(stops) / sizeof(stops[0]) - 1;
+
+			std::array<std::array<uint8_t, 4>, 256> colors{};
+			for (int i = 0; i < 256; i++)
+			{
+				const float position = i / 255.0f * segments;
+				const int segment = std::min(static_cast<int>(position), segments - 1);
+				const float t = position - segment;
+				for (int channel = 0; channel < 4; channel++)
+				{
+					const float value =
+					    lerp(stops[segment][channel], stops[segment + 1][channel], t);
+					colors[i][channel] = static_cast<uint8_t>(value * 255.0f + 0.5f);
+				}
+			}
+
+			return colors;
+		}();
+
+		SpectrogramStrip& strip = spectrogramStrip;
+		const Spectrogram& spectrogram = context.spectrogram;
+		strip.zoom = zoom;
+		strip.musicOffset = context.workingData.musicOffset;
+		strip.version = spectrogram.version;
+		strip.tempoChanges = context.score.tempoChanges;
+
+		// Keep a screen's worth of rows above and below so scrolling rarely rebuilds the strip
+		const int margin = lastRow - firstRow + 1;
+		strip.firstRow = firstRow - margin;
+		strip.rowCount = lastRow + margin - strip.firstRow + 1;
+		strip.pixels.assign(static_cast<size_t>(strip.rowCount) * Spectrogram::bandCount * 4, 0);
+
+		// Only the mips are read here, the FFTs never run again for the same track
+		if (!spectrogram.isEmpty())
+		{
+			const std::vector<double> rowSeconds =
+			    getRowSeconds(context, strip.firstRow, strip.rowCount);
+			std::array<uint8_t, Spectrogram::bandCount> levels{};
+			for (int row = 0; row < strip.rowCount; row++)
+			{
+				const double secondsAtPixel = rowSeconds[row];
+				if (secondsAtPixel < 0)
+					continue;
+
+				double secondsPerPixel = rowSeconds[row + 1] - secondsAtPixel;
+				if (secondsPerPixel <= 0)
+					secondsPerPixel = waveformSecondsPerPixel / zoom;
+
+				const Audio::SpectrogramMip& mip = spectrogram.findClosestMip(secondsPerPixel);
+				spectrogram.levelsInTimeRange(mip, secondsAtPixel, secondsAtPixel + secondsPerPixel,
+				                              levels.data());
+
+				uint8_t* pixel = strip.pixels.data() + static_cast<size_t>(row) *
+				                                           Spectrogram::bandCount * 4;
+				for (size_t band = 0; band < Spectrogram::bandCount; band++, pixel += 4)
+					std::copy(palette[levels[band]].begin(), palette[levels[band]].end(), pixel);
+			}
+		}
+
+		if (strip.texture)
+			strip.texture->dispose();
+
+		strip.texture = std::make_unique<Texture>("spectrogram", Spectrogram::bandCount,
+		                                          strip.rowCount, strip.pixels.data());
+	}
+
+	void ScoreEditorTimeline::drawSpectrogram(ScoreContext& context)
+	{
+		PROFILE_SCOPE("ScoreEditorTimeline::drawSpectrogram");
+
+		ImDrawList* drawList = ImGui::GetWindowDrawList();
+		if (!drawList)
+			return;
+
+		context.updateSpectrogram();
+		if (context.spectrogram.isEmpty())
+			return;
+
+		const int firstRow = visualOffset - size.y;
+		const int lastRow = std::max(firstRow, static_cast<int>(std::ceil(visualOffset)) - 1);
+		if (!isSpectrogramStripValid(context, firstRow, lastRow))
+			updateSpectrogramStrip(context, firstRow, lastRow);
+
+		// Low frequencies on the left, ending right before the lanes
+		const float dpiScale = ImGui::GetMainViewport()->DpiScale;
+		const float x2 = getTimelineStartX(context.score) - (4 * dpiScale);
+		const float x1 = x2 - (spectrogramStripWidth * dpiScale);
+
+		// Rows go up the timeline while the texture's go down
+		const SpectrogramStrip& strip = spectrogramStrip;
+		const float v1 = (visualOffset - strip.firstRow) / strip.rowCount;
+		const float v2 = (visualOffset - size.y - strip.firstRow) / strip.rowCount;
+		drawList->AddImage((void*)strip.texture->getID(), ImVec2(x1, position.y),
+		                   ImVec2(x2, position.y + size.y), ImVec2(0.0f, v1), ImVec2(1.0f, v2));
+	}
+
 	void ScoreEditorTimeline::scrollTimeline(ScoreContext& context, const int tick)
 	{
 		context.currentTick = tick;
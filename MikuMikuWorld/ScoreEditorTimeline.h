@@ -91,8 +91,12 @@ namespace MikuMikuWorld
 		static constexpr float minZoom = 0.25f;
 		static constexpr float maxZoom = 1920.0f;
 		static constexpr double waveformSecondsPerPixel = 0.005;
+		static constexpr float spectrogramStripWidth = 96.0f;
 		static constexpr float noteControlWidth = 12;
 
+		// Maximum screen-space deviation in pixels between a hold curve and its slices
+		static constexpr float holdCurveTolerance = 0.5f;
+
 		static constexpr float minPlaybackSpeed = 0.25f;
 		static constexpr float maxPlaybackSpeed = 1.00f;
 
@@ -116,6 +120,12 @@ namespace MikuMikuWorld
 		bool skipUpdateAfterSortingSteps{ false };
 		bool dragging{ false };
 		bool insertingHold{ false };
+		bool renderingPreview{ false };
+		bool isHoveringCursor{ false };
+		bool isDraggingCursor{ false };
+
+		// Cursor tick the music was last scrubbed at, -1 while playing
+		int lastScrubTick{ -1 };
 
 		float time{};
 		float timeLastFrame{};
@@ -125,6 +135,21 @@ namespace MikuMikuWorld
 		float playbackSpeed{ 1.0f };
 		bool playing{ false };
 
+		// Loop region set from the timeline, played back while enabled
+		int loopStartTick{};
+		int loopEndTick{};
+		bool loopEnabled{ false };
+
+		// The loop being played, its length is what the music's loop rounded to frames lasts
+		bool isLooping{ false };
+		float loopStartTime{};
+		float loopLength{};
+		int loopPass{};
+
+		// Sound effects are scheduled up to a time in a pass of the loop
+		int schedulePass{};
+		float scheduleTime{};
+
 		Camera camera;
 		std::unique_ptr<Framebuffer> framebuffer;
 		ImVec2 size;
@@ -167,8 +192,37 @@ namespace MikuMikuWorld
 
 		} noteTransformOrigin;
 
+		// Normalized waveform amplitude of each timeline pixel row around the visible area
+		struct WaveformStrip
+		{
+			int firstRow{};
+			float zoom{};
+			float musicOffset{};
+			uint32_t versions[2]{};
+			std::vector<Tempo> tempoChanges;
+			std::vector<float> amplitudes[2];
+
+			int getRowCount() const { return static_cast<int>(amplitudes[0].size()); }
+		} waveformStrip;
+
+		// Spectrogram levels of the rows around the visible ones, uploaded as a texture
+		struct SpectrogramStrip
+		{
+			int firstRow{};
+			int rowCount{};
+			float zoom{};
+			float musicOffset{};
+			uint32_t version{};
+			std::vector<Tempo> tempoChanges;
+			std::vector<uint8_t> pixels;
+			std::unique_ptr<Texture> texture;
+		} spectrogramStrip;
+
 		std::vector<StepDrawData> drawSteps;
-		std::unordered_set<std::string> playingNoteSounds;
+		std::vector<id_t> holdQueryResults;
+		std::vector<id_t> noteQueryResults;
+		std::vector<id_t> notesNearMouse;
+		bool updateAllNotes{ false };
 		static constexpr float audioOffsetCorrection = 0.02f;
 		static constexpr float audioLookAhead = 0.05f;
 
@@ -176,6 +230,19 @@ namespace MikuMikuWorld
 		void updateScrollingPosition();
 
 		void drawWaveform(ScoreContext& context);
+		bool isWaveformStripValid(const ScoreContext& context, int firstRow, int lastRow) const;
+		void updateWaveformStrip(const ScoreContext& context, int firstRow, int lastRow);
+
+		/**
+		 * @brief Music time at the start of each row, with one more for the end of the last
+		 */
+		std::vector<double> getRowSeconds(const ScoreContext& context, int firstRow,
+		                                  int rowCount) const;
+
+		void drawSpectrogram(ScoreContext& context);
+		bool isSpectrogramStripValid(const ScoreContext& context, int firstRow,
+		                             int lastRow) const;
+		void updateSpectrogramStrip(const ScoreContext& context, int firstRow, int lastRow);
 
 		void drawHoldCurve(const Note& n1, const Note& n2, EaseType ease, bool isGuide,
 		                   Renderer* renderer, const Color& tint, const int offsetTick = 0,
@@ -230,6 +297,10 @@ namespace MikuMikuWorld
 		void insertDamage(ScoreContext& context, EditArgs& edit);
 
 		void updateNoteSE(ScoreContext& context);
+		void restartPlayback(ScoreContext& context);
+
+		void findNotesNearMouse(ScoreContext& context);
+		bool isNoteNearMouse(const Note& note) const;
 
 		void contextMenu(ScoreContext& context);
 
@@ -289,11 +360,17 @@ namespace MikuMikuWorld
 		void setDivision(int div) { division = std::clamp(div, 4, 1920); }
 
 		constexpr inline bool isMouseInTimeline() const { return mouseInTimeline; }
+		inline int getFirstVisibleTick() const
+		{
+			return std::max(0, positionToTick(visualOffset - size.y));
+		}
+		inline int getLastVisibleTick() const { return positionToTick(visualOffset); }
 		bool isNoteVisible(const Note& note, int offsetTicks = 0) const;
 
 		int findClosestHold(ScoreContext& context, int lane, int tick);
 		bool isMouseInHoldPath(const Note& n1, const Note& n2, EaseType ease, float x, float y);
 		constexpr inline bool isPlaying() const { return playing; }
+		bool isAnimating() const;
 		void setPlaying(ScoreContext& context, bool state);
 		void stop(ScoreContext& context);
 		void calculateMaxOffsetFromScore(const Score& score);
@@ -317,6 +394,21 @@ namespace MikuMikuWorld
 
 		void scrollTimeline(ScoreContext& context, const int tick);
 
+		/**
+		 * @brief Loop playback between two ticks, restarting it from the current time if playing
+		 */
+		void setLoopRegion(ScoreContext& context, int startTick, int endTick);
+		void setLoopEnabled(ScoreContext& context, bool enabled);
+		constexpr inline bool hasLoopRegion() const { return loopEndTick > loopStartTick; }
+		constexpr inline bool isLoopEnabled() const { return loopEnabled; }
+
+		/**
+		 * @brief Rasterize the notes between two ticks on the CPU and save them as a PNG image.
+		 * Does not touch OpenGL so it also works without a visible timeline.
+		 */
+		Result renderPreviewImage(ScoreContext& context, Renderer* renderer, int startTick,
+		                          int endTick, const std::string& filename);
+
 		ScoreEditorTimeline();
 	};
 }
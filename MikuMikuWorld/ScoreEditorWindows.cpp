@@ -1,9 +1,11 @@
 #include "ScoreEditorWindows.h"
 #include "Application.h"
 #include "ApplicationConfiguration.h"
+#include "Audio/AudioCache.h"
 #include "Constants.h"
 #include "File.h"
 #include "NoteTypes.h"
+#include "Profiler.h"
 #include "ScoreContext.h"
 #include "UI.h"
 #include "Utilities.h"
@@ -73,6 +75,25 @@ namespace MikuMikuWorld
 				}
 			}
 
+			const bool isMusicOpening = context.audio.isMusicLoadPending();
+			if (isMusicOpening || context.audio.musicStream->isScanning())
+			{
+				// The waveform is built after the music is swapped in, both count as loading
+				const float progress =
+				    isMusicOpening ? 0.0f : context.audio.musicStream->getScanProgress();
+				UI::propertyLabel(getString("music_loading"));
+				ImGui::ProgressBar(progress,
+				                   { ImGui::GetContentRegionAvail().x - UI::btnSmall.x -
+				                         ImGui::GetStyle().ItemSpacing.x,
+				                     UI::btnSmall.y },
+				                   isMusicOpening ? "..." : nullptr);
+				ImGui::SameLine();
+				if (ImGui::Button(ICON_FA_TIMES "##cancel_music_load", UI::btnSmall))
+					isPendingCancelMusicLoad = true;
+
+				ImGui::NextColumn();
+			}
+
 			float offset = context.workingData.musicOffset;
 			UI::addDragFloatProperty(getString("music_offset"), offset, "%.3fms");
 			if (offset != context.workingData.musicOffset)
@@ -81,6 +102,8 @@ namespace MikuMikuWorld
 				context.audio.setMusicOffset(context.getTimeAtCurrentTick(), offset);
 			}
 
+			updateTempoEstimate(context);
+
 			// volume controls
 			float master = context.audio.getMasterVolume();
 			float bgm = context.audio.getMusicVolume();
@@ -120,6 +143,90 @@ namespace MikuMikuWorld
 		}
 	}
 
+	void ScorePropertiesWindow::updateTempoAnalysis()
+	{
+		// Joined once, the result stays finished until the next estimate
+		if (!tempoAnalysis.isRunning() || !tempoAnalysis.isFinished())
+			return;
+
+		Result result = tempoAnalysis.finish();
+		hasTempoEstimate = result.isOk();
+		if (result.getStatus() == ResultStatus::Error)
+			IO::messageBox(APP_NAME, result.getMessage(), IO::MessageBoxButtons::Ok,
+			               IO::MessageBoxIcon::Error);
+	}
+
+	void ScorePropertiesWindow::updateTempoEstimate(ScoreContext& context)
+	{
+		if (!context.audio.isMusicInitialized())
+			return;
+
+		if (tempoAnalysis.isRunning())
+		{
+			UI::propertyLabel(getString("estimating_tempo"));
+			ImGui::ProgressBar(tempoAnalysis.getProgress(),
+			                   { ImGui::GetContentRegionAvail().x - UI::btnSmall.x -
+			                         ImGui::GetStyle().ItemSpacing.x,
+			                     UI::btnSmall.y });
+			ImGui::SameLine();
+			if (ImGui::Button(ICON_FA_TIMES "##cancel_tempo_estimate", UI::btnSmall))
+				tempoAnalysis.cancel();
+
+			ImGui::NextColumn();
+			return;
+		}
+
+		UI::propertyLabel("");
+		if (ImGui::Button(getString("estimate_tempo"), { -1, UI::btnSmall.y }))
+		{
+			// The decoded copy in the cache skips decoding compressed music a second time
+			std::string filename =
+			    Audio::AudioCache::findPcm(context.audio.musicStream->sourceHash);
+			if (filename.empty())
+				filename = context.workingData.musicFilename;
+
+			hasTempoEstimate = false;
+			estimatedMusicFilename = context.workingData.musicFilename;
+			tempoAnalysis.start(filename);
+		}
+		ImGui::NextColumn();
+
+		if (!hasTempoEstimate || estimatedMusicFilename != context.workingData.musicFilename)
+			return;
+
+		const Audio::TempoEstimate& estimate = tempoAnalysis.getEstimate();
+		UI::addReadOnlyProperty(getString("estimated_bpm"),
+		                        IO::formatString("%.2f", estimate.bpm));
+		UI::addReadOnlyProperty(getString("estimated_offset"),
+		                        IO::formatString("%.3fms", estimate.offset));
+		UI::addReadOnlyProperty(getString("tempo_confidence"),
+		                        IO::formatString("%.0f%%", estimate.confidence * 100.0f));
+
+		const std::vector<float>& onsets = tempoAnalysis.getOnsets();
+		UI::propertyLabel(getString("onsets"));
+		ImGui::PlotLines("##onsets", onsets.data(), static_cast<int>(onsets.size()), 0, nullptr,
+		                 0.0f, 1.0f, { -1, UI::btnSmall.y * 2 });
+		ImGui::NextColumn();
+
+		// The music offset isn't part of the score's history, so it is applied on its own
+		const float buttonWidth =
+		    (ImGui::GetContentRegionAvail().x - ImGui::GetStyle().ItemSpacing.x) / 2;
+		UI::propertyLabel("");
+		if (ImGui::Button(getString("apply_estimated_bpm"), { buttonWidth, UI::btnSmall.y }))
+		{
+			Score prev = context.score;
+			context.score.tempoChanges[0].bpm = std::clamp(estimate.bpm, MIN_BPM, MAX_BPM);
+			context.pushHistory("Change tempo", prev, context.score);
+		}
+		ImGui::SameLine();
+		if (ImGui::Button(getString("apply_estimated_offset"), { -1, UI::btnSmall.y }))
+		{
+			context.workingData.musicOffset = estimate.offset;
+			context.audio.setMusicOffset(context.getTimeAtCurrentTick(), estimate.offset);
+		}
+		ImGui::NextColumn();
+	}
+
 	void ScoreNotePropertiesWindow::update(ScoreContext& context)
 	{
 		auto numSelected = context.selectedNotes.size() + context.selectedHiSpeedChanges.size();
@@ -1129,7 +1236,8 @@ namespace MikuMikuWorld
 		return DialogResult::None;
 	}
 
-	void DebugWindow::update(ScoreContext& context, ScoreEditorTimeline& timeline)
+	void DebugWindow::update(ScoreContext& context, ScoreEditorTimeline& timeline,
+	                         Renderer* renderer)
 	{
 		if (ImGui::Begin(IMGUI_TITLE(ICON_FA_BUG, "debug")))
 		{
@@ -1153,7 +1261,7 @@ namespace MikuMikuWorld
 					UI::beginPropertyColumns();
 					UI::addReadOnlyProperty("Music Initialized",
 					                        boolToString(context.audio.isMusicInitialized()));
-					UI::addReadOnlyProperty("Music Filename", context.audio.musicBuffer.name);
+					UI::addReadOnlyProperty("Music Filename", context.audio.musicStream->name);
 
 					float musicTime = context.audio.getMusicPosition(),
 					      musicLength = context.audio.getMusicLength();
@@ -1167,11 +1275,30 @@ namespace MikuMikuWorld
 					        musicLengthSeconds,
 					        static_cast<int>((musicLength - musicLengthSeconds) * 100)));
 
-					UI::addReadOnlyProperty("Sample Rate", context.audio.musicBuffer.sampleRate);
+					UI::addReadOnlyProperty("Sample Rate", context.audio.musicStream->sampleRate);
 					UI::addReadOnlyProperty("Effective Sample Rate",
-					                        context.audio.musicBuffer.effectiveSampleRate);
+					                        context.audio.musicStream->effectiveSampleRate);
 					UI::addReadOnlyProperty("Channel Count",
-					                        context.audio.musicBuffer.channelCount);
+					                        context.audio.musicStream->channelCount);
+					UI::addReadOnlyProperty("Underrun Frames",
+					                        context.audio.musicStream->getUnderrunFrames());
+					UI::addReadOnlyProperty(
+					    "Time Stretch Load",
+					    IO::formatString("%.2f%%", context.audio.getTimeStretchLoad() * 100));
+					UI::endPropertyColumns();
+				}
+
+				if (ImGui::CollapsingHeader("Sound Effects", headerFlags))
+				{
+					const Audio::SoundEffectMixer::Stats stats =
+					    context.audio.getSoundEffectStats();
+					UI::beginPropertyColumns();
+					UI::addReadOnlyProperty("Active Voices", stats.activeVoices);
+					UI::addReadOnlyProperty("Peak Voices", stats.peakVoices);
+					UI::addReadOnlyProperty("Voice Budget", Audio::SoundEffectMixer::voiceBudget);
+					UI::addReadOnlyProperty("Stolen Voices", stats.stolenVoices);
+					UI::addReadOnlyProperty("Late Voices", stats.lateVoices);
+					UI::addReadOnlyProperty("Dropped Events", stats.droppedEvents);
 					UI::endPropertyColumns();
 				}
 
@@ -1183,22 +1310,20 @@ namespace MikuMikuWorld
 					UI::addReadOnlyProperty("Waveform L Mip Count",
 					                        context.waveformL.getUsedMipCount());
 					UI::addReadOnlyProperty("Waveform L Samples",
-					                        context.waveformL.mips->absoluteSamples.size());
+					                        context.waveformL.getBaseSampleCount());
 					UI::addReadOnlyProperty("Waveform R",
 					                        boolToString(!context.waveformR.isEmpty()));
 					UI::addReadOnlyProperty("Waveform R Mip Count",
 					                        context.waveformR.getUsedMipCount());
 					UI::addReadOnlyProperty("Waveform R Samples",
-					                        context.waveformL.mips->absoluteSamples.size());
+					                        context.waveformR.getBaseSampleCount());
+					UI::addReadOnlyProperty("Waveform Generating",
+					                        boolToString(context.waveformL.isGenerating() ||
+					                                     context.waveformR.isGenerating()));
 					UI::endPropertyColumns();
 
 					if (ImGui::Button("Re-Generate Waveform", { -1, UI::btnSmall.y }))
-					{
-						context.waveformL.generateMipChainsFromSampleBuffer(
-						    context.audio.musicBuffer, 0);
-						context.waveformR.generateMipChainsFromSampleBuffer(
-						    context.audio.musicBuffer, 1);
-					}
+						context.generateWaveforms();
 				}
 
 				if (ImGui::CollapsingHeader("Sound Test", headerFlags))
@@ -1267,9 +1392,50 @@ namespace MikuMikuWorld
 				ImGui::TreePop();
 			}
 
+			if (ImGui::TreeNodeEx("Frames", treeNodeFlags))
+			{
+				const FrameStatistics& stats = Application::frameStatistics;
+				UI::beginPropertyColumns();
+				UI::addReadOnlyProperty("Idle Throttling", boolToString(config.idleThrottling));
+				UI::addReadOnlyProperty("Redraws Per Second", stats.framesPerSecond);
+				UI::addReadOnlyProperty("Idle Ratio",
+				                        IO::formatString("%.1f%%", stats.idleRatio * 100));
+				UI::addReadOnlyProperty("Total Frames", stats.totalFrames);
+				UI::addReadOnlyProperty("Total Idle Waits", stats.totalIdleWaits);
+				UI::addReadOnlyProperty("Total Idle Time",
+				                        IO::formatString("%.1fs", stats.totalIdleSeconds));
+				UI::endPropertyColumns();
+				ImGui::TreePop();
+			}
+
+			if (ImGui::TreeNodeEx("Profiler", treeNodeFlags))
+			{
+				updateProfiler();
+				ImGui::TreePop();
+			}
+
 			if (ImGui::TreeNodeEx("Timeline", treeNodeFlags))
 			{
 				timeline.debug(context);
+
+				if (ImGui::Button("Export Preview Image", { -1, UI::btnSmall.y }))
+				{
+					IO::FileDialog fileDialog{};
+					fileDialog.title = "Export Preview Image";
+					fileDialog.filters = { { "PNG Image", "*.png" } };
+					fileDialog.defaultExtension = "png";
+					fileDialog.parentWindowHandle = Application::windowState.windowHandle;
+
+					if (fileDialog.saveFile() == IO::FileDialogResult::OK)
+					{
+						Result result = timeline.renderPreviewImage(
+						    context, renderer, timeline.getFirstVisibleTick(),
+						    timeline.getLastVisibleTick(), fileDialog.outputFilename);
+						if (!result.isOk())
+							IO::messageBox(APP_NAME, result.getMessage(), IO::MessageBoxButtons::Ok,
+							               IO::MessageBoxIcon::Error);
+					}
+				}
 				ImGui::TreePop();
 			}
 		}
@@ -1277,6 +1443,120 @@ namespace MikuMikuWorld
 		ImGui::End();
 	}
 
+	void DebugWindow::updateProfiler()
+	{
+		bool enabled = Profiler::isEnabled();
+		if (ImGui::Checkbox("Enabled", &enabled))
+			Profiler::setEnabled(enabled);
+
+		ImGui::SameLine();
+		bool paused = Profiler::isPaused();
+		if (ImGui::Checkbox("Paused", &paused))
+			Profiler::setPaused(paused);
+
+		const size_t frameCount = Profiler::getRecordedFrameCount();
+		if (frameCount == 0)
+			return;
+
+		// Oldest frame first so the plot scrolls to the left
+		float maxFrameTime = 0.0f, totalFrameTime = 0.0f;
+		profilerFrameTimes.resize(frameCount);
+		for (size_t age = 0; age < frameCount; ++age)
+		{
+			const float frameTime = Profiler::getFrame(age).duration * 1000.0;
+			profilerFrameTimes[frameCount - 1 - age] = frameTime;
+			maxFrameTime = std::max(maxFrameTime, frameTime);
+			totalFrameTime += frameTime;
+		}
+
+		std::string overlay = IO::formatString("avg %.2fms, max %.2fms",
+		                                       totalFrameTime / frameCount, maxFrameTime);
+		ImGui::PlotLines("##profiler_frame_times", profilerFrameTimes.data(),
+		                 profilerFrameTimes.size(), 0, overlay.c_str(), 0.0f, maxFrameTime,
+		                 { -1, 80 });
+
+		// Pick the frame shown below by clicking on the plot
+		if (ImGui::IsItemHovered() && ImGui::IsMouseDown(ImGuiMouseButton_Left))
+		{
+			const float ratio = (ImGui::GetMousePos().x - ImGui::GetItemRectMin().x) /
+			                    std::max(1.0f, ImGui::GetItemRectSize().x);
+			const int index = std::clamp(static_cast<int>(ratio * frameCount), 0,
+			                             static_cast<int>(frameCount) - 1);
+			profilerFrameAge = static_cast<int>(frameCount) - 1 - index;
+			Profiler::setPaused(true);
+		}
+
+		if (!Profiler::isPaused())
+			profilerFrameAge = 0;
+
+		profilerFrameAge = std::clamp(profilerFrameAge, 0, static_cast<int>(frameCount) - 1);
+		const ProfileFrame& frame = Profiler::getFrame(profilerFrameAge);
+		ImGui::Text("Frame %llu: %.3fms", static_cast<unsigned long long>(frame.index),
+		            frame.duration * 1000.0);
+
+		int maxDepth = 0;
+		for (const ProfileEvent& event : frame.events)
+			maxDepth = std::max(maxDepth, event.depth);
+
+		// Flame graph, one row per nesting level with the frame spanning the whole width
+		const float rowHeight = ImGui::GetFrameHeight();
+		const ImVec2 graphPos = ImGui::GetCursorScreenPos();
+		const ImVec2 graphSize{ std::max(ImGui::GetContentRegionAvail().x, 1.0f),
+			                    rowHeight * (maxDepth + 1) };
+		ImGui::InvisibleButton("##profiler_flame_graph", graphSize);
+		const bool graphHovered = ImGui::IsItemHovered();
+
+		ImDrawList* drawList = ImGui::GetWindowDrawList();
+		drawList->AddRectFilled(graphPos, graphPos + graphSize, 0xff202020);
+		drawList->PushClipRect(graphPos, graphPos + graphSize, true);
+
+		const double frameDuration = std::max(frame.duration, 1e-9);
+		for (const ProfileEvent& event : frame.events)
+		{
+			const ImVec2 min{
+				graphPos.x + static_cast<float>((event.start - frame.start) / frameDuration) *
+				                 graphSize.x,
+				graphPos.y + event.depth * rowHeight
+			};
+			const ImVec2 max{ std::max(min.x + 1.0f,
+				                       min.x + static_cast<float>(event.duration / frameDuration) *
+				                                   graphSize.x),
+				              min.y + rowHeight - 1.0f };
+
+			const ImU32 hue = static_cast<ImU32>(ImHashStr(event.name));
+			const ImU32 color = IM_COL32(0x60 + (hue & 0x7f), 0x60 + ((hue >> 8) & 0x7f),
+			                             0x60 + ((hue >> 16) & 0x3f), 0xff);
+			drawList->AddRectFilled(min, max, color);
+
+			ImVec4 clipRect{ min.x, min.y, max.x, max.y };
+			drawList->AddText(ImGui::GetFont(), ImGui::GetFontSize(),
+			                  { min.x + 2.0f, min.y + ImGui::GetStyle().FramePadding.y },
+			                  0xff000000, event.name, nullptr, 0.0f, &clipRect);
+
+			if (graphHovered && ImGui::IsMouseHoveringRect(min, max))
+				ImGui::SetTooltip("%s\n%.3fms", event.name, event.duration * 1000.0);
+		}
+
+		drawList->PopClipRect();
+
+		if (ImGui::Button("Save Trace", { -1, UI::btnSmall.y }))
+		{
+			IO::FileDialog fileDialog{};
+			fileDialog.title = "Save Trace";
+			fileDialog.filters = { { "Chrome Trace", "*.json" } };
+			fileDialog.defaultExtension = "json";
+			fileDialog.parentWindowHandle = Application::windowState.windowHandle;
+
+			if (fileDialog.saveFile() == IO::FileDialogResult::OK)
+			{
+				Result result = Profiler::writeChromeTrace(fileDialog.outputFilename);
+				if (!result.isOk())
+					IO::messageBox(APP_NAME, result.getMessage(), IO::MessageBoxButtons::Ok,
+					               IO::MessageBoxIcon::Error);
+			}
+		}
+	}
+
 	void SettingsWindow::updateKeyConfig(MultiInputBinding* bindings[], int count)
 	{
 		ImVec2 size = ImVec2(-1, ImGui::GetContentRegionAvail().y * 0.7);
@@ -1630,6 +1910,8 @@ namespace MikuMikuWorld
 						ImGui::Separator();
 
 						UI::addCheckboxProperty(getString("draw_waveform"), config.drawWaveform);
+						UI::addCheckboxProperty(getString("draw_spectrogram"),
+						                        config.drawSpectrogram);
 						UI::addCheckboxProperty(getString("return_to_last_tick"),
 						                        config.returnToLastSelectedTickOnPause);
 						UI::addCheckboxProperty(getString("cursor_auto_scroll"),
@@ -1664,6 +1946,11 @@ namespace MikuMikuWorld
 						UI::addSelectProperty(getString("notes_se"), config.seProfileIndex,
 						                      Audio::soundEffectsProfileNames,
 						                      Audio::soundEffectsProfileCount);
+						UI::addCheckboxProperty(getString("preserve_pitch"), config.preservePitch);
+						UI::addCheckboxProperty(getString("scrub_audio"), config.scrubAudio);
+						UI::addCheckboxProperty(getString("metronome"), config.metronome);
+						UI::addCheckboxProperty(getString("render_metronome"),
+						                        config.renderMetronome);
 						UI::endPropertyColumns();
 					}
 
@@ -1699,6 +1986,8 @@ namespace MikuMikuWorld
 
 						UI::addPercentSliderProperty(getString("background_brightnes"),
 						                             config.backgroundBrightness);
+						UI::addPercentSliderProperty(getString("background_blur"),
+						                             config.backgroundBlur);
 						ImGui::Separator();
 
 						UI::addPercentSliderProperty(getString("lanes_opacity"),
@@ -1,4 +1,5 @@
 #pragma once
+#include "Audio/TempoAnalysis.h"
 #include "InputBinding.h"
 #include "NotesPreset.h"
 #include "ScoreEditorTimeline.h"
@@ -18,10 +19,26 @@ namespace MikuMikuWorld
 
 	class ScorePropertiesWindow
 	{
+	  private:
+		Audio::TempoAnalysis tempoAnalysis;
+		bool hasTempoEstimate{ false };
+		// The estimate is hidden once another music file is opened
+		std::string estimatedMusicFilename{};
+
+		void updateTempoEstimate(ScoreContext& context);
+
 	  public:
 		std::string pendingLoadMusicFilename{};
 		bool isPendingLoadMusic{ false };
+		bool isPendingCancelMusicLoad{ false };
 		void update(ScoreContext& context);
+
+		// Called every frame so the analysis is joined even while the audio section is collapsed
+		void updateTempoAnalysis();
+		inline bool isEstimatingTempo() const
+		{
+			return tempoAnalysis.isRunning() && !tempoAnalysis.isFinished();
+		}
 	};
 
 	class ScoreNotePropertiesWindow
@@ -52,8 +69,14 @@ namespace MikuMikuWorld
 
 	class DebugWindow
 	{
+	  private:
+		std::vector<float> profilerFrameTimes;
+		int profilerFrameAge{};
+
+		void updateProfiler();
+
 	  public:
-		void update(ScoreContext& context, ScoreEditorTimeline& timeline);
+		void update(ScoreContext& context, ScoreEditorTimeline& timeline, Renderer* renderer);
 	};
 
 	class SettingsWindow
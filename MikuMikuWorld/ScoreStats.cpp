@@ -1,6 +1,7 @@
 #include "ScoreStats.h"
 #include "Score.h"
 #include "Constants.h"
+#include "Profiler.h"
 #include <algorithm>
 
 namespace MikuMikuWorld
@@ -19,6 +20,7 @@ namespace MikuMikuWorld
 
 	void ScoreStats::calculateStats(const Score& score)
 	{
+		PROFILE_SCOPE("ScoreStats::calculateStats");
 		hispeeds = score.hiSpeedChanges.size();
 
 		taps = std::count_if(score.notes.begin(), score.notes.end(),
@@ -1,10 +1,26 @@
 #include "Application.h"
 #include "IO.h"
+#include <cerrno>
+#include <climits>
+#include <cwchar>
 #include <iostream>
 
 namespace mmw = MikuMikuWorld;
 mmw::Application app;
 
+// Typos are rejected instead of being read as tick 0
+static bool parseTick(const wchar_t* text, int& tick)
+{
+	wchar_t* end{};
+	errno = 0;
+	const long value = std::wcstol(text, &end, 10);
+	if (end == text || *end != L'\0' || errno == ERANGE || value < 0 || value > INT_MAX)
+		return false;
+
+	tick = static_cast<int>(value);
+	return true;
+}
+
 int main()
 {
 	int argc;
@@ -22,6 +38,28 @@ int main()
 	{
 #endif
 		std::string dir = IO::File::getFilepath(IO::wideStringToMb(args[0]));
+
+		// MikuMikuWorld.exe --render-audio <score> <output.wav>
+		if (argc == 4 && std::wstring_view(args[1]) == L"--render-audio")
+			return mmw::Application::renderAudio(dir, IO::wideStringToMb(args[2]),
+			                                     IO::wideStringToMb(args[3]));
+
+		// MikuMikuWorld.exe --render-preview <score> <start tick> <end tick> <output.png>
+		if (argc == 6 && std::wstring_view(args[1]) == L"--render-preview")
+		{
+			int startTick{}, endTick{};
+			if (!parseTick(args[3], startTick) || !parseTick(args[4], endTick))
+			{
+				mmw::Application::attachParentConsole();
+				fprintf(stderr, "Usage: MikuMikuWorld.exe --render-preview <score> <start tick> "
+				                "<end tick> <output.png>\n");
+				return 1;
+			}
+
+			return mmw::Application::renderPreview(dir, IO::wideStringToMb(args[2]), startTick,
+			                                       endTick, IO::wideStringToMb(args[5]));
+		}
+
 		mmw::Result result = app.initialize(dir);
 
 		if (!result.isOk())
@@ -70,10 +108,12 @@ LRESULT CALLBACK wndProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 
 	case WM_ENTERSIZEMOVE:
 		mmw::Application::windowState.windowDragging = true;
+		::SetTimer(hwnd, mmw::Application::windowState.windowTimerId, USER_TIMER_MINIMUM, nullptr);
 		break;
 
 	case WM_EXITSIZEMOVE:
 		mmw::Application::windowState.windowDragging = false;
+		::KillTimer(hwnd, mmw::Application::windowState.windowTimerId);
 		break;
 
 	case WM_DROPFILES: